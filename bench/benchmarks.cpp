@@ -0,0 +1,977 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <thread>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <dlfcn.h>
+
+#include "expr_node.hpp"
+#include "tokenizer.hpp"
+#include "expression_builder.hpp"
+#include "differentiator.hpp"
+#include "reverse_differentiator.hpp"
+#include "simplifier.hpp"
+#include "tape.hpp"
+#include "batch_evaluator.hpp"
+#include "forward_evaluator.hpp"
+#include "higher_order.hpp"
+#include "canonicalizer.hpp"
+#include "tree_printer.hpp"
+#include "stream_processor.hpp"
+#include "code_generator.hpp"
+#include "graph_file.hpp"
+#include "jacobian.hpp"
+#include "sparsity.hpp"
+#include "checkpoint.hpp"
+
+using namespace autodiff;
+
+namespace {
+    // Variables may only contain letters, so number them in base 26.
+    std::string variableName(int index) {
+        std::string name = "v";
+        do {
+            name += static_cast<char>('a' + index % 26);
+            index /= 26;
+        } while (index > 0);
+        return name;
+    }
+
+    // A chain of coupled terms: every variable appears in two neighbouring terms.
+    std::string chainExpression(int numVars) {
+        std::string expr;
+        for (int i = 0; i < numVars; ++i) {
+            std::string a = variableName(i);
+            std::string b = variableName((i + 1) % numVars);
+            if (i > 0) {
+                expr += "+";
+            }
+            expr += "sin(" + a + "*" + b + ")+" + a + "^2*ln(" + b + ")";
+        }
+        return expr;
+    }
+
+    // An expression parsed into a freshly cleared pool, with its variables
+    // sorted by name.
+    struct Fixture {
+        ExprNodePtr root;
+        std::vector<SymbolId> vars;
+    };
+
+    Fixture parseFixture(const std::string& expr) {
+        ExprPool::current().clear();
+        Tokenizer tokenizer(expr);
+        ExpressionBuilder builder(tokenizer);
+        ExprNodePtr root = builder.build();
+        std::vector<SymbolId> vars = tokenizer.getVariables();
+        sortByName(vars);
+        return { root, vars };
+    }
+
+    struct RunResult {
+        double millis;
+        size_t nodes;
+    };
+
+    RunResult run(const std::string& expr, bool perVariable) {
+        auto [root, vars] = parseFixture(expr);
+
+        Simplifier simplifier;
+        auto start = std::chrono::steady_clock::now();
+        std::vector<ExprNodePtr> derivatives;
+        if (perVariable) {
+            Differentiator differentiator;
+            for (SymbolId var : vars) {
+                derivatives.push_back(differentiator.differentiate(root, var));
+            }
+        } else {
+            ReverseDifferentiator reverse;
+            derivatives = reverse.gradient(root, vars);
+        }
+        for (ExprNodePtr& diff : derivatives) {
+            diff = simplifier.simplify(diff);
+        }
+        auto end = std::chrono::steady_clock::now();
+        return { std::chrono::duration<double, std::milli>(end - start).count(), ExprPool::current().size() };
+    }
+
+    // The chain plus a few functions it does not otherwise use, compiled
+    // together with its gradient, as benchBatch and benchCodegen evaluate it.
+    struct GradientTape {
+        std::vector<SymbolId> vars;
+        std::vector<ExprNodePtr> roots; // the value, then one partial per variable
+        Tape tape;
+    };
+
+    GradientTape gradientTape(int numVars) {
+        std::string expr = chainExpression(numVars) + "+exp(" + variableName(0) + ")/tan(" + variableName(1)
+            + ")+pow(" + variableName(2) + ",3)";
+        auto [root, vars] = parseFixture(expr);
+
+        Simplifier simplifier;
+        std::vector<ExprNodePtr> roots = { root };
+        ReverseDifferentiator reverse;
+        for (ExprNodePtr diff : reverse.gradient(root, vars)) {
+            roots.push_back(simplifier.simplify(diff));
+        }
+        Tape tape = TapeCompiler(vars).compile(roots);
+        return { vars, roots, tape };
+    }
+
+    // Input of variable v at point p, inside the domain of ln.
+    double samplePoint(size_t v, size_t p) {
+        return 0.5 + std::fmod(0.37 * p + 0.91 * v, 3.0);
+    }
+}
+
+static void benchGradient() {
+    std::cout << "vars\tper-variable ms\treverse ms\tspeedup\tper-variable nodes\treverse nodes" << std::endl;
+    for (int numVars : { 10, 50, 200, 1000 }) {
+        std::string expr = chainExpression(numVars);
+        RunResult forward = run(expr, true);
+        RunResult reverse = run(expr, false);
+        std::cout << numVars << "\t" << forward.millis << "\t" << reverse.millis << "\t"
+                  << forward.millis / reverse.millis << "\t" << forward.nodes << "\t" << reverse.nodes << std::endl;
+    }
+}
+
+// Evaluates value plus gradient through a compiled tape at many points.
+static void benchTape() {
+    std::cout << "vars\tinstructions\tregisters\tevaluations/s" << std::endl;
+    for (int numVars : { 10, 50, 200 }) {
+        std::string expr = chainExpression(numVars);
+        auto [root, vars] = parseFixture(expr);
+
+        Simplifier simplifier;
+        std::vector<ExprNodePtr> roots = { root };
+        ReverseDifferentiator reverse;
+        for (ExprNodePtr diff : reverse.gradient(root, vars)) {
+            roots.push_back(simplifier.simplify(diff));
+        }
+        Tape tape = TapeCompiler(vars).compile(roots);
+
+        std::vector<double> inputs(vars.size(), 1.5);
+        std::vector<double> outputs(roots.size());
+        const int evaluations = 2000000 / numVars;
+        double checksum = 0.0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < evaluations; ++i) {
+            inputs[i % inputs.size()] += 1e-9;
+            tape.evaluate(inputs.data(), outputs.data());
+            checksum += outputs[0];
+        }
+        auto end = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(end - start).count();
+        std::cout << numVars << "\t" << tape.getInstructions().size() << "\t" << tape.numRegisters() << "\t"
+                  << evaluations / seconds << (checksum == 0.0 ? " (!)" : "") << std::endl;
+    }
+}
+
+// Value plus gradient at many points: scalar tape loop versus column batches.
+static void benchBatch() {
+    const size_t numPoints = 50000;
+    std::cout << "vars\tpath\tpoints/s\tmax rel. error" << std::endl;
+    for (int numVars : { 10, 50 }) {
+        GradientTape gradient = gradientTape(numVars);
+        const std::vector<SymbolId>& vars = gradient.vars;
+        const std::vector<ExprNodePtr>& roots = gradient.roots;
+        Tape& tape = gradient.tape;
+
+        std::vector<std::vector<double>> inputs(vars.size(), std::vector<double>(numPoints));
+        for (size_t v = 0; v < vars.size(); ++v) {
+            for (size_t p = 0; p < numPoints; ++p) {
+                inputs[v][p] = samplePoint(v, p);
+            }
+        }
+
+        // Reference: one Tape::evaluate per point, gathering the row from the columns.
+        std::vector<std::vector<double>> expected(roots.size(), std::vector<double>(numPoints));
+        std::vector<double> point(vars.size());
+        std::vector<double> values(roots.size());
+        auto start = std::chrono::steady_clock::now();
+        for (size_t p = 0; p < numPoints; ++p) {
+            for (size_t v = 0; v < vars.size(); ++v) {
+                point[v] = inputs[v][p];
+            }
+            tape.evaluate(point.data(), values.data());
+            for (size_t k = 0; k < roots.size(); ++k) {
+                expected[k][p] = values[k];
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << numVars << "\ttape\t" << numPoints / seconds << "\t0" << std::endl;
+
+        std::vector<const double*> columns;
+        for (const auto& column : inputs) {
+            columns.push_back(column.data());
+        }
+        std::vector<std::vector<double>> results(roots.size(), std::vector<double>(numPoints));
+        std::vector<double*> outputs;
+        for (auto& column : results) {
+            outputs.push_back(column.data());
+        }
+        for (SimdLevel level : { SimdLevel::SCALAR, SimdLevel::AVX2, SimdLevel::AVX512 }) {
+            if (level > BatchEvaluator::bestSimdLevel()) {
+                continue;
+            }
+            BatchEvaluator batch(tape, level);
+            start = std::chrono::steady_clock::now();
+            batch.evaluate(columns, outputs, numPoints);
+            seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            double maxError = 0.0;
+            for (size_t k = 0; k < roots.size(); ++k) {
+                for (size_t p = 0; p < numPoints; ++p) {
+                    double scale = std::max(1.0, std::fabs(expected[k][p]));
+                    maxError = std::max(maxError, std::fabs(results[k][p] - expected[k][p]) / scale);
+                }
+            }
+            std::cout << numVars << "\tbatch-" << BatchEvaluator::getLevelName(level) << "\t"
+                      << numPoints / seconds << "\t" << maxError << std::endl;
+        }
+    }
+}
+
+// Generated C kernels, built with the system compiler ($CC, default cc) and
+// loaded with dlopen, checked against the tape interpreter on the same points.
+// The strict build must match the tape to rounding; the -ffast-math build is
+// timed and only has to stay close. Returns false if a kernel cannot be built
+// or loaded, or disagrees with the tape.
+static bool benchCodegen() {
+    const size_t numPoints = 50000;
+    const char* compiler = std::getenv("CC") ? std::getenv("CC") : "cc";
+    struct Build {
+        const char* name;
+        const char* flags;
+        double tolerance; // max relative error against the tape
+    };
+    const Build builds[] = {
+        { "c", "-O2 -ffp-contract=off", 1e-12 },
+        { "c-fast", "-O3 -ffast-math -march=native", 1e-6 },
+    };
+    char directory[] = "/tmp/autodiff-XXXXXX";
+    if (!mkdtemp(directory)) {
+        std::cout << "codegen: cannot create a temporary directory" << std::endl;
+        return false;
+    }
+    bool ok = true;
+    std::cout << "vars\tpath\tpoints/s\tmax rel. error" << std::endl;
+    for (int numVars : { 10, 50 }) {
+        GradientTape gradient = gradientTape(numVars);
+        const std::vector<SymbolId>& vars = gradient.vars;
+        const std::vector<ExprNodePtr>& roots = gradient.roots;
+        Tape& tape = gradient.tape;
+
+        CodeOptions options;
+        options.batched = true;
+        std::string base = std::string(directory) + "/grad" + std::to_string(numVars);
+        {
+            std::ofstream source(base + ".c");
+            source << CodeGenerator().generate(tape, vars, options);
+        }
+
+        std::vector<double> inputs(vars.size() * numPoints); // rows, as grad() takes them
+        std::vector<const double*> columns;
+        std::vector<std::vector<double>> columnData(vars.size(), std::vector<double>(numPoints));
+        for (size_t v = 0; v < vars.size(); ++v) {
+            for (size_t p = 0; p < numPoints; ++p) {
+                inputs[p * vars.size() + v] = columnData[v][p] = samplePoint(v, p);
+            }
+            columns.push_back(columnData[v].data());
+        }
+        std::vector<double> expected(roots.size() * numPoints);
+        std::vector<double> actual(roots.size() * numPoints);
+        auto maxError = [&]() {
+            double error = 0.0;
+            for (size_t i = 0; i < expected.size(); ++i) {
+                double difference = std::fabs(actual[i] - expected[i]) / std::max(1.0, std::fabs(expected[i]));
+                error = std::isnan(difference) ? difference : std::max(error, difference);
+            }
+            return error;
+        };
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t p = 0; p < numPoints; ++p) {
+            tape.evaluate(&inputs[p * vars.size()], &expected[p * roots.size()]);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << numVars << "\ttape\t" << numPoints / seconds << "\t0" << std::endl;
+
+        for (const Build& build : builds) {
+            std::string library = base + "-" + build.name + ".so";
+            std::string command = std::string(compiler) + " " + build.flags + " -shared -fPIC " + base + ".c -o "
+                + library + " -lm";
+            void* handle = std::system(command.c_str()) == 0 ? dlopen(library.c_str(), RTLD_NOW) : nullptr;
+            typedef void (*Kernel)(const double*, double*);
+            typedef void (*BatchKernel)(const double* const*, double* const*, size_t);
+            Kernel kernel = handle ? reinterpret_cast<Kernel>(dlsym(handle, "grad")) : nullptr;
+            BatchKernel batchKernel = handle ? reinterpret_cast<BatchKernel>(dlsym(handle, "grad_batch")) : nullptr;
+            if (!kernel || !batchKernel) {
+                std::cout << numVars << "\t" << build.name << ": could not build or load " << library << "  FAILED"
+                          << std::endl;
+                ok = false;
+                if (handle) {
+                    dlclose(handle);
+                }
+                std::remove(library.c_str());
+                continue;
+            }
+
+            start = std::chrono::steady_clock::now();
+            for (size_t p = 0; p < numPoints; ++p) {
+                kernel(&inputs[p * vars.size()], &actual[p * roots.size()]);
+            }
+            seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            double error = maxError();
+            bool accurate = error <= build.tolerance;
+            std::cout << numVars << "\t" << build.name << "\t" << numPoints / seconds << "\t" << error
+                      << (accurate ? "" : "  FAILED") << std::endl;
+
+            std::vector<std::vector<double>> results(roots.size(), std::vector<double>(numPoints));
+            std::vector<double*> outputs;
+            for (auto& column : results) {
+                outputs.push_back(column.data());
+            }
+            start = std::chrono::steady_clock::now();
+            batchKernel(columns.data(), outputs.data(), numPoints);
+            seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            for (size_t k = 0; k < roots.size(); ++k) {
+                for (size_t p = 0; p < numPoints; ++p) {
+                    actual[p * roots.size() + k] = results[k][p];
+                }
+            }
+            double batchError = maxError();
+            bool batchAccurate = batchError <= build.tolerance;
+            std::cout << numVars << "\t" << build.name << "-batch\t" << numPoints / seconds << "\t" << batchError
+                      << (batchAccurate ? "" : "  FAILED") << std::endl;
+            ok = ok && accurate && batchAccurate;
+            dlclose(handle);
+            std::remove(library.c_str());
+        }
+        std::remove((base + ".c").c_str());
+    }
+    std::remove(directory);
+    return ok;
+}
+
+// One-off gradient at a single point: dual numbers versus building, simplifying
+// and compiling the symbolic gradient first.
+static void benchForward() {
+    std::cout << "vars\tsymbolic+tape us\tdual us\tmax abs. diff" << std::endl;
+    for (int numVars : { 2, 4, 8, 50 }) {
+        std::string expr = chainExpression(numVars);
+        auto [root, vars] = parseFixture(expr);
+        std::vector<double> inputs(vars.size());
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            inputs[i] = 0.5 + 0.1 * i;
+        }
+
+        const int repeats = 200;
+        std::vector<double> symbolic(vars.size() + 1);
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < repeats; ++r) {
+            Simplifier simplifier;
+            std::vector<ExprNodePtr> roots = { root };
+            ReverseDifferentiator reverse;
+            for (ExprNodePtr diff : reverse.gradient(root, vars)) {
+                roots.push_back(simplifier.simplify(diff));
+            }
+            Tape tape = TapeCompiler(vars).compile(roots);
+            tape.evaluate(inputs.data(), symbolic.data());
+        }
+        double symbolicMicros = std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - start).count() / repeats;
+
+        std::vector<double> dual;
+        start = std::chrono::steady_clock::now();
+        for (int r = 0; r < repeats; ++r) {
+            dual = forwardGradient(root, vars, inputs);
+        }
+        double dualMicros = std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - start).count() / repeats;
+
+        double maxDiff = 0.0;
+        for (size_t i = 0; i < dual.size(); ++i) {
+            maxDiff = std::max(maxDiff, std::fabs(dual[i] - symbolic[i]));
+        }
+        std::cout << numVars << "\t" << symbolicMicros << "\t" << dualMicros << "\t" << maxDiff << std::endl;
+    }
+}
+
+// Full Hessian: differentiating each first derivative again per entry versus
+// the memoized higher-order differentiator.
+static void benchHessian() {
+    std::cout << "vars\tnaive ms\tmemoized ms\tnaive nodes\tmemoized nodes" << std::endl;
+    for (int numVars : { 5, 20, 50 }) {
+        std::string expr = chainExpression(numVars);
+        double millis[2];
+        size_t nodes[2];
+        for (int memoized = 0; memoized < 2; ++memoized) {
+            auto [root, vars] = parseFixture(expr);
+
+            auto start = std::chrono::steady_clock::now();
+            std::vector<ExprNodePtr> entries;
+            if (memoized) {
+                HigherOrderDifferentiator higherOrder;
+                Hessian hessian = higherOrder.hessian(root, vars);
+                for (const auto& row : hessian.entries) {
+                    entries.insert(entries.end(), row.begin(), row.end());
+                }
+            } else {
+                Differentiator differentiator;
+                Simplifier simplifier;
+                for (SymbolId x : vars) {
+                    for (SymbolId y : vars) {
+                        ExprNodePtr first = simplifier.simplify(differentiator.differentiate(root, x));
+                        entries.push_back(simplifier.simplify(differentiator.differentiate(first, y)));
+                    }
+                }
+            }
+            millis[memoized] = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+            nodes[memoized] = countNodes(entries);
+        }
+        std::cout << numVars << "\t" << millis[0] << "\t" << millis[1] << "\t" << nodes[0] << "\t" << nodes[1]
+                  << std::endl;
+    }
+}
+
+// Getting a saved gradient back: re-parsing its printed text, against
+// mapping a graph file with and without checking the checksum, then
+// building the nodes from the mapped table.
+static void benchGraphFile() {
+    std::cout << "vars\ttext MB\tfile MB\treparse ms\tmap ms\tmap+verify ms\tload ms" << std::endl;
+    char directory[] = "/tmp/autodiff-XXXXXX";
+    if (!mkdtemp(directory)) {
+        std::cout << "(no temporary directory)" << std::endl;
+        return;
+    }
+    std::string path = std::string(directory) + "/gradient.adg";
+    for (int numVars : { 1000, 20000, 100000 }) {
+        auto [built, vars] = parseFixture(chainExpression(numVars));
+        Simplifier simplifier;
+        ExprNodePtr root = simplifier.simplify(built);
+        std::vector<ExprNodePtr> derivatives = ReverseDifferentiator().gradient(root, vars);
+        for (ExprNodePtr& diff : derivatives) {
+            diff = simplifier.simplify(diff);
+        }
+        std::vector<std::string> texts = { TreePrinter().print(root) };
+        size_t textBytes = texts[0].size();
+        for (ExprNodePtr diff : derivatives) {
+            texts.push_back(TreePrinter().print(diff));
+            textBytes += texts.back().size();
+        }
+        writeGraph(path, root, vars, derivatives);
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        double fileMegabytes = static_cast<double>(file.tellg()) / 1e6;
+
+        ExprPool::current().clear();
+        auto start = std::chrono::steady_clock::now();
+        size_t parsed = 0;
+        for (const std::string& text : texts) {
+            Tokenizer textTokenizer(text);
+            parsed += ExpressionBuilder(textTokenizer).build() != nullptr;
+        }
+        auto reparsed = std::chrono::steady_clock::now();
+        MappedGraph graph;
+        bool mapped = graph.open(path, false);
+        auto opened = std::chrono::steady_clock::now();
+        bool verified = graph.open(path, true);
+        auto checked = std::chrono::steady_clock::now();
+        ExprPool::current().clear();
+        std::vector<SymbolId> loadedVars;
+        std::vector<ExprNodePtr> loaded = graph.load(loadedVars);
+        auto end = std::chrono::steady_clock::now();
+
+        bool ok = parsed == texts.size() && mapped && verified && loadedVars == vars && loaded.size() == texts.size()
+            && TreePrinter().print(loaded.back()) == texts.back();
+        auto millis = [](auto from, auto to) { return std::chrono::duration<double, std::milli>(to - from).count(); };
+        std::cout << numVars << "\t" << textBytes / 1e6 << "\t" << fileMegabytes << "\t" << millis(start, reparsed)
+                  << "\t" << millis(reparsed, opened) << "\t" << millis(opened, checked) << "\t"
+                  << millis(checked, end) << (ok ? "" : " (!)") << std::endl;
+    }
+    std::remove(path.c_str());
+    std::remove(directory);
+}
+
+// A system whose outputs share one chain of terms: output k multiplies the
+// chain by its own variable. Going through it line by line parses and
+// differentiates the chain once per output; the joint Jacobian does it once.
+static void benchJacobian() {
+    std::cout << "outputs\tvars\tper-output ms\tjoint ms\tspeedup\tper-output nodes\tjoint nodes" << std::endl;
+    for (int numVars : { 20, 50, 150 }) {
+        std::string chain = chainExpression(numVars);
+        std::string text;
+        for (int k = 0; k < numVars; ++k) {
+            text += variableName(k) + " = (" + chain + ")*" + variableName(k) + "+exp(" + chain + ")\n";
+        }
+
+        // Today: one expression at a time, each with its own gradient.
+        ExprPool::current().clear();
+        auto start = std::chrono::steady_clock::now();
+        std::vector<ExprNodePtr> separate;
+        std::vector<ExprNodePtr> separateValues;
+        std::vector<SymbolId> vars;
+        std::istringstream lines(text);
+        std::string line;
+        while (std::getline(lines, line)) {
+            std::string expr = line.substr(line.find('=') + 1);
+            Tokenizer tokenizer(expr);
+            ExpressionBuilder builder(tokenizer);
+            Simplifier simplifier;
+            ExprNodePtr root = simplifier.simplify(builder.build());
+            vars = tokenizer.getVariables();
+            sortByName(vars);
+            for (ExprNodePtr diff : ReverseDifferentiator().gradient(root, vars)) {
+                separate.push_back(simplifier.simplify(diff));
+            }
+            separateValues.push_back(root);
+        }
+        double separateMillis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+            .count();
+        size_t separateNodes = countNodes(separate);
+
+        ExprPool::current().clear();
+        start = std::chrono::steady_clock::now();
+        std::istringstream input(text);
+        ExpressionSystem system;
+        readSystem(input, system);
+        system.outputs = Simplifier().simplify(system.outputs);
+        Jacobian jacobian = JacobianBuilder().build(system.outputs, system.vars);
+        double jointMillis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+            .count();
+
+        // Both must agree at a point; the separate run's nodes are gone, so
+        // compare against the joint result rebuilt from the same text.
+        std::vector<double> point(system.vars.size());
+        for (size_t i = 0; i < point.size(); ++i) {
+            point[i] = 0.5 + 0.001 * static_cast<double>(i);
+        }
+        std::vector<double> values(jacobian.entries.size());
+        TapeCompiler(system.vars).compile(jacobian.entries).evaluate(point.data(), values.data());
+        std::vector<ExprNodePtr> reference;
+        for (ExprNodePtr output : system.outputs) {
+            for (ExprNodePtr diff : ReverseDifferentiator().gradient(output, system.vars)) {
+                reference.push_back(diff);
+            }
+        }
+        std::vector<double> expected(reference.size());
+        TapeCompiler(system.vars).compile(reference).evaluate(point.data(), expected.data());
+        bool ok = vars == system.vars && separate.size() == jacobian.entries.size();
+        for (size_t i = 0; ok && i < values.size(); ++i) {
+            ok = std::fabs(values[i] - expected[i]) <= 1e-9 * std::max(1.0, std::fabs(expected[i]));
+        }
+        std::cout << numVars << "\t" << numVars << "\t" << separateMillis << "\t" << jointMillis << "\t"
+                  << separateMillis / jointMillis << "\t" << separateNodes << "\t" << jacobian.nodeCount
+                  << (ok ? "" : " (!)") << std::endl;
+    }
+}
+
+// Numeric Jacobian and Hessian of banded problems: one forward sweep per
+// variable against one per color. The pattern column is the time to find
+// the nonzeros and color them; sweeps are lanes, eight to a pass.
+static void benchSparsity() {
+    std::cout << "matrix\tvars\tnonzeros\tpattern ms\tdense sweeps\tdense ms\tcolored sweeps\tcolored ms\tspeedup"
+              << std::endl;
+    auto millis = [](auto from, auto to) { return std::chrono::duration<double, std::milli>(to - from).count(); };
+    for (int numVars : { 100, 1000, 2000 }) {
+        for (int hessian = 0; hessian < 2; ++hessian) {
+            ExprPool::current().clear();
+            std::vector<SymbolId> vars;
+            for (int i = 0; i < numVars; ++i) {
+                vars.push_back(internSymbol(variableName(i)));
+            }
+            sortByName(vars);
+            std::vector<double> point(vars.size());
+            for (size_t i = 0; i < point.size(); ++i) {
+                point[i] = 0.5 + 0.001 * static_cast<double>(i);
+            }
+
+            // Row i couples a variable with its two neighbours.
+            std::vector<ExprNodePtr> outputs;
+            ExprNodePtr root = nullptr;
+            std::string chain = chainExpression(numVars);
+            if (hessian) {
+                Tokenizer tokenizer(chain);
+                root = ExpressionBuilder(tokenizer).build();
+            } else {
+                for (int i = 0; i < numVars; ++i) {
+                    std::string expr = "sin(" + variableName(i) + "*" + variableName((i + 1) % numVars) + ")+"
+                        + variableName((i + numVars - 1) % numVars) + "^2";
+                    Tokenizer tokenizer(expr);
+                    outputs.push_back(ExpressionBuilder(tokenizer).build());
+                }
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            SparsityPattern pattern = hessian ? hessianPattern(root, vars) : jacobianPattern(outputs, vars);
+            std::vector<std::uint32_t> colors = hessian ? starColor(pattern) : colorColumns(pattern);
+            auto colored = std::chrono::steady_clock::now();
+            std::vector<std::uint32_t> ownColor(vars.size());
+            for (size_t i = 0; i < ownColor.size(); ++i) {
+                ownColor[i] = static_cast<std::uint32_t>(i);
+            }
+            SparseMatrix dense = hessian ? sparseHessian(root, vars, point, pattern, ownColor)
+                                         : sparseJacobian(outputs, vars, point, pattern, ownColor);
+            auto denseEnd = std::chrono::steady_clock::now();
+            SparseMatrix compressed = hessian ? sparseHessian(root, vars, point, pattern, colors)
+                                              : sparseJacobian(outputs, vars, point, pattern, colors);
+            auto end = std::chrono::steady_clock::now();
+
+            bool ok = true;
+            for (size_t k = 0; k < dense.values.size(); ++k) {
+                double expected = dense.values[k];
+                ok = ok && std::fabs(compressed.values[k] - expected) <= 1e-9 * std::max(1.0, std::fabs(expected));
+            }
+            double denseMillis = millis(colored, denseEnd);
+            double coloredMillis = millis(denseEnd, end);
+            std::cout << (hessian ? "hessian" : "jacobian") << "\t" << numVars << "\t" << pattern.nonzeros() << "\t"
+                      << millis(start, colored) << "\t" << vars.size() << "\t" << denseMillis << "\t"
+                      << colorCount(colors) << "\t" << coloredMillis << "\t" << denseMillis / coloredMillis
+                      << (ok ? "" : " (!)") << std::endl;
+        }
+    }
+}
+
+// Numeric reverse sweeps of one large tape under shrinking memory budgets:
+// the register and adjoint files, which every budget has to hold, plus room
+// for all of the recording down to a small fraction of it.
+static void benchCheckpoint() {
+    std::cout << "instructions\trecording share\tbudget KB\tchunks\tsnapshots\trecompute\tpeak KB\tms" << std::endl;
+    auto [root, vars] = parseFixture(chainExpression(50000));
+    Tape tape = TapeCompiler(vars).compile(root);
+    std::vector<double> point(vars.size());
+    for (size_t i = 0; i < point.size(); ++i) {
+        point[i] = 0.5 + 1e-5 * static_cast<double>(i);
+    }
+
+    size_t files = 2 * tape.numRegisters() * sizeof(double);
+    size_t recording = tape.getInstructions().size() * 2 * sizeof(double);
+    std::vector<double> expected(vars.size());
+    std::vector<double> gradient(vars.size());
+    for (size_t divisor : { 1, 4, 16, 64, 256, 4096 }) {
+        size_t budget = files + recording / divisor;
+        CheckpointedReverse reverse(tape, budget);
+        double value = 0.0;
+        auto start = std::chrono::steady_clock::now();
+        bool ran = reverse.gradient(point.data(), value, divisor == 1 ? expected.data() : gradient.data());
+        double millis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        bool ok = ran;
+        for (size_t i = 0; ok && divisor > 1 && i < vars.size(); ++i) {
+            ok = gradient[i] == expected[i];
+        }
+        const CheckpointStats& stats = reverse.getStats();
+        std::cout << stats.instructions << "\t1/" << divisor << "\t" << budget / 1024 << "\t" << stats.chunks << "\t"
+                  << stats.snapshotsUsed << "\t" << stats.recomputeFactor << "\t" << stats.peakBytes / 1024 << "\t"
+                  << millis << (ok ? "" : " (!)") << std::endl;
+    }
+}
+
+// Node counts of simplified gradients before and after canonicalization.
+static void benchCanonical() {
+    std::cout << "vars\tsimplified nodes\tcanonical nodes\tcanonicalize ms" << std::endl;
+    for (int numVars : { 10, 50, 200 }) {
+        std::string expr = chainExpression(numVars) + "+" + variableName(0) + "*" + variableName(1) + "*3*"
+            + variableName(0) + "^(2-1)";
+        auto [root, vars] = parseFixture(expr);
+
+        Simplifier simplifier;
+        Canonicalizer canonicalizer;
+        ReverseDifferentiator reverse;
+        size_t before = 0;
+        size_t after = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (ExprNodePtr diff : reverse.gradient(root, vars)) {
+            canonicalizer.canonicalize(simplifier.simplify(diff));
+            before += canonicalizer.getLastStats().nodesBefore;
+            after += canonicalizer.getLastStats().nodesAfter;
+        }
+        double millis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << numVars << "\t" << before << "\t" << after << "\t" << millis << std::endl;
+    }
+}
+
+// Tokenizer and parser throughput on large inputs: tokenizing into a list,
+// parsing that list, and parsing straight from the tokenizer.
+static void benchParse() {
+    std::cout << "MB\ttokens\ttokenize MB/s\tparse MB/s\tstreaming MB/s" << std::endl;
+    for (int numVars : { 1000, 20000, 100000 }) {
+        ExprPool::current().clear();
+        std::string expr = chainExpression(numVars);
+        double megabytes = expr.size() / 1e6;
+
+        auto start = std::chrono::steady_clock::now();
+        Tokenizer tokenizer(expr);
+        std::vector<Token> tokens = tokenizer.tokenize();
+        auto tokenized = std::chrono::steady_clock::now();
+        size_t numTokens = tokens.size();
+        ExpressionBuilder builder(std::move(tokens));
+        ExprNodePtr root = builder.build();
+        auto parsed = std::chrono::steady_clock::now();
+
+
+        ExprPool::current().clear();
+        Tokenizer streamTokenizer(expr);
+        ExpressionBuilder streamBuilder(streamTokenizer);
+        ExprNodePtr streamRoot = streamBuilder.build();
+        auto streamed = std::chrono::steady_clock::now();
+
+        double tokenizeSeconds = std::chrono::duration<double>(tokenized - start).count();
+        double parseSeconds = std::chrono::duration<double>(parsed - tokenized).count();
+        double streamSeconds = std::chrono::duration<double>(streamed - parsed).count();
+        std::cout << megabytes << "\t" << numTokens << "\t" << megabytes / tokenizeSeconds << "\t"
+                  << megabytes / parseSeconds << "\t" << megabytes / streamSeconds
+                  << (root && streamRoot ? "" : " (!)") << std::endl;
+    }
+}
+
+// Printing a gradient: a fresh string per derivative, appending every
+// derivative to one reused buffer, and writing through an ostream.
+static void benchPrint() {
+    std::cout << "vars\toutput MB\tstring MB/s\tappend MB/s\tostream MB/s" << std::endl;
+    for (int numVars : { 1000, 20000, 100000 }) {
+        auto [root, vars] = parseFixture(chainExpression(numVars));
+        Simplifier simplifier;
+        ReverseDifferentiator reverse;
+        std::vector<ExprNodePtr> derivatives = reverse.gradient(root, vars);
+        derivatives.push_back(root);
+        for (ExprNodePtr& diff : derivatives) {
+            diff = simplifier.simplify(diff);
+        }
+
+        TreePrinter printer;
+        std::string buffer;
+        std::ostringstream stream;
+        size_t bytes = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (ExprNodePtr diff : derivatives) {
+            bytes += printer.print(diff).size();
+        }
+        auto strings = std::chrono::steady_clock::now();
+        for (ExprNodePtr diff : derivatives) {
+            printer.print(diff, buffer);
+        }
+        auto appended = std::chrono::steady_clock::now();
+        for (ExprNodePtr diff : derivatives) {
+            printer.print(diff, stream);
+        }
+        auto streamed = std::chrono::steady_clock::now();
+
+        double megabytes = bytes / 1e6;
+        auto rate = [megabytes](auto from, auto to) { return megabytes / std::chrono::duration<double>(to - from).count(); };
+        std::cout << numVars << "\t" << megabytes << "\t" << rate(start, strings) << "\t" << rate(strings, appended)
+                  << "\t" << rate(appended, streamed)
+                  << (buffer.size() == bytes && stream.str().size() == bytes ? "" : " (!)") << std::endl;
+    }
+}
+
+// The node pool on a parsed, differentiated and simplified gradient: bytes
+// per node including the intern table, building into an empty pool and into
+// one kept from the previous round, and the cost of clear().
+static void benchPool() {
+    std::cout << "vars\tnodes\tnode bytes\tpool bytes/node\tcold Mnodes/s\twarm Mnodes/s\tclear us" << std::endl;
+    for (int numVars : { 1000, 20000, 100000 }) {
+        std::string expr = chainExpression(numVars);
+        auto build = [&expr] {
+            Tokenizer tokenizer(expr);
+            ExpressionBuilder builder(tokenizer);
+            ExprNodePtr root = builder.build();
+            std::vector<SymbolId> vars = tokenizer.getVariables();
+            sortByName(vars);
+            Simplifier simplifier;
+            std::vector<ExprNodePtr> derivatives = ReverseDifferentiator().gradient(root, vars);
+            for (ExprNodePtr& diff : derivatives) {
+                diff = simplifier.simplify(diff);
+            }
+            return ExprPool::current().size();
+        };
+        ExprPool& pool = ExprPool::current();
+        pool.release();
+        auto start = std::chrono::steady_clock::now();
+        size_t nodes = build();
+        auto cold = std::chrono::steady_clock::now();
+        size_t bytes = pool.capacityBytes();
+        pool.clear();
+        auto cleared = std::chrono::steady_clock::now();
+        size_t again = build();
+        auto warm = std::chrono::steady_clock::now();
+
+        auto seconds = [](auto from, auto to) { return std::chrono::duration<double>(to - from).count(); };
+        std::cout << numVars << "\t" << nodes << "\t" << sizeof(ExprNode) << "\t"
+                  << static_cast<double>(bytes) / nodes << "\t" << nodes / seconds(start, cold) / 1e6 << "\t"
+                  << nodes / seconds(cleared, warm) / 1e6 << "\t" << seconds(cold, cleared) * 1e6
+                  << (again == nodes ? "" : " (!)") << std::endl;
+    }
+}
+
+// Deeply nested input, sin(sin(...sin(x)...)): every pass has to run in
+// bounded stack space. The printed expression is the input itself.
+static void benchDepth() {
+    std::cout << "depth\tparse ms\tsimplify ms\tdifferentiate ms\tprint ms" << std::endl;
+    for (int depth : { 1000, 100000, 1000000 }) {
+        ExprPool::current().clear();
+        std::string expr;
+        expr.reserve(5 * static_cast<size_t>(depth) + 1);
+        for (int i = 0; i < depth; ++i) {
+            expr += "sin(";
+        }
+        expr += "x";
+        expr.append(depth, ')');
+
+        auto start = std::chrono::steady_clock::now();
+        Tokenizer tokenizer(expr);
+        ExpressionBuilder builder(tokenizer);
+        ExprNodePtr root = builder.build();
+        auto parsed = std::chrono::steady_clock::now();
+        Simplifier simplifier;
+        root = simplifier.simplify(root);
+        auto simplified = std::chrono::steady_clock::now();
+        Differentiator differentiator;
+        ExprNodePtr derivative = differentiator.differentiate(root, tokenizer.getVariables()[0]);
+        auto differentiated = std::chrono::steady_clock::now();
+        std::string printed = TreePrinter().print(root);
+        auto end = std::chrono::steady_clock::now();
+
+        auto millis = [](auto from, auto to) { return std::chrono::duration<double, std::milli>(to - from).count(); };
+        std::cout << depth << "\t" << millis(start, parsed) << "\t" << millis(parsed, simplified) << "\t"
+                  << millis(simplified, differentiated) << "\t" << millis(differentiated, end)
+                  << (derivative && printed == expr ? "" : " (!)") << std::endl;
+    }
+}
+
+// Many small expressions through the --batch pipeline, output kept in memory:
+// each format serially, then the default format on a growing thread pool.
+static void benchStream() {
+    const int numLines = 100000;
+    std::string input;
+    for (int i = 0; i < numLines; ++i) {
+        std::string k = std::to_string(i % 97 + 2);
+        input += "x*y^" + k + "+sin(x*z)/" + k + "-exp(y*z)*ln(x+" + k + ")\n";
+    }
+    double megabytes = input.size() / 1e6;
+
+    std::cout << "format\tlines\tlines/s\tinput MB/s\toutput MB" << std::endl;
+    const std::pair<const char*, OutputFormat> formats[] = {
+        { "text", OutputFormat::TEXT }, { "tsv", OutputFormat::TSV }, { "json", OutputFormat::JSON }
+    };
+    for (const auto& format : formats) {
+        StreamOptions options;
+        options.format = format.second;
+        StreamProcessor processor(options);
+        std::istringstream in(input);
+        std::ostringstream out;
+        auto start = std::chrono::steady_clock::now();
+        size_t failures = processor.run(in, out);
+        auto end = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(end - start).count();
+        std::cout << format.first << "\t" << numLines << "\t" << numLines / seconds << "\t"
+                  << megabytes / seconds << "\t" << out.str().size() / 1e6
+                  << (failures == 0 ? "" : " (!)") << std::endl;
+    }
+
+    std::cout << "threads\tlines/s\tspeedup" << std::endl;
+    size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    double serialRate = 0;
+    for (size_t threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+        ParallelStreamProcessor processor(StreamOptions(), threads);
+        std::istringstream in(input);
+        std::ostringstream out;
+        auto start = std::chrono::steady_clock::now();
+        size_t failures = processor.run(in, out);
+        auto end = std::chrono::steady_clock::now();
+        double rate = numLines / std::chrono::duration<double>(end - start).count();
+        if (threads == 1) {
+            serialRate = rate;
+        }
+        std::cout << threads << "\t" << rate << "\t" << rate / serialRate
+                  << (failures == 0 ? "" : " (!)") << std::endl;
+        if (threads == maxThreads) {
+            break;
+        }
+    }
+}
+
+// Not a benchmark: constants that outgrow int64, printed and read back,
+// must come back as the same exact value.
+static bool checkNumbers() {
+    std::cout << "Number round trip" << std::endl;
+    Number big = Number(std::int64_t(9223372036854775807)) + Number(1);
+    Number wide;
+    Number::parse("99999999999999999999", wide);
+    Number third = Number(1) / Number(3);
+    Number power;
+    Number::pow(Number(-3), Number(41), power);
+    std::vector<Number> values = { big, -big - Number(1), wide, wide / Number(7), Number(1) / wide, third * wide,
+                                   power, Number(2) / power, -wide * wide };
+    bool ok = true;
+    Simplifier simplifier;
+    TreePrinter printer;
+    for (const Number& value : values) {
+        ExprPool::current().clear();
+        std::string text = printer.print(buildNumber(value));
+        Tokenizer tokenizer(text);
+        ExpressionBuilder builder(tokenizer);
+        ExprNodePtr parsed = builder.build();
+        parsed = parsed ? simplifier.simplify(parsed) : nullptr;
+        bool same = parsed && parsed->type == NodeType::NUMBER && parsed->number == value;
+        ok = ok && same;
+        std::cout << "  " << text << (same ? "  ok" : "  FAILED") << std::endl;
+    }
+    return ok;
+}
+
+// Runs every section in turn, or only the one named on the command line.
+// Exits nonzero if a check fails.
+int main(int argc, char** argv) {
+    typedef bool (*Section)();
+    const std::pair<const char*, Section> sections[] = {
+        { "numbers", checkNumbers },
+        { "parse", [] { benchParse(); return true; } },
+        { "depth", [] { benchDepth(); return true; } },
+        { "pool", [] { benchPool(); return true; } },
+        { "print", [] { benchPrint(); return true; } },
+        { "stream", [] { benchStream(); return true; } },
+        { "gradient", [] { benchGradient(); return true; } },
+        { "tape", [] { benchTape(); return true; } },
+        { "batch", [] { benchBatch(); return true; } },
+        { "codegen", benchCodegen },
+        { "forward", [] { benchForward(); return true; } },
+        { "hessian", [] { benchHessian(); return true; } },
+        { "canonical", [] { benchCanonical(); return true; } },
+        { "graph", [] { benchGraphFile(); return true; } },
+        { "jacobian", [] { benchJacobian(); return true; } },
+        { "sparsity", [] { benchSparsity(); return true; } },
+        { "checkpoint", [] { benchCheckpoint(); return true; } },
+    };
+    if (argc > 2) {
+        std::cerr << "Usage: " << argv[0] << " [section]" << std::endl;
+        return 1;
+    }
+    std::string only = argc == 2 ? argv[1] : "";
+    bool ok = true;
+    bool ran = false;
+    for (const auto& section : sections) {
+        if (!only.empty() && only != section.first) {
+            continue;
+        }
+        if (ran) {
+            std::cout << std::endl;
+        }
+        ok = section.second() && ok;
+        ran = true;
+    }
+    if (!ran) {
+        std::cerr << "Error: Unknown section " << only << "; one of:";
+        for (const auto& section : sections) {
+            std::cerr << " " << section.first;
+        }
+        std::cerr << std::endl;
+        return 1;
+    }
+    return ok ? 0 : 1;
+}
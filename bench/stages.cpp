@@ -0,0 +1,323 @@
+// Times each stage of the pipeline on synthetic expressions: tokenize, parse,
+// simplify, differentiate, simplify the gradient, print. For every stage it
+// reports wall time, ns per node, heap allocations and how far the live heap
+// grew above its level when the stage started. Output is TSV with a header
+// (default) or one JSON object per line (--json), for diffing between releases.
+//
+// usage: AutoDiffStageBench [--json] [--filter name] [--repeat N]
+
+#include <chrono>
+#include <cstdlib>
+#include <algorithm>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+#include <malloc.h>
+#include <sys/resource.h>
+
+#include "expr_node.hpp"
+#include "tokenizer.hpp"
+#include "expression_builder.hpp"
+#include "reverse_differentiator.hpp"
+#include "simplifier.hpp"
+#include "tree_printer.hpp"
+
+using namespace autodiff;
+
+namespace {
+    // Heap traffic of the whole process; the benchmark is single-threaded.
+    struct HeapCounters {
+        size_t allocations = 0;
+        size_t bytes = 0; // allocated in total
+        size_t live = 0;
+        size_t peak = 0; // highest live since the current stage started
+    };
+    HeapCounters heap;
+
+    // Over-aligned requests (the node arena's chunks) go through aligned_alloc,
+    // whose blocks malloc_usable_size and free handle like any other.
+    void* allocate(size_t size, size_t alignment = 0) {
+        if (size == 0) {
+            size = 1;
+        }
+        void* p = alignment ? std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)
+                            : std::malloc(size);
+        if (!p) {
+            throw std::bad_alloc();
+        }
+        size_t usable = malloc_usable_size(p);
+        ++heap.allocations;
+        heap.bytes += usable;
+        heap.live += usable;
+        if (heap.live > heap.peak) {
+            heap.peak = heap.live;
+        }
+        return p;
+    }
+
+    void release(void* p) {
+        if (p) {
+            heap.live -= malloc_usable_size(p);
+            std::free(p);
+        }
+    }
+}
+
+void* operator new(size_t size) { return allocate(size); }
+void* operator new[](size_t size) { return allocate(size); }
+void operator delete(void* p) noexcept { release(p); }
+void operator delete[](void* p) noexcept { release(p); }
+void operator delete(void* p, size_t) noexcept { release(p); }
+void operator delete[](void* p, size_t) noexcept { release(p); }
+void* operator new(size_t size, std::align_val_t alignment) { return allocate(size, static_cast<size_t>(alignment)); }
+void* operator new[](size_t size, std::align_val_t alignment) { return allocate(size, static_cast<size_t>(alignment)); }
+void operator delete(void* p, std::align_val_t) noexcept { release(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { release(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { release(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { release(p); }
+
+namespace {
+    // Variables may only contain letters, so number them in base 26.
+    std::string variableName(int index) {
+        std::string name = "v";
+        do {
+            name += static_cast<char>('a' + index % 26);
+            index /= 26;
+        } while (index > 0);
+        return name;
+    }
+
+    // sin(cos(exp(sin(...x...)))): depth n, one variable.
+    std::string deepNesting(int n) {
+        static const char* functions[] = { "sin(", "cos(", "exp(" };
+        std::string expr;
+        for (int i = 0; i < n; ++i) {
+            expr += functions[i % 3];
+        }
+        expr += "x";
+        expr.append(n, ')');
+        return expr;
+    }
+
+    // 2*va^2+3*vb^2+...: n terms in n variables.
+    std::string wideSum(int n) {
+        std::string expr;
+        for (int i = 0; i < n; ++i) {
+            if (i > 0) {
+                expr += "+";
+            }
+            expr += std::to_string(i % 7 + 2) + "*" + variableName(i) + "^2";
+        }
+        return expr;
+    }
+
+    // (x+1)*(x+2)*...: n factors of one variable.
+    std::string longProduct(int n) {
+        std::string expr;
+        for (int i = 0; i < n; ++i) {
+            if (i > 0) {
+                expr += "*";
+            }
+            expr += "(x+" + std::to_string(i + 1) + ")";
+        }
+        return expr;
+    }
+
+    // x^y^x^y...: n levels, right associative.
+    std::string powerTower(int n) {
+        std::string expr = "x";
+        for (int i = 1; i < n; ++i) {
+            expr += i % 2 ? "^y" : "^x";
+        }
+        return expr;
+    }
+
+    // n terms of stacked functions over a handful of variables.
+    std::string functionHeavy(int n) {
+        std::string expr;
+        for (int i = 0; i < n; ++i) {
+            std::string a = variableName(i % 5);
+            std::string b = variableName((i + 1) % 5);
+            if (i > 0) {
+                expr += "+";
+            }
+            expr += "exp(sin(" + a + "*" + b + ")/ln(" + b + "^2+" + std::to_string(i + 1) + "))*tan(cos(" + a
+                + "))+log(2," + b + "+" + std::to_string(i + 1) + ")";
+        }
+        return expr;
+    }
+
+    // sin(va*vb)+va^2*ln(vb)+...: every variable coupled to its neighbour.
+    std::string manyVariables(int n) {
+        std::string expr;
+        for (int i = 0; i < n; ++i) {
+            std::string a = variableName(i);
+            std::string b = variableName((i + 1) % n);
+            if (i > 0) {
+                expr += "+";
+            }
+            expr += "sin(" + a + "*" + b + ")+" + a + "^2*ln(" + b + ")";
+        }
+        return expr;
+    }
+
+    struct Generator {
+        const char* name;
+        std::string (*make)(int);
+        std::vector<int> sizes;
+    };
+
+    struct StageResult {
+        const char* stage;
+        double nanos = 0.0;
+        size_t nodes = 0; // tokens for tokenize, distinct nodes otherwise
+        size_t allocations = 0;
+        size_t bytes = 0;
+        size_t peakGrowth = 0;
+    };
+
+    // Runs fn as one stage; fn returns the stage's node count.
+    template <typename Fn>
+    StageResult measure(const char* stage, Fn fn) {
+        StageResult result;
+        result.stage = stage;
+        HeapCounters before = heap;
+        heap.peak = heap.live;
+        auto start = std::chrono::steady_clock::now();
+        result.nodes = fn();
+        result.nanos = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        result.allocations = heap.allocations - before.allocations;
+        result.bytes = heap.bytes - before.bytes;
+        result.peakGrowth = heap.peak - before.live;
+        return result;
+    }
+
+    // One pass over the pipeline. Node counts are taken outside the timed
+    // stages. The pool starts empty, so its growth shows in the heap figures.
+    std::vector<StageResult> runPipeline(const std::string& expr) {
+        ExprPool::current().release();
+        std::vector<StageResult> results;
+        std::vector<Token> tokens;
+        std::vector<SymbolId> vars;
+        ExprNodePtr root = nullptr;
+        std::vector<ExprNodePtr> gradient;
+        Simplifier simplifier;
+        ReverseDifferentiator reverse;
+        TreePrinter printer;
+        std::string printed;
+
+        Tokenizer tokenizer(expr);
+        vars = tokenizer.getVariables();
+        sortByName(vars);
+        results.push_back(measure("tokenize", [&] {
+            tokens = tokenizer.tokenize();
+            return tokens.size();
+        }));
+        results.push_back(measure("parse", [&] {
+            root = ExpressionBuilder(std::move(tokens)).build();
+            return size_t(0);
+        }));
+        results.back().nodes = countNodes(root);
+        results.push_back(measure("simplify", [&] {
+            root = simplifier.simplify(root);
+            return size_t(0);
+        }));
+        results.back().nodes = countNodes(root);
+        results.push_back(measure("differentiate", [&] {
+            gradient = reverse.gradient(root, vars);
+            return size_t(0);
+        }));
+        results.back().nodes = countNodes(gradient);
+        results.push_back(measure("simplify-gradient", [&] {
+            for (ExprNodePtr& diff : gradient) {
+                diff = simplifier.simplify(diff);
+            }
+            return size_t(0);
+        }));
+        results.back().nodes = countNodes(gradient);
+        size_t gradientNodes = results.back().nodes;
+        results.push_back(measure("print", [&] {
+            for (ExprNodePtr diff : gradient) {
+                printer.print(diff, printed);
+                printed += '\n';
+            }
+            return size_t(0);
+        }));
+        results.back().nodes = gradientNodes; // per node of the printed gradient; bytes are in the bytes column
+        return results;
+    }
+
+    long maxResidentKilobytes() {
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    bool json = false;
+    std::string filter;
+    int repeat = 1;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--json") {
+            json = true;
+        } else if (arg == "--filter" && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (arg == "--repeat" && i + 1 < argc) {
+            repeat = std::max(1, std::atoi(argv[++i]));
+        } else {
+            std::cerr << "Error: Unknown option " << arg << std::endl;
+            std::cerr << "usage: AutoDiffStageBench [--json] [--filter name] [--repeat N]" << std::endl;
+            return 1;
+        }
+    }
+
+    const std::vector<Generator> generators = {
+        { "deep", deepNesting, { 100, 500, 2000 } },
+        { "wide-sum", wideSum, { 1000, 10000, 100000 } },
+        { "long-product", longProduct, { 50, 200, 800 } },
+        { "power-tower", powerTower, { 10, 50, 200 } },
+        { "function-heavy", functionHeavy, { 100, 1000, 10000 } },
+        { "many-variables", manyVariables, { 100, 1000, 20000 } },
+    };
+
+    if (!json) {
+        std::cout << "generator\tsize\tstage\tms\tnodes\tns/node\tallocations\talloc bytes\tpeak growth bytes\tmax rss KB"
+                  << std::endl;
+    }
+    for (const Generator& generator : generators) {
+        if (!filter.empty() && filter != generator.name) {
+            continue;
+        }
+        for (int size : generator.sizes) {
+            std::string expr = generator.make(size);
+            // Keep the fastest time of each stage; heap figures are the same every run.
+            std::vector<StageResult> best = runPipeline(expr);
+            for (int r = 1; r < repeat; ++r) {
+                std::vector<StageResult> again = runPipeline(expr);
+                for (size_t s = 0; s < best.size(); ++s) {
+                    best[s].nanos = std::min(best[s].nanos, again[s].nanos);
+                }
+            }
+            long rss = maxResidentKilobytes();
+            for (const StageResult& stage : best) {
+                double perNode = stage.nodes ? stage.nanos / stage.nodes : 0.0;
+                if (json) {
+                    std::cout << "{\"generator\":\"" << generator.name << "\",\"size\":" << size << ",\"stage\":\""
+                              << stage.stage << "\",\"ns\":" << static_cast<long long>(stage.nanos)
+                              << ",\"nodes\":" << stage.nodes << ",\"ns_per_node\":" << perNode
+                              << ",\"allocations\":" << stage.allocations << ",\"alloc_bytes\":" << stage.bytes
+                              << ",\"peak_growth_bytes\":" << stage.peakGrowth << ",\"max_rss_kb\":" << rss << "}"
+                              << std::endl;
+                } else {
+                    std::cout << generator.name << "\t" << size << "\t" << stage.stage << "\t" << stage.nanos / 1e6
+                              << "\t" << stage.nodes << "\t" << perNode << "\t" << stage.allocations << "\t"
+                              << stage.bytes << "\t" << stage.peakGrowth << "\t" << rss << std::endl;
+                }
+            }
+        }
+    }
+    return 0;
+}
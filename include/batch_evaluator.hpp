@@ -0,0 +1,48 @@
+#ifndef BATCH_EVALUATOR_HPP
+#define BATCH_EVALUATOR_HPP
+
+#include <vector>
+#include <cstddef>
+
+#include "tape.hpp"
+
+namespace autodiff {
+    enum class SimdLevel {
+        SCALAR,
+        AVX2,
+        AVX512
+    };
+
+    // Runs a Tape over many points at once. Inputs and outputs are columns
+    // (struct-of-arrays); each instruction sweeps a whole block of points.
+    class BatchEvaluator {
+    public:
+        static constexpr size_t blockSize = 256;
+
+        BatchEvaluator(const Tape& tape, SimdLevel level = bestSimdLevel());
+
+        // columns[i] holds numPoints values of the i-th tape input;
+        // outputs[k] receives numPoints values of the k-th tape output.
+        void evaluate(const std::vector<const double*>& columns, const std::vector<double*>& outputs,
+                      size_t numPoints);
+
+        SimdLevel getLevel() const;
+
+        static SimdLevel bestSimdLevel(); // widest level this build was compiled for
+        static const char* getLevelName(SimdLevel level);
+
+    private:
+        std::vector<Instruction> instructions;
+        std::vector<std::uint32_t> outputRegisters;
+        size_t inputCount;
+        SimdLevel level;
+        std::vector<double> rows; // blockSize doubles per register; constant rows prefilled
+
+        template <class S>
+        void evaluateBlock(const std::vector<const double*>& columns, size_t offset, size_t count);
+        const double* source(std::uint32_t reg, const std::vector<const double*>& columns, size_t offset) const;
+    };
+
+}; // namespace autodiff
+
+#endif // BATCH_EVALUATOR_HPP
@@ -0,0 +1,62 @@
+#ifndef CANONICALIZER_HPP
+#define CANONICALIZER_HPP
+
+#include <vector>
+#include <unordered_map>
+
+#include "expr_node.hpp"
+
+namespace autodiff {
+    struct CanonicalizeStats {
+        size_t nodesBefore = 0;
+        size_t nodesAfter = 0;
+        int iterations = 0;
+    };
+
+    // Canonical-form simplification. Chains of + and - (and of * and /) are
+    // flattened into term (factor) lists, constants are folded together, like
+    // terms and powers of the same base are merged, and the operands are sorted
+    // by structural hash before the binary tree is rebuilt. The pass repeats
+    // until the result stops changing or maxIterations is reached.
+    class Canonicalizer {
+    public:
+        Canonicalizer(int maxIterations = 8);
+        ExprNodePtr canonicalize(ExprNodePtr node);
+        const CanonicalizeStats& getLastStats() const;
+
+    private:
+        struct Factor {
+            ExprNodePtr base;
+            bool numeric; // exponent is `power` rather than `symbolic`
+            Number power;
+            ExprNodePtr symbolic;
+        };
+        struct Term {
+            Number coef;
+            std::vector<Factor> factors; // empty for the constant term
+        };
+
+        int maxIterations;
+        CanonicalizeStats stats;
+        std::unordered_map<ExprNodePtr, ExprNodePtr> memo; // node -> canonical node for the current pass
+
+        ExprNodePtr canonicalNode(ExprNodePtr node);
+        ExprNodePtr canonicalUncached(ExprNodePtr node);
+        ExprNodePtr canonicalSum(ExprNodePtr node);
+        ExprNodePtr canonicalProduct(ExprNodePtr node);
+        ExprNodePtr canonicalPow(ExprNodePtr base, ExprNodePtr exponent);
+        ExprNodePtr canonicalFunction(ExprNodePtr node);
+
+        void collectSum(ExprNodePtr node, bool negate, bool canonical, std::vector<Term>& terms);
+        void collectProduct(ExprNodePtr node, bool invert, bool canonical, Number& coef,
+                            std::vector<Factor>& factors);
+        void mergeFactors(std::vector<Factor>& factors);
+        ExprNodePtr buildProduct(const Number& coef, const std::vector<Factor>& factors);
+        ExprNodePtr exponentNode(const Factor& factor) const;
+
+        static bool getCoefficient(ExprNodePtr node, Number& value);
+    };
+
+}; // namespace autodiff
+
+#endif // CANONICALIZER_HPP
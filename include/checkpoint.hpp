@@ -0,0 +1,73 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "tape.hpp"
+
+namespace autodiff {
+    struct CheckpointStats {
+        size_t instructions = 0;  // of the tape
+        size_t chunkLength = 0;   // instructions recorded at a time for the reverse sweep
+        size_t chunks = 0;
+        size_t snapshots = 0;     // register snapshots the budget allows
+        size_t snapshotsUsed = 0; // most held at once
+        size_t forwardSteps = 0;  // instructions executed, recomputation included
+        size_t peakBytes = 0;     // working memory actually held
+        double recomputeFactor = 0.0; // forwardSteps / instructions; 1 means no recomputation
+    };
+
+    // Numeric reverse mode over a tape in bounded memory. Reversing an
+    // instruction needs the operand values it saw, and registers are reused,
+    // so those values are recorded one chunk of instructions at a time. Any
+    // chunk is re-entered from a snapshot of the registers taken at a chunk
+    // boundary, placed on the binomial (revolve) schedule: with s snapshots
+    // and n chunks, every chunk is recomputed at most t times for the least t
+    // with C(s + t, s) >= n. Given enough memory, the whole tape is recorded
+    // in one forward pass and nothing is recomputed.
+    class CheckpointedReverse {
+    public:
+        // memoryBudget covers the register and adjoint files, the snapshots
+        // and the recorded chunk.
+        CheckpointedReverse(const Tape& tape, size_t memoryBudget);
+
+        // False if the budget cannot even hold the register files and one
+        // recorded instruction.
+        bool feasible() const { return chunkLength > 0; }
+        // The first output of the tape at inputs, and its partials in
+        // gradient[0 .. numInputs). Returns false when not feasible.
+        bool gradient(const double* inputs, double& value, double* gradient);
+        const CheckpointStats& getStats() const { return stats; }
+
+    private:
+        struct Operands {
+            double a;
+            double b;
+        };
+
+        const Tape& tape;
+        std::uint32_t firstTemporary = 0; // registers below never change after the inputs are loaded
+        size_t chunkLength = 0;
+        size_t numChunks = 0;
+        size_t maxSnapshots = 0;
+        std::vector<double> registers;
+        std::vector<double> adjoints;
+        std::vector<std::vector<double>> snapshots; // temporaries at a chunk boundary
+        std::vector<Operands> recorded;             // of the chunk being reversed
+        size_t liveSnapshots = 0;
+        double value = 0.0;
+        CheckpointStats stats;
+
+        void advance(size_t fromChunk, size_t toChunk);
+        void record(size_t chunk);
+        void reverseChunk(size_t chunk);
+        void save(size_t slot);
+        void restore(size_t origin);
+        void treeverse(size_t first, size_t last, size_t origin, size_t free);
+    };
+
+}; // namespace autodiff
+
+#endif // CHECKPOINT_HPP
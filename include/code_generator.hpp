@@ -0,0 +1,40 @@
+#ifndef CODE_GENERATOR_HPP
+#define CODE_GENERATOR_HPP
+
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "tape.hpp"
+
+namespace autodiff {
+    struct CodeOptions {
+        std::string name = "grad";
+        // Also emit name_batch(in, out, n): in[k] and out[k] are columns of n
+        // values, as for BatchEvaluator. With gcc and glibc, -O3 -ffast-math
+        // vectorizes its loops, math calls included.
+        bool batched = false;
+    };
+
+    // Turns a compiled Tape into self-contained C source. name(in, out) reads
+    // the tape's inputs from in and writes its outputs to out, which must not
+    // overlap in. Every tape instruction becomes one const temporary, so
+    // subexpressions shared in the DAG are computed once, and constants are
+    // inlined. The source builds as C or C++ and exports unmangled symbols.
+    class CodeGenerator {
+    public:
+        // vars only labels the inputs in a comment; it is the list the tape was compiled for.
+        std::string generate(const Tape& tape, const std::vector<SymbolId>& vars,
+                             const CodeOptions& options = CodeOptions()) const;
+
+    private:
+        void appendScalar(const Tape& tape, std::string& out) const;
+        void appendBatched(const Tape& tape, std::string& out) const;
+        // The right-hand side of ins, with operand() writing each register.
+        void appendInstruction(const Instruction& ins, const std::function<void(std::uint32_t)>& operand,
+                               std::string& out) const;
+    };
+
+}; // namespace autodiff
+
+#endif // CODE_GENERATOR_HPP
@@ -0,0 +1,84 @@
+#ifndef DERIVATIVE_CACHE_HPP
+#define DERIVATIVE_CACHE_HPP
+
+#include <array>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+#include "expr_node.hpp"
+
+namespace autodiff {
+    struct DerivativeCacheStats {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t insertions = 0;
+        size_t evictions = 0;
+        size_t entries = 0;
+        size_t nodes = 0; // held by all entries
+    };
+
+    // Simplified derivatives of subexpressions, kept across calls, pools and
+    // threads. Entries are keyed by (structural hash, variable) and confirmed
+    // by comparing structure, so a hit does not depend on which pool the query
+    // lives in. Entries hold pool-independent copies of the subexpression and
+    // its derivative; a hit rebuilds the derivative in the calling thread's pool.
+    //
+    // The cache is split into shards with their own lock and LRU list. An
+    // entry costs one unit per node it holds, and the least recently used
+    // entries of a shard are evicted once it exceeds its share of maxNodes.
+    class DerivativeCache {
+    public:
+        DerivativeCache(size_t maxNodes = 1 << 20);
+
+        // The cached derivative of expr with respect to var, or nullptr.
+        ExprNodePtr find(ExprNodePtr expr, SymbolId var);
+        void insert(ExprNodePtr expr, SymbolId var, ExprNodePtr derivative);
+        DerivativeCacheStats getStats() const;
+        void clear();
+
+    private:
+        // A DAG in post-order; children are earlier positions, the root is last.
+        struct FlatNode {
+            NodeType type;
+            OperatorType opType;
+            FunctionType funcType;
+            SymbolId symbol;
+            Number number;
+            std::size_t hash;
+            std::uint32_t left;
+            std::uint32_t right;
+        };
+        typedef std::vector<FlatNode> FlatExpr;
+
+        struct Entry {
+            size_t key; // structural hash mixed with the variable
+            SymbolId var;
+            FlatExpr expr;
+            FlatExpr derivative;
+        };
+        struct Shard {
+            mutable std::mutex mutex;
+            std::list<Entry> lru; // most recently used first
+            std::unordered_multimap<size_t, std::list<Entry>::iterator> index;
+            size_t nodes = 0;
+            DerivativeCacheStats stats;
+        };
+        static constexpr size_t numShards = 16;
+        static constexpr std::uint32_t none = UINT32_MAX;
+
+        size_t shardBudget;
+        std::array<Shard, numShards> shards;
+
+        static size_t keyOf(ExprNodePtr expr, SymbolId var);
+        static FlatExpr flatten(ExprNodePtr root);
+        static ExprNodePtr rebuild(const FlatExpr& flat);
+        static bool matches(ExprNodePtr root, const FlatExpr& flat);
+        std::list<Entry>::iterator lookup(Shard& shard, size_t key, ExprNodePtr expr, SymbolId var);
+    };
+
+}; // namespace autodiff
+
+#endif // DERIVATIVE_CACHE_HPP
@@ -3,17 +3,40 @@
 
 #include <string>
 #include <memory>
+#include <unordered_map>
 
 #include "expr_node.hpp"
+#include "simplifier.hpp"
+#include "derivative_cache.hpp"
 
 namespace autodiff {
     class Differentiator {
     public:
-        ExprNodePtr differentiate(const ExprNodePtr& expr, const std::string& var);
+        ExprNodePtr differentiate(ExprNodePtr expr, SymbolId var);
+        // Like differentiate, but derivatives of subexpressions are kept per
+        // variable across calls until clearCache(), so repeated and nested
+        // derivatives reuse each other's work. Nodes must stay alive meanwhile.
+        ExprNodePtr differentiateCached(ExprNodePtr expr, SymbolId var);
+        void clearCache();
+        // Looks up and records the derivatives of small function applications
+        // (sin(2*x), ln(x*y), ...) in a cache shared across calls and threads.
+        // Cached derivatives are simplified. nullptr turns this off.
+        void setDerivativeCache(DerivativeCache* cache);
 
     private:
-        ExprNodePtr diffOperator(const ExprNodePtr& expr, const std::string& var);
-        ExprNodePtr diffFunction(const ExprNodePtr& expr, const std::string& var);
+        std::unordered_map<ExprNodePtr, ExprNodePtr> scratch; // node -> derivative for the current call
+        std::unordered_map<SymbolId, std::unordered_map<ExprNodePtr, ExprNodePtr>> cache; // var -> node -> derivative
+        std::unordered_map<ExprNodePtr, ExprNodePtr>* memo = &scratch;
+        ExprNodePtr zero = nullptr; // derivative of every subtree without var, from the current pool
+        DerivativeCache* derivativeCache = nullptr;
+        Simplifier simplifier; // for entries stored in derivativeCache
+
+        ExprNodePtr diffNode(ExprNodePtr expr, SymbolId var);
+        bool cacheable(ExprNodePtr expr) const;
+        ExprNodePtr diffUncached(ExprNodePtr expr, SymbolId var);
+        ExprNodePtr diffOperator(ExprNodePtr expr, SymbolId var);
+        ExprNodePtr diffFunction(ExprNodePtr expr, SymbolId var);
+        ExprNodePtr powerRule(ExprNodePtr power, ExprNodePtr baseDerivative, ExprNodePtr exponentDerivative);
     };
 }; // namespace autodiff
 
@@ -0,0 +1,130 @@
+#ifndef DUAL_HPP
+#define DUAL_HPP
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+
+namespace autodiff {
+    // A value with N tangent lanes. N is a compile-time constant so the
+    // per-lane loops below unroll completely for small variable counts.
+    template <size_t N>
+    struct Dual {
+        double value;
+        std::array<double, N> tangent;
+
+        Dual() : value(0.0) { tangent.fill(0.0); }
+        explicit Dual(double v) : value(v) { tangent.fill(0.0); }
+
+        // Variable seeded in the given lane (lane >= N seeds nothing).
+        static Dual variable(double v, size_t lane) {
+            Dual d(v);
+            if (lane < N) {
+                d.tangent[lane] = 1.0;
+            }
+            return d;
+        }
+
+        bool hasTangent() const {
+            for (size_t i = 0; i < N; ++i) {
+                if (tangent[i] != 0.0) {
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+
+    // Chain rule for a unary function: f(u) with f'(u) = slope.
+    template <size_t N>
+    Dual<N> chain(const Dual<N>& u, double value, double slope) {
+        Dual<N> r(value);
+        for (size_t i = 0; i < N; ++i) {
+            r.tangent[i] = slope * u.tangent[i];
+        }
+        return r;
+    }
+
+    template <size_t N>
+    Dual<N> operator+(const Dual<N>& a, const Dual<N>& b) {
+        Dual<N> r(a.value + b.value);
+        for (size_t i = 0; i < N; ++i) {
+            r.tangent[i] = a.tangent[i] + b.tangent[i];
+        }
+        return r;
+    }
+
+    template <size_t N>
+    Dual<N> operator-(const Dual<N>& a, const Dual<N>& b) {
+        Dual<N> r(a.value - b.value);
+        for (size_t i = 0; i < N; ++i) {
+            r.tangent[i] = a.tangent[i] - b.tangent[i];
+        }
+        return r;
+    }
+
+    template <size_t N>
+    Dual<N> operator*(const Dual<N>& a, const Dual<N>& b) { // (uv)' = u'v + uv'
+        Dual<N> r(a.value * b.value);
+        for (size_t i = 0; i < N; ++i) {
+            r.tangent[i] = a.tangent[i] * b.value + a.value * b.tangent[i];
+        }
+        return r;
+    }
+
+    template <size_t N>
+    Dual<N> operator/(const Dual<N>& a, const Dual<N>& b) { // (u/v)' = (u' - (u/v)v') / v
+        Dual<N> r(a.value / b.value);
+        for (size_t i = 0; i < N; ++i) {
+            r.tangent[i] = (a.tangent[i] - r.value * b.tangent[i]) / b.value;
+        }
+        return r;
+    }
+
+    template <size_t N>
+    Dual<N> pow(const Dual<N>& u, const Dual<N>& v) { // (u^v)' = v*u^(v-1)*u' + ln(u)*u^v*v'
+        Dual<N> r(std::pow(u.value, v.value));
+        double base = v.value * std::pow(u.value, v.value - 1.0);
+        // ln(u) is only needed, and only finite for u > 0, when the exponent varies.
+        double exponent = v.hasTangent() ? std::log(u.value) * r.value : 0.0;
+        for (size_t i = 0; i < N; ++i) {
+            r.tangent[i] = base * u.tangent[i] + (v.tangent[i] != 0.0 ? exponent * v.tangent[i] : 0.0);
+        }
+        return r;
+    }
+
+    template <size_t N>
+    Dual<N> ln(const Dual<N>& u) { // (ln(u))' = u'/u
+        return chain(u, std::log(u.value), 1.0 / u.value);
+    }
+
+    template <size_t N>
+    Dual<N> log(const Dual<N>& base, const Dual<N>& u) { // log(b, u) = ln(u)/ln(b)
+        return ln(u) / ln(base);
+    }
+
+    template <size_t N>
+    Dual<N> cos(const Dual<N>& u) { // (cos(u))' = -sin(u)*u'
+        return chain(u, std::cos(u.value), -std::sin(u.value));
+    }
+
+    template <size_t N>
+    Dual<N> sin(const Dual<N>& u) { // (sin(u))' = cos(u)*u'
+        return chain(u, std::sin(u.value), std::cos(u.value));
+    }
+
+    template <size_t N>
+    Dual<N> tan(const Dual<N>& u) { // (tan(u))' = u'/cos^2(u)
+        double c = std::cos(u.value);
+        return chain(u, std::tan(u.value), 1.0 / (c * c));
+    }
+
+    template <size_t N>
+    Dual<N> exp(const Dual<N>& u) { // (exp(u))' = exp(u)*u'
+        double e = std::exp(u.value);
+        return chain(u, e, e);
+    }
+
+}; // namespace autodiff
+
+#endif // DUAL_HPP
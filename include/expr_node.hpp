@@ -3,53 +3,142 @@
 
 #include <string>
 #include <memory>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "number.hpp"
+#include "symbol_table.hpp"
 
 namespace autodiff {
-    enum class NodeType {
+    enum class NodeType : std::uint8_t {
         NUMBER,
         VARIABLE,
         OPERATOR,
         FUNCTION
     };
-    enum class OperatorType {
+    enum class OperatorType : std::uint8_t {
         ADD, SUB, MUL, DIV, POW,
         NONE_OP
     };
-    enum class FunctionType {
+    enum class FunctionType : std::uint8_t {
         LN, LOG, COS, SIN, TAN, POW_FUNC, EXP,
         NONE_FUNC
     };
 
+    // Bit (id % 64) of each variable a subtree contains. A clear bit proves the
+    // subtree does not depend on that variable, and a zero mask means it is
+    // constant. With up to 64 distinct symbols the mask is exact; beyond that,
+    // symbols sharing a bit only make the test conservative.
+    typedef std::uint64_t VariableMask;
+
+    inline VariableMask variableBit(SymbolId symbol) {
+        return VariableMask(1) << (symbol & 63);
+    }
+
+    // Nodes are immutable and hash-consed: two structurally equal subtrees
+    // built in the same pool are the same node, so an expression is a DAG.
+    // The layout fits one 64-byte cache line: the payload is a union read
+    // according to type, and opType/funcType are NONE_* where they do not apply.
     struct ExprNode {
+        const ExprNode* left;
+        const ExprNode* right;
+        std::size_t hash; // structural hash, independent of node addresses
+        VariableMask dependencies; // variables below, computed on construction
+        union {
+            Number number; // NUMBER
+            SymbolId symbol; // VARIABLE
+        };
+        std::uint32_t id; // dense index inside the owning pool
         NodeType type;
-        std::string value;
         OperatorType opType;
         FunctionType funcType;
-        std::unique_ptr<ExprNode> left;
-        std::unique_ptr<ExprNode> right;
-
-        ExprNode(NodeType t);
-        ExprNode(NodeType t, std::string val); // NUMBER and VARIABLE
-        ExprNode(NodeType t, OperatorType op); // OPERATOR
-        ExprNode(NodeType t, FunctionType func); // FUNCTION
-        // FUNCTION with single argument
-        ExprNode(NodeType t, FunctionType func, std::unique_ptr<ExprNode> arg);
-        // FUNCTION with two arguments
-        ExprNode(NodeType t, FunctionType func, std::unique_ptr<ExprNode> arg1, std::unique_ptr<ExprNode> arg2);
+
+        ExprNode(NodeType t, Number num); // NUMBER
+        ExprNode(NodeType t, SymbolId sym); // VARIABLE
+        // FUNCTION with one or two arguments
+        ExprNode(NodeType t, FunctionType func, const ExprNode* arg1, const ExprNode* arg2);
         // OPERATOR with two arguments
-        ExprNode(NodeType t, OperatorType op, std::unique_ptr<ExprNode> left, std::unique_ptr<ExprNode> right);
+        ExprNode(NodeType t, OperatorType op, const ExprNode* left, const ExprNode* right);
+    };
+
+    typedef const ExprNode* ExprNodePtr;
+
+    inline bool mayDependOn(ExprNodePtr node, SymbolId var) {
+        return (node->dependencies & variableBit(var)) != 0;
+    }
+
+    // Owns every node and the intern table that maps a node's shallow content
+    // (type, payload, operator/function, child addresses) to its unique instance.
+    //
+    // Nodes live in fixed-size chunks, numbered by id, so interning a node
+    // costs no allocation of its own and addresses stay stable. The table is
+    // open addressing over 32-bit ids, with a generation stamp per slot:
+    // clear() forgets every node in O(1) and keeps the chunks and slots for
+    // the next expression, so memory stays at the high-water mark.
+    class ExprPool {
+    public:
+        ExprPool() = default;
+        ExprPool(const ExprPool&) = delete;
+        ExprPool& operator=(const ExprPool&) = delete;
+
+        ExprNodePtr intern(const ExprNode& candidate);
+        std::size_t size() const;
+        void clear();
+        // Like clear, and hands the chunks and table back to the heap.
+        void release();
+        // Bytes held by chunks and table, live or kept for reuse.
+        std::size_t capacityBytes() const;
+
+        // Pool used by the build* helpers on the calling thread.
+        static ExprPool& current();
+
+    private:
+        static const std::uint32_t chunkShift = 12; // 4096 nodes per chunk
+        static const std::uint32_t chunkMask = (1u << chunkShift) - 1;
+
+        struct alignas(64) NodeStorage {
+            unsigned char bytes[sizeof(ExprNode)];
+        };
+        struct Slot {
+            std::uint32_t id;
+            std::uint32_t generation; // the slot is empty unless this is the current one
+        };
+
+        std::vector<std::unique_ptr<NodeStorage[]>> chunks;
+        std::uint32_t count = 0; // nodes since the last clear, ids 0 to count-1
+        std::vector<Slot> slots; // power-of-two size, at most half full
+        std::uint32_t generation = 1;
+
+        ExprNode* node(std::uint32_t id) const;
+        void grow();
+        static bool sameShallow(const ExprNode& a, const ExprNode& b);
     };
 
-    typedef std::unique_ptr<ExprNode> ExprNodePtr;
+    // Empties a hash table that is kept for reuse. clear() walks every bucket,
+    // so a table grown by one huge expression is dropped rather than cleared;
+    // otherwise each later reset would cost as much as that expression.
+    template <typename Table>
+    void resetTable(Table& table) {
+        if (table.bucket_count() > 4 * table.size() + 4096) {
+            Table().swap(table);
+        } else {
+            table.clear();
+        }
+    }
 
-    ExprNodePtr buildNumber(std::string token);
-    ExprNodePtr buildVariable(std::string token);
-    ExprNodePtr buildOperator(OperatorType opType);
-    ExprNodePtr buildOperator(OperatorType opType, const ExprNodePtr& arg1, const ExprNodePtr& arg2);
-    ExprNodePtr buildFunction(FunctionType funcType, const ExprNodePtr& arg);
-    ExprNodePtr buildFunction(FunctionType funcType, const ExprNodePtr& arg1, const ExprNodePtr& arg2);
+    ExprNodePtr buildNumber(const Number& number);
+    ExprNodePtr buildVariable(SymbolId symbol);
+    ExprNodePtr buildOperator(OperatorType opType, ExprNodePtr arg1, ExprNodePtr arg2);
+    ExprNodePtr buildFunction(FunctionType funcType, ExprNodePtr arg);
+    ExprNodePtr buildFunction(FunctionType funcType, ExprNodePtr arg1, ExprNodePtr arg2);
+    // Rebuilds a subtree owned by another pool inside the current one.
     ExprNodePtr cloneSubtree(const ExprNode* expr);
+    std::size_t countNodes(ExprNodePtr expr); // distinct nodes reachable from expr
+    std::size_t countNodes(const std::vector<ExprNodePtr>& roots);
+    // Nodes on the longest path from a root down to a leaf; a leaf alone is 1.
+    std::size_t maxDepth(const std::vector<ExprNodePtr>& roots);
 
 }; // namespace autodiff
 
-#endif // EXPR_NODE_HPP
\ No newline at end of file
+#endif // EXPR_NODE_HPP
@@ -11,28 +11,43 @@
 namespace autodiff {
     class ExpressionBuilder {
     public:
-        ExpressionBuilder(const std::vector<std::string>& tokens);
+        // tokens as produced by Tokenizer::tokenize, END token included.
+        ExpressionBuilder(std::vector<Token> tokens);
+        // Pulls tokens from the tokenizer while parsing, so no token list is stored.
+        // build() reads from the tokenizer's current position, so after
+        // Tokenizer::reset the same builder parses the next expression.
+        ExpressionBuilder(Tokenizer& tokenizer);
         ExprNodePtr build();
     private:
-        const std::vector<std::string> tokens;
-        int cur_index;
-
-        ExprNodePtr parseExpression(); // fourth
-        ExprNodePtr parseTerm(); // third
-        ExprNodePtr parseFactor(); // second
-        ExprNodePtr parsePrimary(); // first
-
-        std::string peekToken() const;
-        std::string consumeToken();
+        std::vector<Token> tokens;
+        size_t cur_index;
+        Tokenizer* stream = nullptr;
+        Token current; // one token of lookahead
+
+        // Open construct on the parser's explicit stack.
+        struct Frame {
+            TokenKind kind; // OPERATOR, LEFT_PAREN or FUNCTION
+            OperatorType opType;
+            FunctionType funcType;
+            int commas; // FUNCTION: arguments separated so far
+            std::string_view name; // FUNCTION: for error messages
+        };
+        std::vector<Frame> frames;
+        std::vector<ExprNodePtr> operands;
+
+        bool parseOperand(bool& expectOperand);
+        // Applies pending operators that bind tighter than an incoming operator
+        // of the given precedence; -1 applies all of them up to the next group.
+        void reduce(int precedence, bool rightAssociative);
+        bool closeGroup(bool comma);
+        void reportUnclosed(const Frame& frame) const;
+
+        const Token& peekToken() const;
+        Token consumeToken();
         bool isTokenAvailable() const;
-
-
-        NodeType getTokenType(const std::string& token) const;
-        OperatorType getOperatorType(const std::string& token) const;
-        FunctionType getFunctionType(const std::string& token) const;
-
+        static int getPrecedence(OperatorType op);
     };
 
 }; // namespace autodiff
 
-#endif // EXPRESSION_BUILDER_HPP
\ No newline at end of file
+#endif // EXPRESSION_BUILDER_HPP
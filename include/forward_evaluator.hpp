@@ -0,0 +1,148 @@
+#ifndef FORWARD_EVALUATOR_HPP
+#define FORWARD_EVALUATOR_HPP
+
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <utility>
+
+#include "expr_node.hpp"
+#include "dual.hpp"
+
+namespace autodiff {
+    // Numeric forward-mode differentiation: evaluates the expression graph on
+    // Dual<N> values, so the value and N partials come out of a single pass
+    // without building any derivative nodes.
+    template <size_t N>
+    class ForwardEvaluator {
+    public:
+        ForwardEvaluator(const std::vector<SymbolId>& vars) {
+            for (size_t i = 0; i < vars.size(); ++i) {
+                if (vars[i] >= varIndex.size()) {
+                    varIndex.resize(vars[i] + 1, unbound);
+                }
+                varIndex[vars[i]] = i;
+            }
+        }
+
+        // values[i] binds vars[i]; vars[firstLane + k] is seeded in tangent lane k.
+        Dual<N> evaluate(ExprNodePtr expr, const std::vector<double>& values, size_t firstLane = 0) {
+            memo.clear();
+            if (!expr) {
+                return Dual<N>(std::numeric_limits<double>::quiet_NaN());
+            }
+            lanes = nullptr;
+            this->firstLane = firstLane;
+            walk(expr, values);
+            return memo[expr];
+        }
+
+        // Several roots in one pass over their shared graph, with vars[i]
+        // seeded in lane lanes[i]; a lane of N or more seeds nothing. Seeding
+        // structurally orthogonal variables in one lane gives their sum of
+        // partials there, which is how compressed Jacobians are evaluated.
+        std::vector<Dual<N>> evaluate(const std::vector<ExprNodePtr>& roots, const std::vector<double>& values,
+                                      const std::vector<size_t>& lanes) {
+            memo.clear();
+            this->lanes = &lanes;
+            std::vector<Dual<N>> results;
+            results.reserve(roots.size());
+            for (ExprNodePtr root : roots) {
+                if (!root) { // a NaN value, like the single-root overload
+                    results.push_back(Dual<N>(std::numeric_limits<double>::quiet_NaN()));
+                    continue;
+                }
+                walk(root, values);
+                results.push_back(memo[root]);
+            }
+            this->lanes = nullptr;
+            return results;
+        }
+
+    private:
+        static constexpr size_t unbound = static_cast<size_t>(-1);
+        std::vector<size_t> varIndex; // symbol id -> position in vars, or unbound
+        std::unordered_map<ExprNodePtr, Dual<N>> memo;
+        const std::vector<size_t>* lanes = nullptr; // per variable, overrides firstLane
+        size_t firstLane = 0;
+
+        // Evaluates the nodes below expr that are not in memo yet.
+        void walk(ExprNodePtr expr, const std::vector<double>& values) {
+            std::vector<std::pair<ExprNodePtr, bool>> stack; // (node, children already pushed)
+            stack.emplace_back(expr, false);
+            while (!stack.empty()) {
+                auto [node, expanded] = stack.back();
+                stack.pop_back();
+                if (memo.count(node)) {
+                    continue;
+                }
+                if (expanded || (!node->left && !node->right)) {
+                    memo.emplace(node, evaluateNode(node, values));
+                    continue;
+                }
+                stack.emplace_back(node, true);
+                if (node->right) {
+                    stack.emplace_back(node->right, false);
+                }
+                stack.emplace_back(node->left, false);
+            }
+        }
+
+        // Children are already in memo; rules mirror Differentiator.
+        Dual<N> evaluateNode(ExprNodePtr node, const std::vector<double>& values) {
+            switch (node->type) {
+                case NodeType::NUMBER:
+                    return Dual<N>(node->number.toDouble());
+                case NodeType::VARIABLE: {
+                    size_t index = node->symbol < varIndex.size() ? varIndex[node->symbol] : unbound;
+                    if (index == unbound) {
+                        std::cerr << "Error: Unbound variable " << symbolName(node->symbol) << " in ForwardEvaluator"
+                                  << std::endl;
+                        return Dual<N>(std::numeric_limits<double>::quiet_NaN());
+                    }
+                    size_t lane = lanes ? (*lanes)[index] : index >= firstLane ? index - firstLane : N;
+                    return Dual<N>::variable(values[index], lane);
+                }
+                case NodeType::OPERATOR: {
+                    const Dual<N>& u = memo[node->left];
+                    const Dual<N>& v = memo[node->right];
+                    switch (node->opType) {
+                        case OperatorType::ADD: return u + v;
+                        case OperatorType::SUB: return u - v;
+                        case OperatorType::MUL: return u * v;
+                        case OperatorType::DIV: return u / v;
+                        case OperatorType::POW: return pow(u, v);
+                        default: break;
+                    }
+                    break;
+                }
+                case NodeType::FUNCTION: {
+                    const Dual<N>& u = memo[node->left];
+                    switch (node->funcType) {
+                        case FunctionType::LN: return ln(u);
+                        case FunctionType::LOG: return log(u, memo[node->right]);
+                        case FunctionType::COS: return cos(u);
+                        case FunctionType::SIN: return sin(u);
+                        case FunctionType::TAN: return tan(u);
+                        case FunctionType::EXP: return exp(u);
+                        case FunctionType::POW_FUNC: return pow(u, memo[node->right]);
+                        default: break;
+                    }
+                    break;
+                }
+            }
+            std::cerr << "Error: Unknown node in ForwardEvaluator" << std::endl;
+            return Dual<N>(std::numeric_limits<double>::quiet_NaN());
+        }
+    };
+
+    // Value followed by one partial per entry of vars. Picks the narrowest
+    // lane count that fits and sweeps in chunks of 8 lanes beyond that.
+    std::vector<double> forwardGradient(ExprNodePtr expr, const std::vector<SymbolId>& vars,
+                                        const std::vector<double>& values);
+
+}; // namespace autodiff
+
+#endif // FORWARD_EVALUATOR_HPP
@@ -0,0 +1,109 @@
+#ifndef GRAPH_FILE_HPP
+#define GRAPH_FILE_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "expr_node.hpp"
+
+namespace autodiff {
+    // On-disk layout of a saved gradient, in the byte order of the machine
+    // that wrote it. Every section starts 8-byte aligned, in this order:
+    //
+    //   GraphFileHeader
+    //   GraphConstant[constantCount]
+    //   GraphSymbol[symbolCount]     names as offsets into the name blob
+    //   GraphRoot[rootCount]         the value, then one partial per variable
+    //   GraphNode[nodeCount]         children before parents, zero-padded to a multiple of 8
+    //   name blob, zero-padded to a multiple of 8
+    //
+    // The checksum covers everything after the header.
+    struct GraphFileHeader {
+        char magic[8]; // "ADGRAPH\0"
+        std::uint32_t version;
+        std::uint32_t byteOrder; // 0x01020304 as the writer stored it
+        std::uint64_t fileSize;
+        std::uint64_t checksum;
+        std::uint64_t nodeCount;
+        std::uint64_t symbolCount;
+        std::uint64_t constantCount;
+        std::uint64_t rootCount;
+        std::uint64_t nameBytes; // padded
+    };
+
+    const std::uint32_t graphNone = 0xffffffffu; // no child, or no variable
+
+    struct GraphNode {
+        NodeType type;
+        OperatorType opType;
+        FunctionType funcType;
+        std::uint8_t reserved;
+        std::uint32_t left;  // node index; the symbol or constant index for VARIABLE or NUMBER
+        std::uint32_t right; // node index, graphNone when absent
+    };
+
+    struct GraphSymbol {
+        std::uint32_t offset;
+        std::uint32_t length;
+    };
+
+    struct GraphConstant {
+        std::uint32_t kind; // Number::Kind
+        std::uint32_t wide; // 1: numerator and denominator are the offset and length of its text in the name blob
+        std::int64_t numerator; // the bits of the double for REAL
+        std::int64_t denominator;
+    };
+
+    struct GraphRoot {
+        std::uint32_t node;
+        std::uint32_t variable; // symbol index of the partial's variable, graphNone for the value
+    };
+
+    // Writes value and its partial derivatives in vars to path. Shared
+    // subtrees are stored once. Returns false after reporting an error.
+    bool writeGraph(const std::string& path, ExprNodePtr value, const std::vector<SymbolId>& vars,
+                    const std::vector<ExprNodePtr>& partials);
+
+    // A graph file mapped read-only. Opening checks the header and section
+    // bounds in constant time, so the tables can be read straight away;
+    // verifying the checksum reads the whole file once.
+    class MappedGraph {
+    public:
+        MappedGraph() = default;
+        ~MappedGraph();
+        MappedGraph(const MappedGraph&) = delete;
+        MappedGraph& operator=(const MappedGraph&) = delete;
+
+        bool open(const std::string& path, bool verifyChecksum = true);
+        void close();
+
+        size_t nodeCount() const { return header->nodeCount; }
+        size_t symbolCount() const { return header->symbolCount; }
+        size_t rootCount() const { return header->rootCount; }
+        const GraphNode& node(std::uint32_t index) const { return nodes[index]; }
+        const GraphRoot& root(size_t index) const { return roots[index]; }
+        std::string_view symbol(std::uint32_t index) const;
+        bool constant(std::uint32_t index, Number& value) const; // false if the entry is malformed
+
+        // Rebuilds the value and partials in the calling thread's pool with
+        // one pass over the node table; vars receives the partials' variables.
+        // Returns an empty vector if the table is inconsistent.
+        std::vector<ExprNodePtr> load(std::vector<SymbolId>& vars) const;
+
+    private:
+        const unsigned char* data = nullptr;
+        size_t size = 0;
+        const GraphFileHeader* header = nullptr;
+        const GraphNode* nodes = nullptr;
+        const GraphSymbol* symbols = nullptr;
+        const GraphConstant* constants = nullptr;
+        const GraphRoot* roots = nullptr;
+        const char* names = nullptr;
+    };
+
+}; // namespace autodiff
+
+#endif // GRAPH_FILE_HPP
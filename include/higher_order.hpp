@@ -0,0 +1,46 @@
+#ifndef HIGHER_ORDER_HPP
+#define HIGHER_ORDER_HPP
+
+#include <vector>
+#include <unordered_map>
+
+#include "expr_node.hpp"
+#include "differentiator.hpp"
+#include "simplifier.hpp"
+
+namespace autodiff {
+    struct Hessian {
+        std::vector<std::vector<ExprNodePtr>> entries; // symmetric, entries[i][j] == entries[j][i]
+        size_t nodeCount; // distinct nodes shared by all entries
+    };
+
+    // Mixed partials of any order. Variables commute, so every partial is
+    // keyed by its sorted variable list and built from the partial of one
+    // order lower; derivatives of shared subexpressions are cached per variable.
+    class HigherOrderDifferentiator {
+    public:
+        // d^k expr / d vars[0] ... d vars[k-1], simplified.
+        ExprNodePtr partial(ExprNodePtr expr, std::vector<SymbolId> vars);
+        Hessian hessian(ExprNodePtr expr, const std::vector<SymbolId>& vars);
+        void clearCache();
+
+    private:
+        struct Key {
+            ExprNodePtr expr;
+            std::vector<SymbolId> vars; // sorted ids
+            bool operator==(const Key& other) const { return expr == other.expr && vars == other.vars; }
+        };
+        struct KeyHash {
+            size_t operator()(const Key& key) const;
+        };
+
+        Differentiator differentiator;
+        Simplifier simplifier;
+        std::unordered_map<Key, ExprNodePtr, KeyHash> partials;
+
+        ExprNodePtr partialSorted(ExprNodePtr expr, const std::vector<SymbolId>& sortedVars, size_t order);
+    };
+
+}; // namespace autodiff
+
+#endif // HIGHER_ORDER_HPP
@@ -0,0 +1,50 @@
+#ifndef JACOBIAN_HPP
+#define JACOBIAN_HPP
+
+#include <istream>
+#include <string>
+#include <vector>
+
+#include "expr_node.hpp"
+#include "differentiator.hpp"
+#include "simplifier.hpp"
+
+namespace autodiff {
+    // A vector-valued function: named outputs built into the calling thread's
+    // pool, where hash-consing already stores their common subtrees once.
+    struct ExpressionSystem {
+        std::vector<std::string> names;
+        std::vector<ExprNodePtr> outputs; // one per name
+        std::vector<SymbolId> vars;       // of all outputs, sorted by name
+    };
+
+    // Reads one "name = expression" per line; blank lines are skipped. Returns
+    // false after reporting the first line that does not parse.
+    bool readSystem(std::istream& in, ExpressionSystem& system);
+
+    struct Jacobian {
+        size_t rows = 0; // outputs
+        size_t cols = 0; // variables
+        std::vector<ExprNodePtr> entries; // row-major, simplified
+        size_t nodeCount = 0; // distinct nodes shared by all entries
+
+        ExprNodePtr at(size_t row, size_t col) const { return entries[row * cols + col]; }
+    };
+
+    // All partials of a system at once. Each variable is one column: every
+    // output is differentiated against the same per-variable cache, so a
+    // subexpression used by several outputs is differentiated once per
+    // variable rather than once per output. The entries are then simplified
+    // in a single call, which likewise shares work between rows.
+    class JacobianBuilder {
+    public:
+        Jacobian build(const std::vector<ExprNodePtr>& outputs, const std::vector<SymbolId>& vars);
+
+    private:
+        Differentiator differentiator;
+        Simplifier simplifier;
+    };
+
+}; // namespace autodiff
+
+#endif // JACOBIAN_HPP
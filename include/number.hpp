@@ -0,0 +1,82 @@
+#ifndef NUMBER_HPP
+#define NUMBER_HPP
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
+
+namespace autodiff {
+    struct WideRational; // exact value beyond int64, see number.cpp
+
+    // Numeric literal payload. Integers stay int64 and quotients become exact
+    // int64 fractions. A value that outgrows int64 stays exact as a wide
+    // integer or fraction held out of line, so doubles only appear when
+    // given explicitly.
+    class Number {
+    public:
+        enum class Kind : std::uint8_t {
+            INTEGER,
+            RATIONAL,
+            REAL
+        };
+
+        Number(); // 0
+        Number(std::int64_t value);
+        static Number rational(std::int64_t num, std::int64_t den);
+        static Number real(double value);
+        // Decimal integer with optional sign, of any length; anything else
+        // strtod accepts becomes REAL.
+        static bool parse(std::string_view token, Number& result);
+
+        Kind getKind() const;
+        bool isInteger() const;
+        bool isExact() const; // INTEGER or RATIONAL
+        bool isWide() const;  // exact, with a numerator or denominator beyond int64
+        bool isZero() const;
+        bool isOne() const;
+        bool isNegative() const;
+        std::int64_t getNumerator() const; // exact kinds that are not wide
+        std::int64_t getDenominator() const; // 1 for integers
+        Number numerator() const; // exact kinds, wide or not
+        Number denominator() const;
+        double toDouble() const; // nearest double, also for wide values
+        std::string toString() const;
+        void appendTo(std::string& out) const; // toString() without a temporary
+        std::size_t hash() const;
+
+        bool operator==(const Number& other) const;
+        bool operator!=(const Number& other) const;
+        Number operator-() const;
+        Number operator+(const Number& other) const;
+        Number operator-(const Number& other) const;
+        Number operator*(const Number& other) const;
+        Number operator/(const Number& other) const; // x/0 yields a REAL inf or nan
+        Number abs() const;
+        Number reciprocal() const;
+
+        // Folds base^exponent when the result is exact (integral exponent on an
+        // exact base) or when either side is already REAL. Returns false
+        // otherwise, and for exact results too large to be worth writing out.
+        static bool pow(const Number& base, const Number& exponent, Number& result);
+
+    private:
+        // REAL values only use realValue, exact ones num and den, and wide
+        // ones (marked by den == 0) the interned wide value, so they share
+        // storage and a Number fits in 24 bytes.
+        Kind kind;
+        union {
+            std::int64_t num;
+            double realValue;
+            const WideRational* wide;
+        };
+        std::int64_t den;
+
+        static Number normalize(std::int64_t num, std::int64_t den);
+        static WideRational widen(const Number& number);
+        static Number fromWide(WideRational value); // reduces, and narrows what fits int64
+    };
+
+}; // namespace autodiff
+
+#endif // NUMBER_HPP
@@ -0,0 +1,153 @@
+#ifndef PIPELINE_STATS_HPP
+#define PIPELINE_STATS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include "expr_node.hpp"
+
+namespace autodiff {
+    enum class Stage {
+        TOKENIZE,      // Tokenizer::tokenize
+        PARSE,         // ExpressionBuilder::build, tokenizing included when it pulls from a Tokenizer
+        SIMPLIFY,      // Simplifier::simplify
+        DIFFERENTIATE, // Differentiator::differentiate(Cached), ReverseDifferentiator::gradient
+        CANONICALIZE,  // Canonicalizer::canonicalize
+        PRINT,         // TreePrinter::print, TreePrinter::printShared
+        COUNT
+    };
+
+    const char* stageName(Stage stage);
+
+    // One call of a stage. Node counts are distinct nodes of the DAG.
+    struct StageEvent {
+        Stage stage;
+        double seconds = 0.0;
+        size_t nodesBefore = 0; // of the input; 0 for TOKENIZE and PARSE
+        size_t nodesAfter = 0;  // of the result; 0 for TOKENIZE and PRINT
+        size_t length = 0;      // tokens for TOKENIZE, characters for PRINT
+        size_t allocations = 0; // nodes added to the calling thread's ExprPool
+        size_t depth = 0;       // longest path in the result, or in the input for PRINT
+    };
+
+    struct StageTotals {
+        size_t calls = 0;
+        double seconds = 0.0;
+        size_t nodesBefore = 0;
+        size_t nodesAfter = 0;
+        size_t length = 0;
+        size_t allocations = 0;
+        size_t maxDepth = 0;
+    };
+
+    // Adds up the stage events of every thread while installed with
+    // setPipelineStats. Only the outermost stage of a thread is recorded, so a
+    // simplification inside a differentiation is counted as differentiation
+    // and the stage times add up to the time spent in the library.
+    //
+    // Recording costs a node count and a depth walk per call, outside the
+    // timed part. Builds without AUTODIFF_STATS leave out the hooks entirely.
+    class PipelineStats {
+    public:
+        // Called for every event, from the thread that ran the stage.
+        typedef std::function<void(const StageEvent&)> Callback;
+
+        PipelineStats(Callback callback = Callback());
+
+        void record(const StageEvent& event);
+        StageTotals getTotals(Stage stage) const;
+        void printText(std::ostream& out) const;
+        void printJson(std::ostream& out) const; // one object, keyed by stage name
+
+    private:
+        Callback callback;
+        mutable std::mutex mutex;
+        std::array<StageTotals, static_cast<size_t>(Stage::COUNT)> totals;
+    };
+
+    // Installs stats for all threads; nullptr stops recording.
+    void setPipelineStats(PipelineStats* stats);
+    // True if the library was built with the stage hooks.
+    bool pipelineStatsAvailable();
+
+#ifdef AUTODIFF_STATS
+    namespace detail {
+        extern std::atomic<PipelineStats*> activeStats;
+    }
+
+    // Times one stage call from construction to finish(). The hooks cost a
+    // pointer load and a branch per call while no stats are installed.
+    class StageTimer {
+    public:
+        StageTimer(Stage stage, ExprNodePtr input = nullptr) : stats(detail::activeStats.load(std::memory_order_acquire)) {
+            if (stats && nesting()++ == 0) {
+                start(stage, input ? std::vector<ExprNodePtr>{ input } : std::vector<ExprNodePtr>());
+            }
+        }
+        StageTimer(Stage stage, const std::vector<ExprNodePtr>& inputs)
+            : stats(detail::activeStats.load(std::memory_order_acquire)) {
+            if (stats && nesting()++ == 0) {
+                start(stage, inputs);
+            }
+        }
+        ~StageTimer() {
+            if (stats) {
+                --nesting();
+            }
+        }
+        StageTimer(const StageTimer&) = delete;
+        StageTimer& operator=(const StageTimer&) = delete;
+
+        // Records the call with its result and passes the result through.
+        ExprNodePtr finish(ExprNodePtr result) {
+            if (outermost) {
+                stop(std::vector<ExprNodePtr>{ result }, 0);
+            }
+            return result;
+        }
+        const std::vector<ExprNodePtr>& finish(const std::vector<ExprNodePtr>& results) {
+            if (outermost) {
+                stop(results, 0);
+            }
+            return results;
+        }
+        // For stages whose result is text or tokens rather than nodes.
+        void finishLength(size_t length) {
+            if (outermost) {
+                stop(std::vector<ExprNodePtr>(), length);
+            }
+        }
+
+    private:
+        PipelineStats* stats;
+        bool outermost = false; // a stage nested in another is left to the outer one
+        StageEvent event;
+        size_t poolBefore = 0;
+        std::chrono::steady_clock::time_point begin;
+
+        static int& nesting() {
+            static thread_local int depth = 0;
+            return depth;
+        }
+        void start(Stage stage, const std::vector<ExprNodePtr>& inputs);
+        void stop(const std::vector<ExprNodePtr>& results, size_t length);
+    };
+#else
+    class StageTimer {
+    public:
+        StageTimer(Stage, ExprNodePtr = nullptr) {}
+        StageTimer(Stage, const std::vector<ExprNodePtr>&) {}
+        ExprNodePtr finish(ExprNodePtr result) { return result; }
+        const std::vector<ExprNodePtr>& finish(const std::vector<ExprNodePtr>& results) { return results; }
+        void finishLength(size_t) {}
+    };
+#endif
+
+}; // namespace autodiff
+
+#endif // PIPELINE_STATS_HPP
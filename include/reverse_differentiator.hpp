@@ -0,0 +1,34 @@
+#ifndef REVERSE_DIFFERENTIATOR_HPP
+#define REVERSE_DIFFERENTIATOR_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "expr_node.hpp"
+
+namespace autodiff {
+    // Symbolic reverse-mode (adjoint) differentiation: one sweep over the
+    // expression graph yields the partial derivative for every variable.
+    class ReverseDifferentiator {
+    public:
+        // Returns one derivative per entry of vars, in the same order.
+        std::vector<ExprNodePtr> gradient(ExprNodePtr expr, const std::vector<SymbolId>& vars);
+
+    private:
+        std::unordered_map<ExprNodePtr, ExprNodePtr> adjoints; // node -> accumulated adjoint
+        VariableMask wanted = 0; // variables of the current gradient
+
+        bool needed(ExprNodePtr node) const { return (node->dependencies & wanted) != 0; }
+
+        std::vector<ExprNodePtr> topologicalOrder(ExprNodePtr expr) const;
+        void propagate(ExprNodePtr node, ExprNodePtr adjoint);
+        void propagateOperator(ExprNodePtr node, ExprNodePtr adjoint);
+        void propagateFunction(ExprNodePtr node, ExprNodePtr adjoint);
+        void accumulate(ExprNodePtr node, ExprNodePtr contribution, bool negate = false);
+        ExprNodePtr scale(ExprNodePtr adjoint, ExprNodePtr factor) const;
+    };
+
+}; // namespace autodiff
+
+#endif // REVERSE_DIFFERENTIATOR_HPP
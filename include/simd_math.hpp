@@ -0,0 +1,337 @@
+#ifndef SIMD_MATH_HPP
+#define SIMD_MATH_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <limits>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+namespace autodiff {
+    // Each *Ops struct exposes the same small vocabulary over one register
+    // width, so the math kernels below are written once as templates.
+    // V is a vector of doubles, M a lane mask and I the 64-bit integer view.
+    struct ScalarOps {
+        typedef double V;
+        typedef bool M;
+        typedef std::int64_t I;
+        static constexpr size_t width = 1;
+
+        static V load(const double* p) { return *p; }
+        static void store(double* p, V v) { *p = v; }
+        static V set(double x) { return x; }
+        static V add(V a, V b) { return a + b; }
+        static V sub(V a, V b) { return a - b; }
+        static V mul(V a, V b) { return a * b; }
+        static V div(V a, V b) { return a / b; }
+        static V floor(V a) { return std::floor(a); }
+        static V abs(V a) { return std::fabs(a); }
+        static M lt(V a, V b) { return a < b; }
+        static M le(V a, V b) { return a <= b; }
+        static M eq(V a, V b) { return a == b; }
+        static M neq(V a, V b) { return a != b; }
+        static M andm(M a, M b) { return a && b; }
+        static M orm(M a, M b) { return a || b; }
+        static M notm(M a) { return !a; }
+        static V select(M m, V a, V b) { return m ? a : b; }
+        static int bits(M m) { return m ? 1 : 0; }
+        static I asInt(V a) { I i; std::memcpy(&i, &a, sizeof(i)); return i; }
+        static V asDouble(I i) { V a; std::memcpy(&a, &i, sizeof(a)); return a; }
+        static I iset(std::int64_t x) { return x; }
+        static I iadd(I a, I b) { return a + b; }
+        static I isub(I a, I b) { return a - b; }
+        static I iand(I a, I b) { return a & b; }
+        static I ior(I a, I b) { return a | b; }
+        template <int k> static I shl(I a) { return static_cast<I>(static_cast<std::uint64_t>(a) << k); }
+        template <int k> static I shr(I a) { return static_cast<I>(static_cast<std::uint64_t>(a) >> k); }
+    };
+
+#if defined(__AVX2__)
+    struct Avx2Ops {
+        typedef __m256d V;
+        typedef __m256d M;
+        typedef __m256i I;
+        static constexpr size_t width = 4;
+
+        static V load(const double* p) { return _mm256_loadu_pd(p); }
+        static void store(double* p, V v) { _mm256_storeu_pd(p, v); }
+        static V set(double x) { return _mm256_set1_pd(x); }
+        static V add(V a, V b) { return _mm256_add_pd(a, b); }
+        static V sub(V a, V b) { return _mm256_sub_pd(a, b); }
+        static V mul(V a, V b) { return _mm256_mul_pd(a, b); }
+        static V div(V a, V b) { return _mm256_div_pd(a, b); }
+        static V floor(V a) { return _mm256_floor_pd(a); }
+        static V abs(V a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+        static M lt(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+        static M le(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_LE_OQ); }
+        static M eq(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); }
+        static M neq(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_NEQ_UQ); }
+        static M andm(M a, M b) { return _mm256_and_pd(a, b); }
+        static M orm(M a, M b) { return _mm256_or_pd(a, b); }
+        static M notm(M a) { return _mm256_xor_pd(a, _mm256_castsi256_pd(_mm256_set1_epi64x(-1))); }
+        static V select(M m, V a, V b) { return _mm256_blendv_pd(b, a, m); }
+        static int bits(M m) { return _mm256_movemask_pd(m); }
+        static I asInt(V a) { return _mm256_castpd_si256(a); }
+        static V asDouble(I i) { return _mm256_castsi256_pd(i); }
+        static I iset(std::int64_t x) { return _mm256_set1_epi64x(x); }
+        static I iadd(I a, I b) { return _mm256_add_epi64(a, b); }
+        static I isub(I a, I b) { return _mm256_sub_epi64(a, b); }
+        static I iand(I a, I b) { return _mm256_and_si256(a, b); }
+        static I ior(I a, I b) { return _mm256_or_si256(a, b); }
+        template <int k> static I shl(I a) { return _mm256_slli_epi64(a, k); }
+        template <int k> static I shr(I a) { return _mm256_srli_epi64(a, k); }
+    };
+#endif
+
+#if defined(__AVX512F__)
+    struct Avx512Ops {
+        typedef __m512d V;
+        typedef __mmask8 M;
+        typedef __m512i I;
+        static constexpr size_t width = 8;
+
+        static V load(const double* p) { return _mm512_loadu_pd(p); }
+        static void store(double* p, V v) { _mm512_storeu_pd(p, v); }
+        static V set(double x) { return _mm512_set1_pd(x); }
+        static V add(V a, V b) { return _mm512_add_pd(a, b); }
+        static V sub(V a, V b) { return _mm512_sub_pd(a, b); }
+        static V mul(V a, V b) { return _mm512_mul_pd(a, b); }
+        static V div(V a, V b) { return _mm512_div_pd(a, b); }
+        static V floor(V a) { return _mm512_roundscale_pd(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+        static V abs(V a) { return _mm512_abs_pd(a); }
+        static M lt(V a, V b) { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+        static M le(V a, V b) { return _mm512_cmp_pd_mask(a, b, _CMP_LE_OQ); }
+        static M eq(V a, V b) { return _mm512_cmp_pd_mask(a, b, _CMP_EQ_OQ); }
+        static M neq(V a, V b) { return _mm512_cmp_pd_mask(a, b, _CMP_NEQ_UQ); }
+        static M andm(M a, M b) { return static_cast<M>(a & b); }
+        static M orm(M a, M b) { return static_cast<M>(a | b); }
+        static M notm(M a) { return static_cast<M>(~a); }
+        static V select(M m, V a, V b) { return _mm512_mask_blend_pd(m, b, a); }
+        static int bits(M m) { return m; }
+        static I asInt(V a) { return _mm512_castpd_si512(a); }
+        static V asDouble(I i) { return _mm512_castsi512_pd(i); }
+        static I iset(std::int64_t x) { return _mm512_set1_epi64(x); }
+        static I iadd(I a, I b) { return _mm512_add_epi64(a, b); }
+        static I isub(I a, I b) { return _mm512_sub_epi64(a, b); }
+        static I iand(I a, I b) { return _mm512_and_si512(a, b); }
+        static I ior(I a, I b) { return _mm512_or_si512(a, b); }
+        template <int k> static I shl(I a) { return _mm512_slli_epi64(a, k); }
+        template <int k> static I shr(I a) { return _mm512_srli_epi64(a, k); }
+    };
+#endif
+
+    // Polynomial approximations after Cephes. Arguments outside the range the
+    // reductions handle accurately fall back to <cmath> lane by lane.
+    namespace simd_math {
+        template <class S>
+        typename S::V polevl(typename S::V x, const double* coef, int degree) {
+            typename S::V result = S::set(coef[0]);
+            for (int i = 1; i <= degree; ++i) {
+                result = S::add(S::mul(result, x), S::set(coef[i]));
+            }
+            return result;
+        }
+
+        // Same as polevl with an implicit leading coefficient of 1.
+        template <class S>
+        typename S::V p1evl(typename S::V x, const double* coef, int degree) {
+            typename S::V result = S::add(x, S::set(coef[0]));
+            for (int i = 1; i < degree; ++i) {
+                result = S::add(S::mul(result, x), S::set(coef[i]));
+            }
+            return result;
+        }
+
+        // Integral double in [-2^51, 2^51] to its two's complement bits.
+        template <class S>
+        typename S::I toInt(typename S::V x) {
+            const double magic = 6755399441055744.0; // 1.5 * 2^52
+            return S::isub(S::asInt(S::add(x, S::set(magic))), S::asInt(S::set(magic)));
+        }
+
+        // 2^n for integral n in [-1022, 1023].
+        template <class S>
+        typename S::V pow2(typename S::V n) {
+            return S::asDouble(S::template shl<52>(S::iadd(toInt<S>(n), S::iset(1023))));
+        }
+
+        template <class S, class F>
+        typename S::V fixup(typename S::M mask, typename S::V x, typename S::V result, F scalar) {
+            int lanes = S::bits(mask);
+            if (lanes == 0) {
+                return result;
+            }
+            double in[S::width];
+            double out[S::width];
+            S::store(in, x);
+            S::store(out, result);
+            for (size_t i = 0; i < S::width; ++i) {
+                if (lanes & (1 << i)) {
+                    out[i] = scalar(in[i]);
+                }
+            }
+            return S::load(out);
+        }
+
+        template <class S>
+        typename S::V exp(typename S::V x) {
+            typedef typename S::V V;
+            static const double P[] = {
+                1.26177193074810590878E-4, 3.02994407707441961300E-2, 9.99999999999999999910E-1 };
+            static const double Q[] = {
+                3.00198505138664455042E-6, 2.52448340349684104192E-3, 2.27265548208155028766E-1,
+                2.00000000000000000009E0 };
+            const double maxArg = 709.782712893384;
+            const double minArg = -708.3964185322641;
+
+            typename S::M overflow = S::lt(S::set(maxArg), x);
+            typename S::M underflow = S::lt(x, S::set(minArg));
+            typename S::M isNan = S::neq(x, x);
+            V xc = S::select(overflow, S::set(maxArg), S::select(underflow, S::set(minArg), x));
+
+            V n = S::floor(S::add(S::mul(xc, S::set(1.4426950408889634073599)), S::set(0.5)));
+            V r = S::sub(xc, S::mul(n, S::set(6.93145751953125E-1)));
+            r = S::sub(r, S::mul(n, S::set(1.42860682030941723212E-6)));
+            V rr = S::mul(r, r);
+            V px = S::mul(r, polevl<S>(rr, P, 2));
+            r = S::div(px, S::sub(polevl<S>(rr, Q, 3), px));
+            r = S::add(S::set(1.0), S::add(r, r));
+
+            // Split the scale so that n = 1024 near the overflow bound stays representable.
+            V half = S::floor(S::mul(n, S::set(0.5)));
+            r = S::mul(S::mul(r, pow2<S>(half)), pow2<S>(S::sub(n, half)));
+
+            r = S::select(overflow, S::set(std::numeric_limits<double>::infinity()), r);
+            r = S::select(underflow, S::set(0.0), r);
+            return S::select(isNan, x, r);
+        }
+
+        template <class S>
+        typename S::V log(typename S::V x) {
+            typedef typename S::V V;
+            typedef typename S::I I;
+            static const double P[] = {
+                1.01875663804580931796E-4, 4.97494994976747001425E-1, 4.70579119878881725854E0,
+                1.44989225341610930846E1, 1.79368678507819816313E1, 7.70838733755885391666E0 };
+            static const double Q[] = {
+                1.12873587189167450590E1, 4.52279145837532221105E1, 8.29875266912776603211E1,
+                7.11544750618563894466E1, 2.31251620126765340583E1 };
+
+            // Subnormals are scaled into the normal range before splitting.
+            typename S::M subnormal = S::andm(S::lt(S::set(0.0), x),
+                S::lt(x, S::set(std::numeric_limits<double>::min())));
+            V xs = S::select(subnormal, S::mul(x, S::set(18014398509481984.0)), x); // 2^54
+            V adjust = S::select(subnormal, S::set(54.0), S::set(0.0));
+
+            I bitsX = S::asInt(xs);
+            I biased = S::iand(S::template shr<52>(bitsX), S::iset(0x7ff));
+            const double two52 = 4503599627370496.0;
+            V e = S::sub(S::asDouble(S::ior(biased, S::asInt(S::set(two52)))), S::set(two52));
+            e = S::sub(e, S::add(S::set(1022.0), adjust));
+            V m = S::asDouble(S::ior(S::iand(bitsX, S::iset(0x000fffffffffffffLL)), S::iset(0x3fe0000000000000LL)));
+
+            typename S::M small = S::lt(m, S::set(0.70710678118654752440));
+            e = S::select(small, S::sub(e, S::set(1.0)), e);
+            m = S::select(small, S::sub(S::add(m, m), S::set(1.0)), S::sub(m, S::set(1.0)));
+
+            V z = S::mul(m, m);
+            V y = S::mul(m, S::div(S::mul(z, polevl<S>(m, P, 5)), p1evl<S>(m, Q, 5)));
+            y = S::sub(y, S::mul(e, S::set(2.121944400546905827679e-4)));
+            y = S::sub(y, S::mul(z, S::set(0.5)));
+            z = S::add(m, y);
+            z = S::add(z, S::mul(e, S::set(0.693359375)));
+
+            const double inf = std::numeric_limits<double>::infinity();
+            z = S::select(S::eq(x, S::set(0.0)), S::set(-inf), z);
+            z = S::select(S::lt(x, S::set(0.0)), S::set(std::numeric_limits<double>::quiet_NaN()), z);
+            z = S::select(S::eq(x, S::set(inf)), x, z);
+            return S::select(S::neq(x, x), x, z);
+        }
+
+        // Shared octant reduction for sin and cos; returns the reduced
+        // argument's sine and cosine polynomials plus the octant flags.
+        template <class S>
+        void sinCosKernel(typename S::V ax, typename S::V& sinPoly, typename S::V& cosPoly,
+                          typename S::M& swap, typename S::M& flip) {
+            typedef typename S::V V;
+            static const double sinCoef[] = {
+                1.58962301576546568060E-10, -2.50507477628578072866E-8, 2.75573136213857245213E-6,
+                -1.98412698295895385996E-4, 8.33333333332211858878E-3, -1.66666666666666307295E-1 };
+            static const double cosCoef[] = {
+                -1.13585365213876817300E-11, 2.08757008419747316778E-9, -2.75573141792967388112E-7,
+                2.48015872888517045348E-5, -1.38888888888730564116E-3, 4.16666666666665929218E-2 };
+
+            V y = S::floor(S::mul(ax, S::set(1.27323954473516268615))); // 4/pi
+            V odd = S::sub(y, S::mul(S::set(2.0), S::floor(S::mul(y, S::set(0.5)))));
+            y = S::add(y, odd);
+            V octant = S::sub(y, S::mul(S::set(8.0), S::floor(S::mul(y, S::set(0.125)))));
+            flip = S::le(S::set(4.0), octant);
+            V j = S::select(flip, S::sub(octant, S::set(4.0)), octant);
+            swap = S::eq(j, S::set(2.0));
+
+            V z = S::sub(ax, S::mul(y, S::set(7.85398125648498535156E-1)));
+            z = S::sub(z, S::mul(y, S::set(3.77489470793079817668E-8)));
+            z = S::sub(z, S::mul(y, S::set(2.69515142907905952645E-15)));
+            V zz = S::mul(z, z);
+            sinPoly = S::add(z, S::mul(S::mul(z, zz), polevl<S>(zz, sinCoef, 5)));
+            cosPoly = S::add(S::sub(S::set(1.0), S::mul(zz, S::set(0.5))),
+                S::mul(S::mul(zz, zz), polevl<S>(zz, cosCoef, 5)));
+        }
+
+        template <class S>
+        typename S::V sin(typename S::V x) {
+            typedef typename S::V V;
+            V ax = S::abs(x);
+            V sinPoly, cosPoly;
+            typename S::M swap, flip;
+            sinCosKernel<S>(ax, sinPoly, cosPoly, swap, flip);
+            V r = S::select(swap, cosPoly, sinPoly);
+            typename S::M negative = S::lt(x, S::set(0.0));
+            typename S::M negate = S::andm(S::orm(flip, negative), S::notm(S::andm(flip, negative)));
+            r = S::select(negate, S::sub(S::set(0.0), r), r);
+            typename S::M outOfRange = S::notm(S::le(ax, S::set(1e8)));
+            return fixup<S>(outOfRange, x, r, [](double v) { return std::sin(v); });
+        }
+
+        template <class S>
+        typename S::V cos(typename S::V x) {
+            typedef typename S::V V;
+            V ax = S::abs(x);
+            V sinPoly, cosPoly;
+            typename S::M swap, flip;
+            sinCosKernel<S>(ax, sinPoly, cosPoly, swap, flip);
+            V r = S::select(swap, sinPoly, cosPoly);
+            typename S::M negate = S::andm(S::orm(flip, swap), S::notm(S::andm(flip, swap)));
+            r = S::select(negate, S::sub(S::set(0.0), r), r);
+            typename S::M outOfRange = S::notm(S::le(ax, S::set(1e8)));
+            return fixup<S>(outOfRange, x, r, [](double v) { return std::cos(v); });
+        }
+
+        template <class S>
+        typename S::V tan(typename S::V x) {
+            return S::div(sin<S>(x), cos<S>(x));
+        }
+
+        // Follows std::pow for negative bases, zero and unit cases.
+        template <class S>
+        typename S::V pow(typename S::V a, typename S::V b) {
+            typedef typename S::V V;
+            V r = exp<S>(S::mul(b, log<S>(S::abs(a))));
+            typename S::M integral = S::eq(S::floor(b), b);
+            typename S::M negativeBase = S::lt(a, S::set(0.0));
+            V parity = S::sub(b, S::mul(S::set(2.0), S::floor(S::mul(b, S::set(0.5)))));
+            typename S::M oddPower = S::andm(integral, S::eq(parity, S::set(1.0)));
+            r = S::select(S::andm(negativeBase, oddPower), S::sub(S::set(0.0), r), r);
+            r = S::select(S::andm(negativeBase, S::notm(integral)),
+                S::set(std::numeric_limits<double>::quiet_NaN()), r);
+            return S::select(S::orm(S::eq(b, S::set(0.0)), S::eq(a, S::set(1.0))), S::set(1.0), r);
+        }
+    }; // namespace simd_math
+
+}; // namespace autodiff
+
+#endif // SIMD_MATH_HPP
@@ -1,25 +1,35 @@
 #ifndef SIMPLIFIER_HPP
 #define SIMPLIFIER_HPP
 
+#include <unordered_map>
+#include <vector>
+
 #include "expr_node.hpp"
 
 namespace autodiff {
     class Simplifier {
     public:
         ExprNodePtr simplify(ExprNodePtr node);
+        // Simplifies nodes in one call, so subtrees they share are simplified once.
+        std::vector<ExprNodePtr> simplify(const std::vector<ExprNodePtr>& nodes);
     private:
+        std::unordered_map<ExprNodePtr, ExprNodePtr> memo; // node -> simplified node for the current call
+
         ExprNodePtr simplifyNode(ExprNodePtr node);
+        ExprNodePtr simplifyUncached(ExprNodePtr node);
+
+        // Each rule receives the original node and its already simplified children.
+        ExprNodePtr simplifyAdd(ExprNodePtr node, ExprNodePtr left, ExprNodePtr right);
+        ExprNodePtr simplifySub(ExprNodePtr node, ExprNodePtr left, ExprNodePtr right);
+        ExprNodePtr simplifyMul(ExprNodePtr node, ExprNodePtr left, ExprNodePtr right);
+        ExprNodePtr simplifyDiv(ExprNodePtr node, ExprNodePtr left, ExprNodePtr right);
+        ExprNodePtr simplifyPow(ExprNodePtr node, ExprNodePtr left, ExprNodePtr right);
 
-        ExprNodePtr simplifyAdd(ExprNodePtr node);
-        ExprNodePtr simplifySub(ExprNodePtr node);
-        ExprNodePtr simplifyMul(ExprNodePtr node);
-        ExprNodePtr simplifyDiv(ExprNodePtr node);
-        ExprNodePtr simplifyPow(ExprNodePtr node);
+        ExprNodePtr rebuild(ExprNodePtr node, ExprNodePtr left, ExprNodePtr right) const;
 
-        bool isNumberNode(const ExprNodePtr& expr, const std::string& value) const;
-        bool isZero(const ExprNodePtr& expr) const;
-        bool isOne(const ExprNodePtr& expr) const;
+        bool isZero(ExprNodePtr expr) const;
+        bool isOne(ExprNodePtr expr) const;
     };
 };
 
-#endif // SIMPLIFIER_HPP
\ No newline at end of file
+#endif // SIMPLIFIER_HPP
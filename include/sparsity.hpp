@@ -0,0 +1,66 @@
+#ifndef SPARSITY_HPP
+#define SPARSITY_HPP
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "expr_node.hpp"
+
+namespace autodiff {
+    // Structural nonzeros of a matrix in compressed sparse row form, columns
+    // ascending within a row. Entries not listed are zero for every input.
+    struct SparsityPattern {
+        size_t rows = 0;
+        size_t cols = 0;
+        std::vector<size_t> rowStart;        // rows + 1 offsets into columns
+        std::vector<std::uint32_t> columns;
+
+        size_t nonzeros() const { return columns.size(); }
+    };
+
+    // A sparse matrix on a pattern: values[k] belongs to pattern.columns[k].
+    struct SparseMatrix {
+        SparsityPattern pattern;
+        std::vector<double> values;
+    };
+
+    // Patterns read off the graph alone, without differentiating. Row r of the
+    // Jacobian holds the variables outputs[r] contains. The Hessian pattern is
+    // symmetric with both triangles stored: (i, j) is in it when some node
+    // combines vars[i] and vars[j] nonlinearly (a product of a term in one and
+    // a term in the other, a quotient, a power or a function of both). Both
+    // are conservative: terms that cancel still count.
+    SparsityPattern jacobianPattern(const std::vector<ExprNodePtr>& outputs, const std::vector<SymbolId>& vars);
+    SparsityPattern hessianPattern(ExprNodePtr expr, const std::vector<SymbolId>& vars);
+
+    // Greedy colorings, largest degree first; colors are 0, 1, ... Columns of
+    // one color share no row, so a single forward sweep seeded with all of
+    // them yields every one of their entries.
+    std::vector<std::uint32_t> colorColumns(const SparsityPattern& jacobian);
+    // Star coloring of a symmetric pattern: adjacent variables differ and every
+    // path on four variables uses at least three colors, so each entry can be
+    // read directly from one Hessian-vector product per color.
+    std::vector<std::uint32_t> starColor(const SparsityPattern& hessian);
+    size_t colorCount(const std::vector<std::uint32_t>& colors);
+
+    // Jacobian of outputs at values (values[i] binds vars[i]) with one forward
+    // sweep per color of colorColumns(pattern), eight colors at a time.
+    SparseMatrix sparseJacobian(const std::vector<ExprNodePtr>& outputs, const std::vector<SymbolId>& vars,
+                                const std::vector<double>& values, const SparsityPattern& pattern,
+                                const std::vector<std::uint32_t>& colors);
+    // Hessian of expr at values: the symbolic gradient is built once, then
+    // swept forward along one seed per color of starColor(pattern).
+    SparseMatrix sparseHessian(ExprNodePtr expr, const std::vector<SymbolId>& vars, const std::vector<double>& values,
+                               const SparsityPattern& pattern, const std::vector<std::uint32_t>& colors);
+
+    // Coordinate form, one "row column value" per line with 0-based indices;
+    // values is optional.
+    void printCoo(std::ostream& out, const SparsityPattern& pattern, const std::vector<double>& values = {});
+    // Compressed rows as three lines: row_start, columns and, if given, values.
+    void printCsr(std::ostream& out, const SparsityPattern& pattern, const std::vector<double>& values = {});
+
+}; // namespace autodiff
+
+#endif // SPARSITY_HPP
@@ -0,0 +1,107 @@
+#ifndef STREAM_PROCESSOR_HPP
+#define STREAM_PROCESSOR_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <istream>
+#include <ostream>
+
+#include "expr_node.hpp"
+#include "tokenizer.hpp"
+#include "expression_builder.hpp"
+#include "simplifier.hpp"
+#include "differentiator.hpp"
+#include "reverse_differentiator.hpp"
+#include "canonicalizer.hpp"
+#include "tree_printer.hpp"
+#include "thread_pool.hpp"
+
+namespace autodiff {
+    enum class OutputFormat {
+        TEXT, // "x: <derivative>" per variable, a blank line after each expression
+        TSV,  // line<TAB>variable<TAB>derivative, or line<TAB>t1<TAB>definition for a binding
+        JSON  // one object per expression: {"line":N,"expression":...,"derivatives":{...}}
+    };
+
+    struct StreamOptions {
+        OutputFormat format = OutputFormat::TEXT;
+        bool perVariable = false;
+        bool canonical = false;
+        bool shared = false; // print repeated subtrees once as let-bindings shared by all derivatives
+        DerivativeCache* cache = nullptr; // shared by all workers, used in per-variable mode
+    };
+
+    // Differentiates one expression per input line. The tokenizer, parser,
+    // passes and output buffer are reused from line to line, and the calling
+    // thread's ExprPool is cleared before every line, so memory stays bounded
+    // by the largest expression rather than the length of the input.
+    //
+    // With a pool, the per-variable work on a large expression (differentiating
+    // in per-variable mode, simplifying, printing) runs as one task per variable.
+    // Not with shared bindings: the derivatives must then outlive the tasks,
+    // and a worker's nodes are gone once it moves on to its next line.
+    class StreamProcessor {
+    public:
+        StreamProcessor(const StreamOptions& options, ThreadPool* pool = nullptr);
+
+        // Appends the formatted gradient of expr to out. lineNumber is 1-based
+        // and only used for labelling. Returns false if expr did not parse;
+        // an error record is still appended in the TSV and JSON formats.
+        bool process(std::string_view expr, size_t lineNumber, std::string& out);
+
+        // Processes every non-blank line of in, writing to out in large blocks.
+        // Returns the number of expressions that failed to parse.
+        size_t run(std::istream& in, std::ostream& out);
+
+    private:
+        // Pass objects for whichever thread runs a variable's task.
+        struct Scratch {
+            Simplifier simplifier;
+            Differentiator differentiator;
+            ReverseDifferentiator reverse;
+            Canonicalizer canonicalizer;
+            TreePrinter printer;
+        };
+        static Scratch& threadScratch();
+
+        StreamOptions options;
+        ThreadPool* pool;
+        Tokenizer tokenizer;
+        ExpressionBuilder builder;
+        std::vector<ExprNodePtr> derivatives;
+        std::vector<std::string> texts; // printed derivative per variable, when not printed in place
+        std::vector<ExprNodePtr> finished; // final derivative per variable, kept for shared printing
+        SharedPrint bindings;
+
+        ExprNodePtr derive(ExprNodePtr root, SymbolId var, size_t index);
+        void appendError(std::string_view expr, size_t lineNumber, std::string& out) const;
+    };
+
+    // Runs the batch on a thread pool. Lines are handed out in chunks to
+    // whichever worker is free, each worker keeps its own StreamProcessor and
+    // node pool, and the chunks' output is written back in input order.
+    class ParallelStreamProcessor {
+    public:
+        ParallelStreamProcessor(const StreamOptions& options, size_t numThreads = 0);
+        size_t run(std::istream& in, std::ostream& out); // as StreamProcessor::run
+
+    private:
+        struct Chunk {
+            std::vector<std::string> lines;
+            size_t firstLine = 0; // number of lines[0]
+            std::string output;
+            size_t failures = 0;
+            TaskGroup done;
+        };
+
+        ThreadPool pool;
+        std::vector<std::unique_ptr<StreamProcessor>> processors; // one per worker
+    };
+
+    // Appends text as a quoted JSON string.
+    void appendJsonString(std::string_view text, std::string& out);
+
+}; // namespace autodiff
+
+#endif // STREAM_PROCESSOR_HPP
@@ -0,0 +1,56 @@
+#ifndef SYMBOL_TABLE_HPP
+#define SYMBOL_TABLE_HPP
+
+#include <string>
+#include <string_view>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace autodiff {
+    typedef std::uint32_t SymbolId;
+
+    // Interns identifier names into dense integer ids. Ids are process-wide and
+    // never reused, so nodes from different pools and threads agree on them.
+    // Only intern locks; symbols live in fixed chunks that never move, so
+    // getName and getHash read without synchronization.
+    class SymbolTable {
+    public:
+        SymbolId intern(std::string_view name);
+        const std::string& getName(SymbolId id) const;
+        std::size_t getHash(SymbolId id) const; // hash of the name, stable across runs
+        std::size_t size() const;
+
+        static SymbolTable& global();
+
+    private:
+        struct Symbol {
+            std::string name;
+            std::size_t hash;
+        };
+
+        static constexpr std::size_t chunkBits = 12;
+        static constexpr std::size_t chunkSize = std::size_t(1) << chunkBits;
+        static constexpr std::size_t maxChunks = 16384;
+
+        std::mutex mutex;
+        std::unordered_map<std::string, SymbolId> ids;
+        std::array<std::unique_ptr<Symbol[]>, maxChunks> chunks;
+        std::atomic<std::uint32_t> count{ 0 };
+
+        const Symbol& at(SymbolId id) const;
+    };
+
+    SymbolId internSymbol(std::string_view name); // SymbolTable::global().intern
+    const std::string& symbolName(SymbolId id);
+    // Orders ids by name, which is how variables are presented to the user.
+    void sortByName(std::vector<SymbolId>& ids);
+
+}; // namespace autodiff
+
+#endif // SYMBOL_TABLE_HPP
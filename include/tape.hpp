@@ -0,0 +1,67 @@
+#ifndef TAPE_HPP
+#define TAPE_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+#include "expr_node.hpp"
+
+namespace autodiff {
+    enum class OpCode : std::uint8_t {
+        ADD, SUB, MUL, DIV, POW,
+        LN, LOG, COS, SIN, TAN, EXP
+    };
+
+    // dst = op(a, b); b is unused by unary opcodes.
+    struct Instruction {
+        OpCode op;
+        std::uint32_t dst;
+        std::uint32_t a;
+        std::uint32_t b;
+    };
+
+    // Straight-line program over a flat register file laid out as
+    // [inputs | constants | temporaries]. Evaluation only indexes arrays.
+    class Tape {
+    public:
+        // inputs[i] binds the i-th variable given to the compiler;
+        // outputs[k] receives the value of the k-th compiled root.
+        void evaluate(const double* inputs, double* outputs);
+        double evaluate(const double* inputs); // first root only
+
+        size_t numInputs() const;
+        size_t numOutputs() const;
+        size_t numRegisters() const;
+        const std::vector<Instruction>& getInstructions() const;
+        const std::vector<std::uint32_t>& getOutputs() const;
+        const std::vector<double>& getRegisters() const; // constants already loaded
+
+    private:
+        friend class TapeCompiler;
+
+        void run(const double* inputs);
+
+        size_t inputCount = 0;
+        std::vector<Instruction> instructions;
+        std::vector<std::uint32_t> outputs;
+        std::vector<double> registers;
+    };
+
+    class TapeCompiler {
+    public:
+        TapeCompiler(const std::vector<SymbolId>& vars);
+        Tape compile(ExprNodePtr root);
+        Tape compile(const std::vector<ExprNodePtr>& roots);
+
+    private:
+        std::vector<SymbolId> vars;
+
+        std::vector<ExprNodePtr> topologicalOrder(const std::vector<ExprNodePtr>& roots) const;
+        OpCode getOpCode(ExprNodePtr node) const;
+    };
+
+}; // namespace autodiff
+
+#endif // TAPE_HPP
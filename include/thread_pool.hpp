@@ -0,0 +1,77 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace autodiff {
+    // Counts the unfinished tasks submitted under it.
+    class TaskGroup {
+    public:
+        bool done() const;
+
+    private:
+        friend class ThreadPool;
+        std::atomic<size_t> pending{ 0 };
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+
+    // Work-stealing pool. Every worker owns a deque: it pushes and pops its own
+    // tasks at the back, and idle workers steal from the front of the others.
+    // Tasks submitted from outside the pool go to a shared injection queue that
+    // only idle workers take from.
+    //
+    // Each worker has its own thread_local ExprPool, so a task may read nodes
+    // built on another thread but interns new ones into its own pool.
+    class ThreadPool {
+    public:
+        ThreadPool(size_t numThreads = 0); // 0: one per hardware thread
+        ~ThreadPool();
+
+        size_t size() const;
+        // Index of the calling worker, or size() when called from another thread.
+        size_t currentWorker() const;
+
+        void submit(TaskGroup& group, std::function<void()> task);
+        // Returns once every task of the group has finished. A worker that waits
+        // runs the group's tasks, its own or stolen, and never starts unrelated
+        // work, so the caller's thread-local state stays untouched.
+        void wait(TaskGroup& group);
+
+    private:
+        struct Task {
+            TaskGroup* group;
+            std::function<void()> run;
+        };
+        struct Worker {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::vector<std::thread> threads;
+        std::mutex injectionMutex;
+        std::deque<Task> injection; // submitted from outside the pool
+        std::atomic<size_t> queued{ 0 };
+        std::mutex sleepMutex;
+        std::condition_variable wake;
+        bool stopping = false;
+
+        bool popOwn(size_t index, TaskGroup* group, Task& task);
+        bool popInjected(Task& task);
+        // Oldest task of group, or of any group if it is null, from another worker.
+        bool steal(size_t thief, TaskGroup* group, Task& task);
+        void execute(Task& task);
+        void workerLoop(size_t index);
+    };
+
+}; // namespace autodiff
+
+#endif // THREAD_POOL_HPP
@@ -2,30 +2,65 @@
 #define TOKENIZER_HPP
 
 #include <string>
+#include <string_view>
 #include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+#include "expr_node.hpp"
+#include "symbol_table.hpp"
 
 namespace autodiff {
+    enum class TokenKind : std::uint8_t {
+        NUMBER,
+        VARIABLE,
+        FUNCTION,
+        OPERATOR,
+        LEFT_PAREN,
+        RIGHT_PAREN,
+        COMMA,
+        END
+    };
+
+    // Classified once by the tokenizer; text points into the source string.
+    struct Token {
+        TokenKind kind;
+        OperatorType opType; // OPERATOR
+        FunctionType funcType; // FUNCTION
+        SymbolId symbol; // VARIABLE, interned while tokenizing
+        std::string_view text;
+    };
+
+    // The tokenizer does not copy the expression: it and its tokens refer to
+    // the caller's string, which has to outlive them.
     class Tokenizer {
     public:
-        Tokenizer(const std::string& expr);
-        std::vector<std::string> tokenize();
-        std::vector<std::string> getVariables();
+        Tokenizer(std::string_view expr);
+        // Starts over on a new expression, keeping allocated capacity.
+        void reset(std::string_view expr);
+        std::vector<Token> tokenize(); // ends with an END token
+        std::vector<SymbolId> getVariables(); // interned, in order of first appearance
+        // Streams the next token without materializing the list; END repeats at the end.
+        Token next();
 
     private:
-        std::string expr;
-        int cur_pos;
+        std::string_view expr;
+        size_t cur_pos;
+        TokenKind previous; // kind of the last token handed out, END before the first
+        std::unordered_map<std::string_view, SymbolId> symbols; // names this tokenizer has interned
+
+        SymbolId intern(std::string_view name);
 
-        std::string getNumber();
-        std::string getLetters();
-        std::string getOperator();
-        std::string getFunction();
+        std::string_view getNumber();
+        std::string_view getLetters();
     };
 
     bool isDigit(char c);
     bool isLetter(char c);
     bool isOperator(char c);
-    bool isFunction(const std::string& s);
+    bool isFunction(std::string_view s);
+    FunctionType getFunctionType(std::string_view s); // NONE_FUNC for non-functions
 
 }; // namespace autodiff
 
-#endif // TOKENIZER_HPP
\ No newline at end of file
+#endif // TOKENIZER_HPP
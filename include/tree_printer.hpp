@@ -3,25 +3,58 @@
 
 #include <string>
 #include <memory>
+#include <vector>
+#include <unordered_map>
+#include <ostream>
 
 #include "expr_node.hpp"
 
 namespace autodiff {
+    // Several expressions printed against one set of let-bindings. A subtree
+    // that occurs more than once across all of them, and is long enough to
+    // make it pay, is printed once as t<k> = ... and referred to by name
+    // everywhere else. Names contain a digit, so they never clash with a variable.
+    struct SharedPrint {
+        std::vector<std::string> names;       // t1, t2, ...
+        std::vector<std::string> definitions; // of names[i], which may use names before i
+        std::vector<std::string> results;     // one per root
+    };
+
+    // Appends output directly to the caller's buffer: no string is built per
+    // node, and the pending-item stack is kept from call to call, so printing
+    // allocates nothing once the buffers have grown to size.
     class TreePrinter {
     public:
-        std::string print(const ExprNodePtr& node) const;
+        std::string print(ExprNodePtr node);
+        void print(ExprNodePtr node, std::string& out); // appends to out
+        // Writes in blocks through an internal buffer, whatever the size of the tree.
+        void print(ExprNodePtr node, std::ostream& out);
+        SharedPrint printShared(const std::vector<ExprNodePtr>& roots);
     private:
-        std::string printNode(const ExprNodePtr& node) const;
-        std::string printOperator(const ExprNodePtr& node) const;
-        std::string printFunction(const ExprNodePtr& node) const;
+        typedef std::unordered_map<ExprNodePtr, std::string> Names;
+
+        // Pending output: a node still to be printed, or one character when node is null.
+        struct Item {
+            ExprNodePtr node;
+            char text;
+        };
+        std::vector<Item> stack;
+        std::string block; // for print to an ostream
+        size_t flushed = 0; // bytes of block already written out by the current print
+
+        // Prints node, writing a bound subtree below it as its name. With a
+        // sink, out is written to it and emptied whenever it grows large.
+        void append(ExprNodePtr node, const Names* names, std::string& out, std::ostream* sink = nullptr);
+        ExprNodePtr openOperator(ExprNodePtr node, const Names* names, std::string& out);
+        ExprNodePtr openFunction(ExprNodePtr node, std::string& out);
 
-        int getPrecedence(const ExprNodePtr& node) const;
-        bool needParentheses(const ExprNodePtr& parent, const ExprNodePtr& child, bool isRight) const;
+        int getPrecedence(ExprNodePtr node) const;
+        bool needParentheses(ExprNodePtr parent, ExprNodePtr child, bool isRight) const;
 
-        std::string getOperatorString(OperatorType op) const;
-        std::string getFunctionString(FunctionType func) const;
+        char getOperatorSymbol(OperatorType op) const;
+        const char* getFunctionString(FunctionType func) const;
     };
 
 }; // namespace autodiff
 
-#endif // TREE_PRINTER_HPP
\ No newline at end of file
+#endif // TREE_PRINTER_HPP
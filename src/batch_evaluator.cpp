@@ -0,0 +1,138 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "batch_evaluator.hpp"
+#include "simd_math.hpp"
+
+using namespace autodiff;
+
+namespace {
+    // One functor per opcode; unary operations ignore b.
+    struct AddOp { template <class S> static typename S::V apply(typename S::V a, typename S::V b) { return S::add(a, b); } };
+    struct SubOp { template <class S> static typename S::V apply(typename S::V a, typename S::V b) { return S::sub(a, b); } };
+    struct MulOp { template <class S> static typename S::V apply(typename S::V a, typename S::V b) { return S::mul(a, b); } };
+    struct DivOp { template <class S> static typename S::V apply(typename S::V a, typename S::V b) { return S::div(a, b); } };
+    struct PowOp { template <class S> static typename S::V apply(typename S::V a, typename S::V b) { return simd_math::pow<S>(a, b); } };
+    struct LnOp { template <class S> static typename S::V apply(typename S::V a, typename S::V) { return simd_math::log<S>(a); } };
+    struct LogOp {
+        template <class S> static typename S::V apply(typename S::V a, typename S::V b) {
+            return S::div(simd_math::log<S>(b), simd_math::log<S>(a));
+        }
+    };
+    struct CosOp { template <class S> static typename S::V apply(typename S::V a, typename S::V) { return simd_math::cos<S>(a); } };
+    struct SinOp { template <class S> static typename S::V apply(typename S::V a, typename S::V) { return simd_math::sin<S>(a); } };
+    struct TanOp { template <class S> static typename S::V apply(typename S::V a, typename S::V) { return simd_math::tan<S>(a); } };
+    struct ExpOp { template <class S> static typename S::V apply(typename S::V a, typename S::V) { return simd_math::exp<S>(a); } };
+
+    // dst may alias a or b: every lane is loaded before it is stored.
+    template <class S, class Op>
+    void kernel(const double* a, const double* b, double* dst, size_t count) {
+        size_t i = 0;
+        for (; i + S::width <= count; i += S::width) {
+            S::store(dst + i, Op::template apply<S>(S::load(a + i), S::load(b + i)));
+        }
+        for (; i < count; ++i) {
+            dst[i] = Op::template apply<ScalarOps>(a[i], b[i]);
+        }
+    }
+
+    template <class S>
+    void dispatch(OpCode op, const double* a, const double* b, double* dst, size_t count) {
+        switch (op) {
+            case OpCode::ADD: kernel<S, AddOp>(a, b, dst, count); break;
+            case OpCode::SUB: kernel<S, SubOp>(a, b, dst, count); break;
+            case OpCode::MUL: kernel<S, MulOp>(a, b, dst, count); break;
+            case OpCode::DIV: kernel<S, DivOp>(a, b, dst, count); break;
+            case OpCode::POW: kernel<S, PowOp>(a, b, dst, count); break;
+            case OpCode::LN: kernel<S, LnOp>(a, b, dst, count); break;
+            case OpCode::LOG: kernel<S, LogOp>(a, b, dst, count); break;
+            case OpCode::COS: kernel<S, CosOp>(a, b, dst, count); break;
+            case OpCode::SIN: kernel<S, SinOp>(a, b, dst, count); break;
+            case OpCode::TAN: kernel<S, TanOp>(a, b, dst, count); break;
+            case OpCode::EXP: kernel<S, ExpOp>(a, b, dst, count); break;
+        }
+    }
+}
+
+BatchEvaluator::BatchEvaluator(const Tape& tape, SimdLevel level) :
+    instructions(tape.getInstructions()), outputRegisters(tape.getOutputs()),
+    inputCount(tape.numInputs()), level(level) {
+    if (level > bestSimdLevel()) {
+        std::cerr << "Error: " << getLevelName(level) << " is not available in this build, using "
+                  << getLevelName(bestSimdLevel()) << std::endl;
+        this->level = bestSimdLevel();
+    }
+    const std::vector<double>& registers = tape.getRegisters();
+    rows.assign(registers.size() * blockSize, 0.0);
+    for (size_t reg = inputCount; reg < registers.size(); ++reg) {
+        std::fill_n(rows.begin() + reg * blockSize, blockSize, registers[reg]);
+    }
+}
+
+void BatchEvaluator::evaluate(const std::vector<const double*>& columns, const std::vector<double*>& outputs,
+                              size_t numPoints) {
+    for (size_t offset = 0; offset < numPoints; offset += blockSize) {
+        size_t count = std::min(blockSize, numPoints - offset);
+        switch (level) {
+#if defined(__AVX512F__)
+            case SimdLevel::AVX512:
+                evaluateBlock<Avx512Ops>(columns, offset, count);
+                break;
+#endif
+#if defined(__AVX2__)
+            case SimdLevel::AVX2:
+                evaluateBlock<Avx2Ops>(columns, offset, count);
+                break;
+#endif
+            default:
+                evaluateBlock<ScalarOps>(columns, offset, count);
+                break;
+        }
+        for (size_t k = 0; k < outputRegisters.size(); ++k) {
+            std::memcpy(outputs[k] + offset, source(outputRegisters[k], columns, offset), count * sizeof(double));
+        }
+    }
+}
+
+template <class S>
+void BatchEvaluator::evaluateBlock(const std::vector<const double*>& columns, size_t offset, size_t count) {
+    for (const Instruction& ins : instructions) {
+        dispatch<S>(ins.op, source(ins.a, columns, offset), source(ins.b, columns, offset),
+            rows.data() + ins.dst * blockSize, count);
+    }
+}
+
+// Input registers read straight from the caller's columns instead of a copy.
+const double* BatchEvaluator::source(std::uint32_t reg, const std::vector<const double*>& columns,
+                                     size_t offset) const {
+    if (reg < inputCount) {
+        return columns[reg] + offset;
+    }
+    return rows.data() + reg * blockSize;
+}
+
+SimdLevel BatchEvaluator::getLevel() const {
+    return level;
+}
+
+SimdLevel BatchEvaluator::bestSimdLevel() {
+#if defined(__AVX512F__)
+    return SimdLevel::AVX512;
+#elif defined(__AVX2__)
+    return SimdLevel::AVX2;
+#else
+    return SimdLevel::SCALAR;
+#endif
+}
+
+const char* BatchEvaluator::getLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::AVX2:
+            return "avx2";
+        case SimdLevel::AVX512:
+            return "avx512";
+        default:
+            return "scalar";
+    }
+}
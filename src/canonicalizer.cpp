@@ -0,0 +1,420 @@
+#include <algorithm>
+#include <unordered_map>
+
+#include "canonicalizer.hpp"
+#include "pipeline_stats.hpp"
+
+using namespace autodiff;
+
+namespace {
+    bool isOperator(ExprNodePtr node, OperatorType a, OperatorType b) {
+        return node->type == NodeType::OPERATOR && (node->opType == a || node->opType == b);
+    }
+}
+
+Canonicalizer::Canonicalizer(int maxIterations) : maxIterations(maxIterations) {}
+
+ExprNodePtr Canonicalizer::canonicalize(ExprNodePtr node) {
+    stats = CanonicalizeStats();
+    if (!node) {
+        return nullptr;
+    }
+    StageTimer timer(Stage::CANONICALIZE, node);
+    stats.nodesBefore = countNodes(node);
+    // Hash-consing makes "nothing changed" a pointer comparison.
+    ExprNodePtr current = node;
+    while (stats.iterations < maxIterations) {
+        resetTable(memo);
+        ExprNodePtr next = canonicalNode(current);
+        ++stats.iterations;
+        if (next == current) {
+            break;
+        }
+        current = next;
+    }
+    stats.nodesAfter = countNodes(current);
+    return timer.finish(current);
+}
+
+const CanonicalizeStats& Canonicalizer::getLastStats() const {
+    return stats;
+}
+
+ExprNodePtr Canonicalizer::canonicalNode(ExprNodePtr node) {
+    if (!node) {
+        return nullptr;
+    }
+    auto cached = memo.find(node);
+    if (cached != memo.end()) {
+        return cached->second;
+    }
+    // Explicit post-order walk: whatever a node is rebuilt from is canonical
+    // before the node itself, whatever the nesting depth. A +/- or * and /
+    // chain is rebuilt from its leaves, not from the chain's inner nodes.
+    std::vector<std::pair<ExprNodePtr, bool>> stack; // (node, operands already pushed)
+    std::vector<ExprNodePtr> chain;
+    stack.emplace_back(node, false);
+    while (!stack.empty()) {
+        auto [top, expanded] = stack.back();
+        if (memo.count(top)) {
+            stack.pop_back();
+            continue;
+        }
+        if (expanded) {
+            stack.pop_back();
+            memo.emplace(top, canonicalUncached(top));
+            continue;
+        }
+        stack.back().second = true;
+        bool sum = isOperator(top, OperatorType::ADD, OperatorType::SUB);
+        if (sum || isOperator(top, OperatorType::MUL, OperatorType::DIV)) {
+            OperatorType a = sum ? OperatorType::ADD : OperatorType::MUL;
+            OperatorType b = sum ? OperatorType::SUB : OperatorType::DIV;
+            chain.assign(1, top);
+            while (!chain.empty()) {
+                ExprNodePtr link = chain.back();
+                chain.pop_back();
+                if (isOperator(link, a, b)) {
+                    chain.push_back(link->right);
+                    chain.push_back(link->left);
+                } else if (!memo.count(link)) {
+                    stack.emplace_back(link, false);
+                }
+            }
+            continue;
+        }
+        if (top->right) {
+            stack.emplace_back(top->right, false);
+        }
+        if (top->left) {
+            stack.emplace_back(top->left, false);
+        }
+    }
+    return memo.at(node);
+}
+
+// Whatever the node is rebuilt from is already in memo.
+ExprNodePtr Canonicalizer::canonicalUncached(ExprNodePtr node) {
+    if (node->type == NodeType::OPERATOR) {
+        switch (node->opType) {
+            case OperatorType::ADD:
+            case OperatorType::SUB:
+                return canonicalSum(node);
+            case OperatorType::MUL:
+            case OperatorType::DIV:
+                return canonicalProduct(node);
+            case OperatorType::POW:
+                return canonicalPow(canonicalNode(node->left), canonicalNode(node->right));
+            default:
+                break;
+        }
+    } else if (node->type == NodeType::FUNCTION) {
+        return canonicalFunction(node);
+    }
+    return node;
+}
+
+ExprNodePtr Canonicalizer::canonicalSum(ExprNodePtr node) {
+    std::vector<Term> terms;
+    collectSum(node, false, false, terms);
+
+    // Like terms share the same coefficient-free product.
+    Number constant;
+    std::vector<std::pair<ExprNodePtr, Term>> merged;
+    std::unordered_map<ExprNodePtr, size_t> index;
+    for (Term& term : terms) {
+        if (term.factors.empty()) {
+            constant = constant + term.coef;
+            continue;
+        }
+        ExprNodePtr key = buildProduct(Number(1), term.factors);
+        auto found = index.find(key);
+        if (found != index.end()) {
+            merged[found->second].second.coef = merged[found->second].second.coef + term.coef;
+        } else {
+            index.emplace(key, merged.size());
+            merged.emplace_back(key, std::move(term));
+        }
+    }
+    std::stable_sort(merged.begin(), merged.end(), [](const auto& a, const auto& b) {
+        return a.first->hash < b.first->hash;
+    });
+
+    ExprNodePtr result = nullptr;
+    for (const auto& entry : merged) {
+        const Term& term = entry.second;
+        if (term.coef.isZero()) {
+            continue;
+        }
+        bool positive = !term.coef.isNegative();
+        if (!result) {
+            result = buildProduct(term.coef, term.factors);
+        } else {
+            Number magnitude = term.coef.abs();
+            result = buildOperator(positive ? OperatorType::ADD : OperatorType::SUB, result,
+                buildProduct(magnitude, term.factors));
+        }
+    }
+    if (!constant.isZero()) {
+        if (!result) {
+            result = buildNumber(constant);
+        } else if (!constant.isNegative()) {
+            result = buildOperator(OperatorType::ADD, result, buildNumber(constant));
+        } else {
+            result = buildOperator(OperatorType::SUB, result, buildNumber(-constant));
+        }
+    }
+    return result ? result : buildNumber(0);
+}
+
+ExprNodePtr Canonicalizer::canonicalProduct(ExprNodePtr node) {
+    Number coef(1);
+    std::vector<Factor> factors;
+    collectProduct(node, false, false, coef, factors);
+    if (coef.isZero()) {
+        return buildNumber(0);
+    }
+    mergeFactors(factors);
+    return buildProduct(coef, factors);
+}
+
+ExprNodePtr Canonicalizer::canonicalPow(ExprNodePtr base, ExprNodePtr exponent) {
+    Number e;
+    Number b;
+    bool numericBase = getCoefficient(base, b);
+    if (getCoefficient(exponent, e)) {
+        if (e.isZero()) { // x^0 = 1
+            return buildNumber(1);
+        }
+        if (e.isOne()) { // x^1 = x
+            return base;
+        }
+        if (e.isInteger()) {
+            Number result;
+            if (numericBase && Number::pow(b, e, result)) { // exact power of a constant
+                return buildNumber(result);
+            }
+            Number inner;
+            if (isOperator(base, OperatorType::POW, OperatorType::POW) && getCoefficient(base->right, inner)) {
+                // (x^a)^n = x^(a*n) for integral n
+                return canonicalPow(base->left, buildNumber(inner * e));
+            }
+        }
+    }
+    if (numericBase && b.isOne()) { // 1^x = 1
+        return buildNumber(1);
+    }
+    return buildOperator(OperatorType::POW, base, exponent);
+}
+
+ExprNodePtr Canonicalizer::canonicalFunction(ExprNodePtr node) {
+    ExprNodePtr left = canonicalNode(node->left);
+    ExprNodePtr right = canonicalNode(node->right);
+    if (node->funcType == FunctionType::POW_FUNC) {
+        return canonicalPow(left, right);
+    }
+    Number arg;
+    if (getCoefficient(left, arg)) {
+        switch (node->funcType) {
+            case FunctionType::LN: // ln(1) = 0
+                if (arg.isOne()) {
+                    return buildNumber(0);
+                }
+                break;
+            case FunctionType::EXP: // exp(0) = 1
+            case FunctionType::COS: // cos(0) = 1
+                if (arg.isZero()) {
+                    return buildNumber(1);
+                }
+                break;
+            case FunctionType::SIN: // sin(0) = 0
+            case FunctionType::TAN: // tan(0) = 0
+                if (arg.isZero()) {
+                    return buildNumber(0);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    if (node->funcType == FunctionType::LN && left->type == NodeType::FUNCTION
+        && left->funcType == FunctionType::EXP) { // ln(exp(u)) = u
+        return left->left;
+    }
+    if (left == node->left && right == node->right) {
+        return node;
+    }
+    return right ? buildFunction(node->funcType, left, right) : buildFunction(node->funcType, left);
+}
+
+// Flattens a +/- chain into terms, left to right. Leaves are canonicalized
+// first unless they already are, and leaves that canonicalize into sums are
+// flattened as well.
+void Canonicalizer::collectSum(ExprNodePtr node, bool negate, bool canonical, std::vector<Term>& terms) {
+    struct Pending {
+        ExprNodePtr node;
+        bool negate;
+        bool canonical;
+    };
+    std::vector<Pending> stack{ { node, negate, canonical } };
+    while (!stack.empty()) {
+        Pending top = stack.back();
+        stack.pop_back();
+        if (isOperator(top.node, OperatorType::ADD, OperatorType::SUB)) {
+            bool flip = top.node->opType == OperatorType::SUB;
+            stack.push_back({ top.node->right, flip ? !top.negate : top.negate, top.canonical });
+            stack.push_back({ top.node->left, top.negate, top.canonical });
+            continue;
+        }
+        ExprNodePtr leaf = top.canonical ? top.node : canonicalNode(top.node);
+        if (!top.canonical && isOperator(leaf, OperatorType::ADD, OperatorType::SUB)) {
+            stack.push_back({ leaf, top.negate, true });
+            continue;
+        }
+        Term term;
+        term.coef = Number(top.negate ? -1 : 1);
+        collectProduct(leaf, false, true, term.coef, term.factors);
+        mergeFactors(term.factors);
+        terms.push_back(std::move(term));
+    }
+}
+
+// Flattens a * and / chain into a coefficient and (base, exponent) factors,
+// left to right.
+void Canonicalizer::collectProduct(ExprNodePtr node, bool invert, bool canonical, Number& coef,
+                                   std::vector<Factor>& factors) {
+    struct Pending {
+        ExprNodePtr node;
+        bool invert;
+        bool canonical;
+    };
+    std::vector<Pending> stack{ { node, invert, canonical } };
+    while (!stack.empty()) {
+        Pending top = stack.back();
+        stack.pop_back();
+        if (isOperator(top.node, OperatorType::MUL, OperatorType::DIV)) {
+            bool flip = top.node->opType == OperatorType::DIV;
+            stack.push_back({ top.node->right, flip ? !top.invert : top.invert, top.canonical });
+            stack.push_back({ top.node->left, top.invert, top.canonical });
+            continue;
+        }
+        ExprNodePtr leaf = top.canonical ? top.node : canonicalNode(top.node);
+        if (!top.canonical && isOperator(leaf, OperatorType::MUL, OperatorType::DIV)) {
+            stack.push_back({ leaf, top.invert, true });
+            continue;
+        }
+        Number value;
+        if (getCoefficient(leaf, value) && !(top.invert && value.isZero())) {
+            coef = top.invert ? coef / value : coef * value;
+            continue;
+        }
+        Factor factor;
+        if (isOperator(leaf, OperatorType::POW, OperatorType::POW)) {
+            factor.base = leaf->left;
+            factor.numeric = getCoefficient(leaf->right, factor.power);
+            factor.symbolic = factor.numeric ? nullptr : leaf->right;
+        } else {
+            factor.base = leaf;
+            factor.numeric = true;
+            factor.power = Number(1);
+            factor.symbolic = nullptr;
+        }
+        if (top.invert) {
+            if (factor.numeric) {
+                factor.power = -factor.power;
+            } else {
+                factor.symbolic = canonicalNode(buildOperator(OperatorType::MUL, buildNumber(-1), factor.symbolic));
+            }
+        }
+        factors.push_back(factor);
+    }
+}
+
+// Adds up the exponents of equal bases, drops x^0 and sorts by structural hash.
+void Canonicalizer::mergeFactors(std::vector<Factor>& factors) {
+    std::vector<Factor> merged;
+    std::unordered_map<ExprNodePtr, size_t> index;
+    for (const Factor& factor : factors) {
+        auto found = index.find(factor.base);
+        if (found == index.end()) {
+            index.emplace(factor.base, merged.size());
+            merged.push_back(factor);
+            continue;
+        }
+        Factor& target = merged[found->second];
+        if (target.numeric && factor.numeric) {
+            target.power = target.power + factor.power;
+        } else {
+            ExprNodePtr sum = canonicalNode(buildOperator(OperatorType::ADD, exponentNode(target), exponentNode(factor)));
+            target.numeric = getCoefficient(sum, target.power);
+            target.symbolic = target.numeric ? nullptr : sum;
+        }
+    }
+    merged.erase(std::remove_if(merged.begin(), merged.end(), [](const Factor& f) {
+        return f.numeric && f.power.isZero();
+    }), merged.end());
+    std::stable_sort(merged.begin(), merged.end(), [](const Factor& a, const Factor& b) {
+        return a.base->hash < b.base->hash;
+    });
+    factors.swap(merged);
+}
+
+// coef * numerator factors / denominator factors, where a factor lands in the
+// denominator when its exponent is a negative constant.
+ExprNodePtr Canonicalizer::buildProduct(const Number& coef, const std::vector<Factor>& factors) {
+    std::vector<ExprNodePtr> numerator;
+    std::vector<ExprNodePtr> denominator;
+    for (const Factor& factor : factors) {
+        if (!factor.numeric) {
+            numerator.push_back(buildOperator(OperatorType::POW, factor.base, factor.symbolic));
+            continue;
+        }
+        bool negative = factor.power.isNegative();
+        Number magnitude = factor.power.abs();
+        ExprNodePtr piece = magnitude.isOne() ? factor.base
+            : buildOperator(OperatorType::POW, factor.base, buildNumber(magnitude));
+        (negative ? denominator : numerator).push_back(piece);
+    }
+    // An exact fraction is split so that 3*x/4 reads as a product over 4.
+    Number leading = coef.isExact() ? coef.numerator() : coef;
+    if (!leading.isOne() || numerator.empty()) {
+        numerator.insert(numerator.begin(), buildNumber(leading));
+    }
+    if (coef.isExact() && !coef.isInteger()) {
+        denominator.insert(denominator.begin(), buildNumber(coef.denominator()));
+    }
+
+    ExprNodePtr result = numerator[0];
+    for (size_t i = 1; i < numerator.size(); ++i) {
+        result = buildOperator(OperatorType::MUL, result, numerator[i]);
+    }
+    if (denominator.empty()) {
+        return result;
+    }
+    ExprNodePtr divisor = denominator[0];
+    for (size_t i = 1; i < denominator.size(); ++i) {
+        divisor = buildOperator(OperatorType::MUL, divisor, denominator[i]);
+    }
+    return buildOperator(OperatorType::DIV, result, divisor);
+}
+
+ExprNodePtr Canonicalizer::exponentNode(const Factor& factor) const {
+    return factor.numeric ? buildNumber(factor.power) : factor.symbolic;
+}
+
+// Numbers and quotients of two numbers count as constants.
+bool Canonicalizer::getCoefficient(ExprNodePtr node, Number& value) {
+    if (node->type == NodeType::NUMBER) {
+        value = node->number;
+        return true;
+    }
+    if (node->type == NodeType::OPERATOR && node->opType == OperatorType::DIV
+        && node->left->type == NodeType::NUMBER && node->right->type == NodeType::NUMBER) {
+        if (node->right->number.isZero()) {
+            return false;
+        }
+        value = node->left->number / node->right->number;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,276 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "checkpoint.hpp"
+
+using namespace autodiff;
+
+namespace {
+    const size_t initialState = static_cast<size_t>(-1); // the registers as the inputs leave them
+
+    // C(s + t, s): chunks that s snapshots reverse with each chunk recomputed
+    // at most t times. Saturates instead of overflowing.
+    size_t binomialReach(size_t s, size_t t) {
+        const size_t cap = std::numeric_limits<size_t>::max() / 2;
+        double reach = 1.0;
+        for (size_t k = 1; k <= s; ++k) {
+            reach = reach * static_cast<double>(t + k) / static_cast<double>(k);
+            if (reach >= static_cast<double>(cap)) {
+                return cap;
+            }
+        }
+        return static_cast<size_t>(reach + 0.5);
+    }
+
+    // The least t with binomialReach(s, t) >= n.
+    size_t repetitions(size_t s, size_t n) {
+        if (n <= 1) {
+            return 0;
+        }
+        if (s == 0) {
+            return n - 1;
+        }
+        size_t t = 1;
+        while (binomialReach(s, t) < n) {
+            ++t;
+        }
+        return t;
+    }
+
+    inline double apply(OpCode op, double a, double b) {
+        switch (op) {
+            case OpCode::ADD: return a + b;
+            case OpCode::SUB: return a - b;
+            case OpCode::MUL: return a * b;
+            case OpCode::DIV: return a / b;
+            case OpCode::POW: return std::pow(a, b);
+            case OpCode::LN: return std::log(a);
+            case OpCode::LOG: return std::log(b) / std::log(a);
+            case OpCode::COS: return std::cos(a);
+            case OpCode::SIN: return std::sin(a);
+            case OpCode::TAN: return std::tan(a);
+            case OpCode::EXP: return std::exp(a);
+        }
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+}
+
+CheckpointedReverse::CheckpointedReverse(const Tape& tape, size_t memoryBudget) : tape(tape) {
+    const std::vector<Instruction>& instructions = tape.getInstructions();
+    size_t numRegisters = tape.numRegisters();
+    firstTemporary = static_cast<std::uint32_t>(numRegisters);
+    for (const Instruction& ins : instructions) {
+        firstTemporary = std::min(firstTemporary, ins.dst);
+    }
+    stats.instructions = instructions.size();
+
+    size_t fixed = 2 * numRegisters * sizeof(double); // registers and adjoints
+    if (memoryBudget < fixed + sizeof(Operands)) {
+        return;
+    }
+    size_t available = memoryBudget - fixed;
+    size_t n = std::max<size_t>(instructions.size(), 1);
+    if (available >= n * sizeof(Operands)) {
+        chunkLength = n; // record everything, no snapshots needed
+    } else {
+        // Split the rest between the recorded chunk and the snapshots,
+        // trying a few ratios and keeping the one with the fewest repetitions.
+        size_t snapshotBytes = std::max<size_t>(numRegisters - firstTemporary, 1) * sizeof(double);
+        size_t bestRepetitions = std::numeric_limits<size_t>::max();
+        for (size_t eighths = 1; eighths < 8; ++eighths) {
+            size_t length = std::max<size_t>(available * eighths / 8 / sizeof(Operands), 1);
+            size_t chunks = (n + length - 1) / length;
+            size_t snapshots = (available - length * sizeof(Operands)) / snapshotBytes;
+            size_t t = repetitions(std::min(snapshots, chunks - 1), chunks);
+            if (t < bestRepetitions || (t == bestRepetitions && length > chunkLength)) {
+                bestRepetitions = t;
+                chunkLength = length;
+                maxSnapshots = std::min(snapshots, chunks - 1);
+            }
+        }
+    }
+    numChunks = (instructions.size() + chunkLength - 1) / chunkLength;
+    stats.chunkLength = chunkLength;
+    stats.chunks = numChunks;
+    stats.snapshots = maxSnapshots;
+}
+
+bool CheckpointedReverse::gradient(const double* inputs, double& result, double* gradient) {
+    if (!feasible()) {
+        return false;
+    }
+    size_t numInputs = tape.numInputs();
+    registers = tape.getRegisters();
+    std::memcpy(registers.data(), inputs, numInputs * sizeof(double));
+    adjoints.assign(registers.size(), 0.0);
+    snapshots.resize(maxSnapshots);
+    recorded.reserve(std::min(chunkLength, stats.instructions)); // the last chunk is recorded first and may be shorter
+    liveSnapshots = 0;
+    stats.snapshotsUsed = 0;
+    stats.forwardSteps = 0;
+    value = std::numeric_limits<double>::quiet_NaN();
+
+    std::uint32_t output = tape.getOutputs().empty() ? 0 : tape.getOutputs()[0];
+    if (numChunks == 0) { // the output is an input or a constant
+        value = registers[output];
+    } else {
+        adjoints[output] = 1.0;
+        treeverse(0, numChunks, initialState, maxSnapshots);
+    }
+    result = value;
+    for (size_t i = 0; i < numInputs; ++i) {
+        gradient[i] = adjoints[i];
+    }
+    if (numChunks == 0 && output < numInputs) {
+        gradient[output] = 1.0;
+    }
+
+    size_t snapshotBytes = (registers.size() - std::min<size_t>(firstTemporary, registers.size())) * sizeof(double);
+    stats.peakBytes = (registers.capacity() + adjoints.capacity()) * sizeof(double)
+        + recorded.capacity() * sizeof(Operands) + stats.snapshotsUsed * snapshotBytes;
+    stats.recomputeFactor = stats.instructions
+        ? static_cast<double>(stats.forwardSteps) / static_cast<double>(stats.instructions) : 1.0;
+    std::vector<Operands>().swap(recorded);
+    std::vector<std::vector<double>>().swap(snapshots);
+    return true;
+}
+
+// Reverses chunks [first, last). The registers at the start of first can be
+// restored from origin, and free snapshot slots above the ones in use remain.
+void CheckpointedReverse::treeverse(size_t first, size_t last, size_t origin, size_t free) {
+    while (last - first > 1 && free > 0) {
+        // The right part gets one snapshot less and as many repetitions, the
+        // left part keeps them all with one repetition less. Only the right
+        // part recurses, so the depth is bounded by the snapshot count.
+        size_t n = last - first;
+        size_t t = repetitions(free, n);
+        size_t middle = last - std::min(binomialReach(free - 1, t), n - 1);
+        restore(origin);
+        advance(first, middle);
+        size_t slot = liveSnapshots++;
+        stats.snapshotsUsed = std::max(stats.snapshotsUsed, liveSnapshots);
+        save(slot);
+        treeverse(middle, last, slot, free - 1);
+        --liveSnapshots;
+        last = middle;
+    }
+    // One chunk, or no snapshot to spare: start over from origin for each.
+    for (size_t chunk = last; chunk-- > first;) {
+        restore(origin);
+        advance(first, chunk);
+        record(chunk);
+        reverseChunk(chunk);
+    }
+}
+
+void CheckpointedReverse::advance(size_t fromChunk, size_t toChunk) {
+    const std::vector<Instruction>& instructions = tape.getInstructions();
+    size_t end = std::min(toChunk * chunkLength, instructions.size());
+    double* r = registers.data();
+    for (size_t k = fromChunk * chunkLength; k < end; ++k) {
+        const Instruction& ins = instructions[k];
+        r[ins.dst] = apply(ins.op, r[ins.a], r[ins.b]);
+    }
+    stats.forwardSteps += end - std::min(end, fromChunk * chunkLength);
+}
+
+void CheckpointedReverse::record(size_t chunk) {
+    const std::vector<Instruction>& instructions = tape.getInstructions();
+    size_t begin = chunk * chunkLength;
+    size_t end = std::min(begin + chunkLength, instructions.size());
+    recorded.resize(end - begin);
+    double* r = registers.data();
+    for (size_t k = begin; k < end; ++k) {
+        const Instruction& ins = instructions[k];
+        recorded[k - begin] = { r[ins.a], r[ins.b] };
+        r[ins.dst] = apply(ins.op, r[ins.a], r[ins.b]);
+    }
+    stats.forwardSteps += end - begin;
+    if (end == instructions.size()) {
+        value = r[tape.getOutputs()[0]];
+    }
+}
+
+void CheckpointedReverse::reverseChunk(size_t chunk) {
+    const std::vector<Instruction>& instructions = tape.getInstructions();
+    size_t begin = chunk * chunkLength;
+    size_t end = std::min(begin + chunkLength, instructions.size());
+    size_t numInputs = tape.numInputs();
+    double* adj = adjoints.data();
+    for (size_t k = end; k-- > begin;) {
+        const Instruction& ins = instructions[k];
+        double g = adj[ins.dst];
+        adj[ins.dst] = 0.0; // the register held another value before this instruction
+        if (g == 0.0) {
+            continue;
+        }
+        double a = recorded[k - begin].a;
+        double b = recorded[k - begin].b;
+        // Constant registers collect no adjoint, which also keeps ln(a) of a
+        // constant exponent's base out of the way when a <= 0.
+        bool wantB = ins.b < numInputs || ins.b >= firstTemporary;
+        switch (ins.op) {
+            case OpCode::ADD:
+                adj[ins.a] += g;
+                adj[ins.b] += g;
+                break;
+            case OpCode::SUB:
+                adj[ins.a] += g;
+                adj[ins.b] -= g;
+                break;
+            case OpCode::MUL:
+                adj[ins.a] += g * b;
+                adj[ins.b] += g * a;
+                break;
+            case OpCode::DIV:
+                adj[ins.a] += g / b;
+                adj[ins.b] -= g * a / (b * b);
+                break;
+            case OpCode::POW:
+                adj[ins.a] += g * b * std::pow(a, b - 1.0);
+                if (wantB) {
+                    adj[ins.b] += g * std::pow(a, b) * std::log(a);
+                }
+                break;
+            case OpCode::LN:
+                adj[ins.a] += g / a;
+                break;
+            case OpCode::LOG: { // log(a, b) = ln(b)/ln(a)
+                double lnA = std::log(a);
+                adj[ins.a] -= g * std::log(b) / (a * lnA * lnA);
+                if (wantB) {
+                    adj[ins.b] += g / (b * lnA);
+                }
+                break;
+            }
+            case OpCode::COS:
+                adj[ins.a] -= g * std::sin(a);
+                break;
+            case OpCode::SIN:
+                adj[ins.a] += g * std::cos(a);
+                break;
+            case OpCode::TAN: {
+                double c = std::cos(a);
+                adj[ins.a] += g / (c * c);
+                break;
+            }
+            case OpCode::EXP:
+                adj[ins.a] += g * std::exp(a);
+                break;
+        }
+    }
+}
+
+void CheckpointedReverse::save(size_t slot) {
+    snapshots[slot].assign(registers.begin() + firstTemporary, registers.end());
+}
+
+void CheckpointedReverse::restore(size_t origin) {
+    // Temporaries are always written before they are read, so the initial
+    // state needs nothing back.
+    if (origin != initialState) {
+        std::copy(snapshots[origin].begin(), snapshots[origin].end(), registers.begin() + firstTemporary);
+    }
+}
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "code_generator.hpp"
+
+using namespace autodiff;
+
+namespace {
+    const size_t none = static_cast<size_t>(-1);
+
+    // A double literal that reads back exactly, never an integer literal, so
+    // that constant operands cannot turn into integer arithmetic.
+    void appendLiteral(double value, std::string& out) {
+        if (std::isnan(value)) {
+            out += "NAN";
+            return;
+        }
+        if (std::isinf(value)) {
+            out += value > 0 ? "INFINITY" : "(-INFINITY)";
+            return;
+        }
+        char buffer[40];
+        std::snprintf(buffer, sizeof(buffer), "%.17g", value);
+        bool negative = buffer[0] == '-';
+        if (negative) {
+            out += '(';
+        }
+        out += buffer;
+        if (!std::strpbrk(buffer, ".e")) {
+            out += ".0";
+        }
+        if (negative) {
+            out += ')';
+        }
+    }
+}
+
+std::string CodeGenerator::generate(const Tape& tape, const std::vector<SymbolId>& vars,
+                                    const CodeOptions& options) const {
+    std::string out = "/* Generated by AutoDiff.";
+    for (size_t k = 0; k < vars.size() && k < tape.numInputs(); ++k) {
+        out += k == 0 ? " in: " : ", ";
+        out += symbolName(vars[k]);
+    }
+    out += ". */\n"
+           "#include <math.h>\n"
+           "#include <stddef.h>\n"
+           "#include <stdlib.h>\n"
+           "\n"
+           "#ifdef __cplusplus\n"
+           "#define AD_RESTRICT __restrict\n"
+           "extern \"C\" {\n"
+           "#else\n"
+           "#define AD_RESTRICT restrict\n"
+           "#endif\n\n";
+
+    out += "void " + options.name + "(const double* in, double* out) {\n";
+    appendScalar(tape, out);
+    out += "}\n";
+    if (options.batched) {
+        out += "\nvoid " + options.name + "_batch(const double* const* in, double* const* out, size_t n) {\n";
+        appendBatched(tape, out);
+        out += "}\n";
+    }
+    out += "\n#ifdef __cplusplus\n}\n#endif\n";
+    return out;
+}
+
+// One const temporary per instruction. The tape reuses a register once its
+// value is dead; here a register stands for whichever temporary last wrote it.
+void CodeGenerator::appendScalar(const Tape& tape, std::string& out) const {
+    std::vector<size_t> writer(tape.numRegisters(), none); // register -> temporary holding it
+    auto operand = [&](std::uint32_t reg) {
+        if (reg < tape.numInputs()) {
+            out += "in[" + std::to_string(reg) + "]";
+        } else if (writer[reg] != none) {
+            out += "t" + std::to_string(writer[reg]);
+        } else {
+            appendLiteral(tape.getRegisters()[reg], out);
+        }
+    };
+    const std::vector<Instruction>& instructions = tape.getInstructions();
+    for (size_t index = 0; index < instructions.size(); ++index) {
+        out += "    const double t" + std::to_string(index) + " = ";
+        appendInstruction(instructions[index], operand, out);
+        out += ";\n";
+        writer[instructions[index].dst] = index;
+    }
+    const std::vector<std::uint32_t>& outputs = tape.getOutputs();
+    for (size_t k = 0; k < outputs.size(); ++k) {
+        out += "    out[" + std::to_string(k) + "] = ";
+        operand(outputs[k]);
+        out += ";\n";
+    }
+}
+
+// Points are processed in blocks, one loop per instruction over the block.
+// Each loop holds a single operation, so it vectorizes on its own; one loop
+// over all instructions would not, since gcc fuses sin(u) and cos(u) into a
+// sincos call that has no vector form. Temporaries are rows of a scratch
+// block, one per tape register, which the tape already keeps few.
+void CodeGenerator::appendBatched(const Tape& tape, std::string& out) const {
+    std::vector<size_t> row(tape.numRegisters(), none); // register -> scratch row
+    size_t rows = 0;
+    for (const Instruction& ins : tape.getInstructions()) {
+        if (row[ins.dst] == none) {
+            row[ins.dst] = rows++;
+        }
+    }
+    const size_t block = 64;
+    out += "    const size_t block = " + std::to_string(block) + ";\n";
+    out += "    double* scratch = (double*)malloc(" + std::to_string(std::max<size_t>(rows, 1))
+        + " * block * sizeof(double));\n";
+    out += "    if (!scratch) {\n        return;\n    }\n";
+    for (size_t r = 0; r < rows; ++r) {
+        out += "    double* AD_RESTRICT r" + std::to_string(r) + " = scratch + " + std::to_string(r) + " * block;\n";
+    }
+    out += "    for (size_t start = 0; start < n; start += block) {\n";
+    out += "        const size_t m = n - start < block ? n - start : block;\n";
+    for (size_t k = 0; k < tape.numInputs(); ++k) {
+        out += "        const double* AD_RESTRICT in" + std::to_string(k) + " = in[" + std::to_string(k)
+            + "] + start;\n";
+    }
+    for (size_t k = 0; k < tape.numOutputs(); ++k) {
+        out += "        double* AD_RESTRICT out" + std::to_string(k) + " = out[" + std::to_string(k)
+            + "] + start;\n";
+    }
+    auto operand = [&](std::uint32_t reg) {
+        if (reg < tape.numInputs()) {
+            out += "in" + std::to_string(reg) + "[i]";
+        } else if (row[reg] != none) {
+            out += "r" + std::to_string(row[reg]) + "[i]";
+        } else {
+            appendLiteral(tape.getRegisters()[reg], out);
+        }
+    };
+    const char* loop = "        for (size_t i = 0; i < m; ++i) ";
+    for (const Instruction& ins : tape.getInstructions()) {
+        out += loop;
+        out += "r" + std::to_string(row[ins.dst]) + "[i] = ";
+        appendInstruction(ins, operand, out);
+        out += ";\n";
+    }
+    const std::vector<std::uint32_t>& outputs = tape.getOutputs();
+    for (size_t k = 0; k < outputs.size(); ++k) {
+        out += loop;
+        out += "out" + std::to_string(k) + "[i] = ";
+        operand(outputs[k]);
+        out += ";\n";
+    }
+    out += "    }\n    free(scratch);\n";
+}
+
+void CodeGenerator::appendInstruction(const Instruction& ins, const std::function<void(std::uint32_t)>& operand,
+                                      std::string& out) const {
+    auto call = [&](const char* function, std::uint32_t reg) {
+        out += function;
+        out += '(';
+        operand(reg);
+        out += ')';
+    };
+    auto binary = [&](const char* op) {
+        operand(ins.a);
+        out += op;
+        operand(ins.b);
+    };
+    switch (ins.op) {
+        case OpCode::ADD: binary(" + "); break;
+        case OpCode::SUB: binary(" - "); break;
+        case OpCode::MUL: binary(" * "); break;
+        case OpCode::DIV: binary(" / "); break;
+        case OpCode::POW:
+            out += "pow(";
+            binary(", ");
+            out += ')';
+            break;
+        case OpCode::LN: call("log", ins.a); break;
+        case OpCode::LOG: // log(a, b): logarithm of b to base a
+            call("log", ins.b);
+            out += " / ";
+            call("log", ins.a);
+            break;
+        case OpCode::COS: call("cos", ins.a); break;
+        case OpCode::SIN: call("sin", ins.a); break;
+        case OpCode::TAN: call("tan", ins.a); break;
+        case OpCode::EXP: call("exp", ins.a); break;
+    }
+}
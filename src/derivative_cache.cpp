@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <utility>
+
+#include "derivative_cache.hpp"
+
+using namespace autodiff;
+
+DerivativeCache::DerivativeCache(size_t maxNodes) : shardBudget(std::max<size_t>(1, maxNodes / numShards)) {}
+
+size_t DerivativeCache::keyOf(ExprNodePtr expr, SymbolId var) {
+    std::uint64_t h = expr->hash ^ (static_cast<std::uint64_t>(var) * 0x9e3779b97f4a7c15ULL);
+    h ^= h >> 29;
+    return static_cast<size_t>(h);
+}
+
+ExprNodePtr DerivativeCache::find(ExprNodePtr expr, SymbolId var) {
+    size_t key = keyOf(expr, var);
+    Shard& shard = shards[key % numShards];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto entry = lookup(shard, key, expr, var);
+    if (entry == shard.lru.end()) {
+        ++shard.stats.misses;
+        return nullptr;
+    }
+    ++shard.stats.hits;
+    shard.lru.splice(shard.lru.begin(), shard.lru, entry);
+    return rebuild(entry->derivative);
+}
+
+void DerivativeCache::insert(ExprNodePtr expr, SymbolId var, ExprNodePtr derivative) {
+    // Flattened before locking; only a duplicate insert wastes the work.
+    Entry entry{ keyOf(expr, var), var, flatten(expr), flatten(derivative) };
+    size_t nodes = entry.expr.size() + entry.derivative.size();
+    if (nodes > shardBudget) {
+        return;
+    }
+    Shard& shard = shards[entry.key % numShards];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (lookup(shard, entry.key, expr, var) != shard.lru.end()) {
+        return; // another thread got there first
+    }
+    shard.lru.push_front(std::move(entry));
+    shard.index.emplace(shard.lru.front().key, shard.lru.begin());
+    shard.nodes += nodes;
+    ++shard.stats.insertions;
+    while (shard.nodes > shardBudget) {
+        const Entry& victim = shard.lru.back();
+        auto range = shard.index.equal_range(victim.key);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (&*it->second == &victim) {
+                shard.index.erase(it);
+                break;
+            }
+        }
+        shard.nodes -= victim.expr.size() + victim.derivative.size();
+        shard.lru.pop_back();
+        ++shard.stats.evictions;
+    }
+}
+
+std::list<DerivativeCache::Entry>::iterator DerivativeCache::lookup(Shard& shard, size_t key, ExprNodePtr expr,
+                                                                    SymbolId var) {
+    auto range = shard.index.equal_range(key);
+    for (auto it = range.first; it != range.second; ++it) {
+        const Entry& entry = *it->second;
+        if (entry.var == var && matches(expr, entry.expr)) {
+            return it->second;
+        }
+    }
+    return shard.lru.end();
+}
+
+DerivativeCache::FlatExpr DerivativeCache::flatten(ExprNodePtr root) {
+    FlatExpr flat;
+    std::unordered_map<ExprNodePtr, std::uint32_t> positions;
+    auto positionOf = [&positions](ExprNodePtr node) { return node ? positions.at(node) : none; };
+    std::vector<std::pair<ExprNodePtr, bool>> stack; // (node, children already pushed)
+    stack.emplace_back(root, false);
+    while (!stack.empty()) {
+        auto [node, expanded] = stack.back();
+        if (positions.count(node)) {
+            stack.pop_back();
+            continue;
+        }
+        if (!expanded && (node->left || node->right)) {
+            stack.back().second = true;
+            if (node->right) {
+                stack.emplace_back(node->right, false);
+            }
+            if (node->left) {
+                stack.emplace_back(node->left, false);
+            }
+            continue;
+        }
+        stack.pop_back();
+        positions.emplace(node, static_cast<std::uint32_t>(flat.size()));
+        flat.push_back({ node->type, node->opType, node->funcType,
+                         node->type == NodeType::VARIABLE ? node->symbol : 0,
+                         node->type == NodeType::NUMBER ? node->number : Number(), node->hash,
+                         positionOf(node->left), positionOf(node->right) });
+    }
+    return flat;
+}
+
+// Children come first, so one forward pass rebuilds the DAG.
+ExprNodePtr DerivativeCache::rebuild(const FlatExpr& flat) {
+    static thread_local std::vector<ExprNodePtr> built;
+    built.resize(flat.size());
+    auto at = [](std::uint32_t position) { return position == none ? nullptr : built[position]; };
+    for (size_t i = 0; i < flat.size(); ++i) {
+        const FlatNode& node = flat[i];
+        switch (node.type) {
+            case NodeType::NUMBER:
+                built[i] = buildNumber(node.number);
+                break;
+            case NodeType::VARIABLE:
+                built[i] = buildVariable(node.symbol);
+                break;
+            case NodeType::OPERATOR:
+                built[i] = buildOperator(node.opType, at(node.left), at(node.right));
+                break;
+            case NodeType::FUNCTION:
+                built[i] = node.right == none
+                    ? buildFunction(node.funcType, at(node.left))
+                    : buildFunction(node.funcType, at(node.left), at(node.right));
+                break;
+        }
+    }
+    return built.back();
+}
+
+// Pairs root with the last position and walks both DAGs together. The query
+// is hash-consed, so a position shared in flat must meet the same node again.
+bool DerivativeCache::matches(ExprNodePtr root, const FlatExpr& flat) {
+    static thread_local std::vector<ExprNodePtr> paired;
+    static thread_local std::vector<std::pair<ExprNodePtr, std::uint32_t>> stack;
+    paired.assign(flat.size(), nullptr);
+    stack.clear();
+    stack.emplace_back(root, static_cast<std::uint32_t>(flat.size() - 1));
+    while (!stack.empty()) {
+        auto [node, position] = stack.back();
+        stack.pop_back();
+        if (!node || position == none) {
+            if (node || position != none) {
+                return false;
+            }
+            continue;
+        }
+        if (paired[position]) {
+            if (paired[position] != node) {
+                return false;
+            }
+            continue;
+        }
+        const FlatNode& other = flat[position];
+        if (node->hash != other.hash || node->type != other.type || node->opType != other.opType
+            || node->funcType != other.funcType) {
+            return false;
+        }
+        if ((node->type == NodeType::VARIABLE && node->symbol != other.symbol)
+            || (node->type == NodeType::NUMBER && node->number != other.number)) {
+            return false;
+        }
+        paired[position] = node;
+        stack.emplace_back(node->left, other.left);
+        stack.emplace_back(node->right, other.right);
+    }
+    return true;
+}
+
+DerivativeCacheStats DerivativeCache::getStats() const {
+    DerivativeCacheStats total;
+    for (const Shard& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total.hits += shard.stats.hits;
+        total.misses += shard.stats.misses;
+        total.insertions += shard.stats.insertions;
+        total.evictions += shard.stats.evictions;
+        total.entries += shard.lru.size();
+        total.nodes += shard.nodes;
+    }
+    return total;
+}
+
+void DerivativeCache::clear() {
+    for (Shard& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.lru.clear();
+        shard.index.clear();
+        shard.nodes = 0;
+        shard.stats = DerivativeCacheStats();
+    }
+}
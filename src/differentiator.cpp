@@ -2,24 +2,124 @@
 #include <memory>
 #include <string>
 #include <vector>
+#include <utility>
 #include <cmath>
 
 #include "differentiator.hpp"
+#include "pipeline_stats.hpp"
 
 using namespace autodiff;
 
-ExprNodePtr Differentiator::differentiate(const ExprNodePtr& expr, const std::string& var) {
+ExprNodePtr Differentiator::differentiate(ExprNodePtr expr, SymbolId var) {
+    StageTimer timer(Stage::DIFFERENTIATE, expr);
+    resetTable(scratch);
+    memo = &scratch;
+    zero = buildNumber(0);
+    return timer.finish(diffNode(expr, var));
+}
+
+ExprNodePtr Differentiator::differentiateCached(ExprNodePtr expr, SymbolId var) {
+    StageTimer timer(Stage::DIFFERENTIATE, expr);
+    memo = &cache[var];
+    zero = buildNumber(0);
+    ExprNodePtr result = diffNode(expr, var);
+    memo = &scratch;
+    return timer.finish(result);
+}
+
+void Differentiator::clearCache() {
+    cache.clear();
+}
+
+void Differentiator::setDerivativeCache(DerivativeCache* cache) {
+    derivativeCache = cache;
+}
+
+// Small enough that comparing and copying an entry is cheaper than the
+// differentiation it saves, and large enough to save anything at all.
+bool Differentiator::cacheable(ExprNodePtr expr) const {
+    const size_t minNodes = 4;
+    const size_t maxNodes = 64;
+    if (!derivativeCache || expr->type != NodeType::FUNCTION) {
+        return false;
+    }
+    size_t count = 0; // as a tree, so shared nodes count every time
+    std::vector<ExprNodePtr> stack = { expr };
+    while (!stack.empty()) {
+        ExprNodePtr node = stack.back();
+        stack.pop_back();
+        if (++count > maxNodes) {
+            return false;
+        }
+        if (node->left) {
+            stack.push_back(node->left);
+        }
+        if (node->right) {
+            stack.push_back(node->right);
+        }
+    }
+    return count >= minNodes;
+}
+
+ExprNodePtr Differentiator::diffNode(ExprNodePtr expr, SymbolId var) {
     if (!expr) {
         return nullptr;
     }
+    if (!mayDependOn(expr, var)) { // constant in var, nothing to walk
+        return zero;
+    }
+    // Shared subexpressions of the DAG are differentiated once per call.
+    auto cached = memo->find(expr);
+    if (cached != memo->end()) {
+        return cached->second;
+    }
+    // Differentiate children first in an explicit post-order walk, so the
+    // rules below only find them in the memo and depth never recurses.
+    std::vector<std::pair<ExprNodePtr, bool>> stack; // (node, children already pushed)
+    stack.emplace_back(expr, false);
+    while (!stack.empty()) {
+        auto [node, expanded] = stack.back();
+        if (memo->count(node)) {
+            stack.pop_back();
+            continue;
+        }
+        if (expanded) {
+            stack.pop_back();
+            ExprNodePtr derivative = diffUncached(node, var);
+            if (cacheable(node)) {
+                derivative = simplifier.simplify(derivative);
+                derivativeCache->insert(node, var, derivative);
+            }
+            memo->emplace(node, derivative);
+            continue;
+        }
+        if (cacheable(node)) {
+            if (ExprNodePtr cached = derivativeCache->find(node, var)) {
+                stack.pop_back();
+                memo->emplace(node, cached);
+                continue;
+            }
+        }
+        stack.back().second = true;
+        if (node->right && mayDependOn(node->right, var)) {
+            stack.emplace_back(node->right, false);
+        }
+        if (node->left && mayDependOn(node->left, var)) {
+            stack.emplace_back(node->left, false);
+        }
+    }
+    return memo->at(expr);
+}
+
+ExprNodePtr Differentiator::diffUncached(ExprNodePtr expr, SymbolId var) {
     switch (expr->type) {
         case NodeType::NUMBER:
-            return buildNumber(std::string("0"));
+            return buildNumber(0);
         case NodeType::VARIABLE:
-            if (expr->value == var) {
-                return buildNumber(std::string("1"));
+            if (expr->symbol == var) {
+                return buildNumber(1);
             } else {
-                return buildNumber(std::string("0"));
+                return buildNumber(0);
             }
         case NodeType::OPERATOR:
             return diffOperator(expr, var);
@@ -31,39 +131,50 @@ ExprNodePtr Differentiator::differentiate(const ExprNodePtr& expr, const std::st
     }
 }
 
-ExprNodePtr Differentiator::diffOperator(const ExprNodePtr& expr, const std::string& var) {
+// At least one operand depends on var; the rules only emit the terms whose
+// factor u' or v' does not vanish.
+ExprNodePtr Differentiator::diffOperator(ExprNodePtr expr, SymbolId var) {
     OperatorType opType = expr->opType;
-    ExprNodePtr leftDerivative = expr->left ? differentiate(expr->left, var) : nullptr;
-    ExprNodePtr rightDerivative = expr->right ? differentiate(expr->right, var) : nullptr;
+    ExprNodePtr leftDerivative = expr->left ? diffNode(expr->left, var) : nullptr;
+    ExprNodePtr rightDerivative = expr->right ? diffNode(expr->right, var) : nullptr;
+    bool leftVaries = expr->left && mayDependOn(expr->left, var);
+    bool rightVaries = expr->right && mayDependOn(expr->right, var);
 
     switch (opType) {
         case OperatorType::ADD:
-            return buildOperator(OperatorType::ADD, leftDerivative, rightDerivative); 
+            if (!rightVaries) {
+                return leftDerivative;
+            }
+            if (!leftVaries) {
+                return rightDerivative;
+            }
+            return buildOperator(OperatorType::ADD, leftDerivative, rightDerivative);
         case OperatorType::SUB:
-            return buildOperator(OperatorType::SUB, leftDerivative, rightDerivative); 
-        case OperatorType::MUL: // (u*v)' = u'v + uv'
-            return buildOperator(OperatorType::ADD,
-                buildOperator(OperatorType::MUL, leftDerivative, expr->right),
-                buildOperator(OperatorType::MUL, expr->left, rightDerivative));
-        case OperatorType::DIV: { // (u/v)' = (u'v - uv') / v^2
-            return buildOperator(OperatorType::DIV,
-                buildOperator(OperatorType::SUB,
-                    buildOperator(OperatorType::MUL, leftDerivative, expr->right),
-                    buildOperator(OperatorType::MUL, expr->left, rightDerivative)),
-                buildOperator(OperatorType::POW, expr->right, buildNumber(std::string("2"))));
-        }
-        case OperatorType::POW: { // (u^v)' = (v * u^(v-1) * u') + (ln(u) * u^v * v')
-            ExprNodePtr vMinus1 = buildOperator(OperatorType::SUB, expr->right, buildNumber(std::string("1")));
-            ExprNodePtr uPowVMinus1 = buildOperator(OperatorType::POW, expr->left, vMinus1);
-            ExprNodePtr term1 = buildOperator(OperatorType::MUL,
-                buildOperator(OperatorType::MUL, expr->right, uPowVMinus1),
-                leftDerivative);
-            ExprNodePtr term2 = buildOperator(OperatorType::MUL,
-                buildOperator(OperatorType::MUL, buildFunction(FunctionType::LN, expr->left),
-                    cloneSubtree(expr.get())), // Keep cloneSubtree for expr itself
-                rightDerivative);
+            if (!rightVaries) {
+                return leftDerivative;
+            }
+            return buildOperator(OperatorType::SUB, leftDerivative, rightDerivative);
+        case OperatorType::MUL: { // (u*v)' = u'v + uv'
+            ExprNodePtr term1 = leftVaries ? buildOperator(OperatorType::MUL, leftDerivative, expr->right) : nullptr;
+            ExprNodePtr term2 = rightVaries ? buildOperator(OperatorType::MUL, expr->left, rightDerivative) : nullptr;
+            if (!term1 || !term2) {
+                return term1 ? term1 : term2;
+            }
             return buildOperator(OperatorType::ADD, term1, term2);
         }
+        case OperatorType::DIV: { // (u/v)' = (u'v - uv') / v^2, u'/v for constant v, -uv'/v^2 for constant u
+            if (!rightVaries) {
+                return buildOperator(OperatorType::DIV, leftDerivative, expr->right);
+            }
+            ExprNodePtr product = buildOperator(OperatorType::MUL, expr->left, rightDerivative);
+            ExprNodePtr numerator = leftVaries
+                ? buildOperator(OperatorType::SUB, buildOperator(OperatorType::MUL, leftDerivative, expr->right), product)
+                : buildOperator(OperatorType::MUL, buildNumber(-1), product);
+            return buildOperator(OperatorType::DIV, numerator,
+                buildOperator(OperatorType::POW, expr->right, buildNumber(2)));
+        }
+        case OperatorType::POW: // (u^v)' = (v * u^(v-1) * u') + (ln(u) * u^v * v')
+            return powerRule(expr, leftVaries ? leftDerivative : nullptr, rightVaries ? rightDerivative : nullptr);
         default:
             std::cerr << "Error: Unknown OperatorType in diffOperator" << std::endl;
             return nullptr;
@@ -71,32 +182,39 @@ ExprNodePtr Differentiator::diffOperator(const ExprNodePtr& expr, const std::str
 }
 
 
-ExprNodePtr Differentiator::diffFunction(const ExprNodePtr& expr, const std::string& var) {
+ExprNodePtr Differentiator::diffFunction(ExprNodePtr expr, SymbolId var) {
     FunctionType funcType = expr->funcType;
-    ExprNodePtr leftDerivative = expr->left ? differentiate(expr->left, var) : nullptr;
-    ExprNodePtr rightDerivative = expr->right ? differentiate(expr->right, var) : nullptr;
+    ExprNodePtr leftDerivative = expr->left ? diffNode(expr->left, var) : nullptr;
+    ExprNodePtr rightDerivative = expr->right ? diffNode(expr->right, var) : nullptr;
+    bool leftVaries = expr->left && mayDependOn(expr->left, var);
+    bool rightVaries = expr->right && mayDependOn(expr->right, var);
 
     switch (funcType) {
         case FunctionType::LN: // (ln(u))' = (1/u) * u'
             return buildOperator(OperatorType::MUL,
-                buildOperator(OperatorType::DIV, buildNumber(std::string("1")), expr->left),
+                buildOperator(OperatorType::DIV, buildNumber(1), expr->left),
                 leftDerivative);
         case FunctionType::LOG: { // log_base(value) = ln(value) / ln(base)
             ExprNodePtr lnValue = buildFunction(FunctionType::LN, expr->right);
             ExprNodePtr lnBase = buildFunction(FunctionType::LN, expr->left);
-            
-            ExprNodePtr numerator = buildOperator(OperatorType::SUB,
-                buildOperator(OperatorType::MUL,buildOperator(OperatorType::DIV, rightDerivative, expr->right),
-                    expr->left),
-                buildOperator(OperatorType::MUL, expr->right,
-                    buildOperator(OperatorType::DIV, leftDerivative, expr->left)));
-            
-            ExprNodePtr denominator = buildOperator(OperatorType::POW, lnBase, buildNumber(std::string("2")));
+
+            // (v'/v * ln(u) - ln(v) * u'/u) / ln(u)^2, without the term whose factor vanishes
+            ExprNodePtr valueTerm = rightVaries
+                ? buildOperator(OperatorType::MUL, buildOperator(OperatorType::DIV, rightDerivative, expr->right), lnBase)
+                : nullptr;
+            ExprNodePtr baseTerm = leftVaries
+                ? buildOperator(OperatorType::MUL, lnValue, buildOperator(OperatorType::DIV, leftDerivative, expr->left))
+                : nullptr;
+            ExprNodePtr numerator = !baseTerm ? valueTerm
+                : valueTerm ? buildOperator(OperatorType::SUB, valueTerm, baseTerm)
+                : buildOperator(OperatorType::MUL, buildNumber(-1), baseTerm);
+
+            ExprNodePtr denominator = buildOperator(OperatorType::POW, lnBase, buildNumber(2));
             return buildOperator(OperatorType::DIV, numerator, denominator);
         }                
         case FunctionType::COS: // (cos(u))' = -sin(u) * u'
             return buildOperator(OperatorType::MUL,
-                buildOperator(OperatorType::MUL, buildNumber(std::string("-1")),
+                buildOperator(OperatorType::MUL, buildNumber(-1),
                     buildFunction(FunctionType::SIN, expr->left)),
                 leftDerivative);
         case FunctionType::SIN: // (sin(u))' = cos(u) * u'
@@ -105,34 +223,47 @@ ExprNodePtr Differentiator::diffFunction(const ExprNodePtr& expr, const std::str
                 leftDerivative);
         case FunctionType::TAN: // (tan(u))' = (1/cos^2(u)) * u'
             return buildOperator(OperatorType::MUL,
-                buildOperator(OperatorType::DIV, buildNumber(std::string("1")),
+                buildOperator(OperatorType::DIV, buildNumber(1),
                     buildOperator(OperatorType::POW, buildFunction(FunctionType::COS, expr->left),
-                        buildNumber(std::string("2")))),
+                        buildNumber(2))),
                 leftDerivative);
         case FunctionType::EXP: // (exp(u))' = exp(u) * u'
             return buildOperator(OperatorType::MUL,
                 buildFunction(FunctionType::EXP, expr->left),
                 leftDerivative);
-        case FunctionType::POW_FUNC: { // pow(u, v)' = (u^v)'
-            // (u^v)' = (v * u^(v-1) * u') + (ln(u) * u^v * v')
-            ExprNodePtr vMinus1 = buildOperator(OperatorType::SUB, expr->right, buildNumber(std::string("1")));
-            ExprNodePtr uPowVMinus1 = buildOperator(OperatorType::POW, expr->left, vMinus1);
-            ExprNodePtr term1 = buildOperator(OperatorType::MUL,
-                buildOperator(OperatorType::MUL, expr->right, uPowVMinus1),
-                leftDerivative);
-
-            ExprNodePtr lnU = buildFunction(FunctionType::LN, expr->left);
-            ExprNodePtr powUV = buildOperator(OperatorType::POW, expr->left, expr->right);
-
-            ExprNodePtr term2 = buildOperator(OperatorType::MUL,
-                buildOperator(OperatorType::MUL, lnU, powUV),
-                rightDerivative);
-
-            return buildOperator(OperatorType::ADD, term1, term2);
-        }
+        case FunctionType::POW_FUNC: // pow(u, v)' = (u^v)'
+            return powerRule(buildOperator(OperatorType::POW, expr->left, expr->right),
+                leftVaries ? leftDerivative : nullptr, rightVaries ? rightDerivative : nullptr);
         default:
             std::cerr << "Error: Unknown FunctionType in diffFunction" << std::endl;
             return nullptr;
     }
 }
 
+// power is u^v; a null derivative marks an operand that does not depend on var.
+// (u^v)' = (v * u^(v-1) * u') + (ln(u) * u^v * v')
+ExprNodePtr Differentiator::powerRule(ExprNodePtr power, ExprNodePtr baseDerivative, ExprNodePtr exponentDerivative) {
+    ExprNodePtr base = power->left;
+    ExprNodePtr exponent = power->right;
+    ExprNodePtr term1 = nullptr;
+    ExprNodePtr term2 = nullptr;
+    if (baseDerivative) {
+        ExprNodePtr vMinus1 = buildOperator(OperatorType::SUB, exponent, buildNumber(1));
+        ExprNodePtr uPowVMinus1 = buildOperator(OperatorType::POW, base, vMinus1);
+        term1 = buildOperator(OperatorType::MUL,
+            buildOperator(OperatorType::MUL, exponent, uPowVMinus1),
+            baseDerivative);
+    }
+    if (exponentDerivative) {
+        term2 = buildOperator(OperatorType::MUL,
+            buildOperator(OperatorType::MUL, buildFunction(FunctionType::LN, base), power),
+            exponentDerivative);
+    }
+    if (!term2) {
+        return term1;
+    }
+    if (!term1) {
+        return term2;
+    }
+    return buildOperator(OperatorType::ADD, term1, term2);
+}
@@ -1,70 +1,295 @@
+#include <algorithm>
+#include <new>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
 #include "expr_node.hpp"
 
 using namespace autodiff;
 
-ExprNode::ExprNode(NodeType t) : type(t) {}
-ExprNode::ExprNode(NodeType t, std::string val) : type(t), value(val) {}
-ExprNode::ExprNode(NodeType t, OperatorType op) : type(t), opType(op) {}
-ExprNode::ExprNode(NodeType t, FunctionType func) : type(t), funcType(func) {}
-ExprNode::ExprNode(NodeType t, FunctionType func, std::unique_ptr<ExprNode> arg) :
-    type(t), funcType(func), left(std::move(arg)) {}
-ExprNode::ExprNode(NodeType t, FunctionType func, std::unique_ptr<ExprNode> arg1, std::unique_ptr<ExprNode> arg2) :
-    type(t), funcType(func), left(std::move(arg1)), right(std::move(arg2)) {}
-ExprNode::ExprNode(NodeType t, OperatorType op, std::unique_ptr<ExprNode> l, std::unique_ptr<ExprNode> r) :
-    type(t), opType(op), left(std::move(l)), right(std::move(r)) {}
+namespace {
+    std::size_t hashCombine(std::size_t seed, std::size_t value) {
+        std::uint64_t h = seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return static_cast<std::size_t>(h);
+    }
+
+    // Payload hash (number value or symbol name, never the symbol id), then a
+    // 64-bit mix per child: deterministic across runs and pools, so hashes can
+    // be compared between processes.
+    std::size_t hashPayload(const ExprNode& node) {
+        switch (node.type) {
+            case NodeType::NUMBER:
+                return node.number.hash();
+            case NodeType::VARIABLE:
+                return SymbolTable::global().getHash(node.symbol);
+            default:
+                return 0;
+        }
+    }
+
+    std::size_t hashNode(const ExprNode& node) {
+        std::size_t h = static_cast<std::size_t>(node.type);
+        h = hashCombine(h, hashPayload(node));
+        h = hashCombine(h, static_cast<std::size_t>(node.opType));
+        h = hashCombine(h, static_cast<std::size_t>(node.funcType));
+        h = hashCombine(h, node.left ? node.left->hash : 0);
+        h = hashCombine(h, node.right ? node.right->hash : 0);
+        return h;
+    }
+
+    VariableMask childDependencies(const ExprNode* left, const ExprNode* right) {
+        return (left ? left->dependencies : 0) | (right ? right->dependencies : 0);
+    }
+}
+
+ExprNode::ExprNode(NodeType t, Number num) :
+    left(nullptr), right(nullptr), dependencies(0), number(num), id(0), type(t),
+    opType(OperatorType::NONE_OP), funcType(FunctionType::NONE_FUNC) {
+    hash = hashNode(*this);
+}
+ExprNode::ExprNode(NodeType t, SymbolId sym) :
+    left(nullptr), right(nullptr), dependencies(variableBit(sym)), symbol(sym), id(0), type(t),
+    opType(OperatorType::NONE_OP), funcType(FunctionType::NONE_FUNC) {
+    hash = hashNode(*this);
+}
+ExprNode::ExprNode(NodeType t, FunctionType func, const ExprNode* arg1, const ExprNode* arg2) :
+    left(arg1), right(arg2), dependencies(childDependencies(arg1, arg2)), symbol(0), id(0), type(t),
+    opType(OperatorType::NONE_OP), funcType(func) {
+    hash = hashNode(*this);
+}
+ExprNode::ExprNode(NodeType t, OperatorType op, const ExprNode* l, const ExprNode* r) :
+    left(l), right(r), dependencies(childDependencies(l, r)), symbol(0), id(0), type(t), opType(op),
+    funcType(FunctionType::NONE_FUNC) {
+    hash = hashNode(*this);
+}
+
+static_assert(std::is_trivially_destructible<ExprNode>::value, "ExprPool::clear does not run destructors");
+
+// Children are already interned, so comparing their addresses is enough.
+bool ExprPool::sameShallow(const ExprNode& a, const ExprNode& b) {
+    if (a.hash != b.hash || a.type != b.type || a.opType != b.opType || a.funcType != b.funcType
+        || a.left != b.left || a.right != b.right) {
+        return false;
+    }
+    switch (a.type) {
+        case NodeType::NUMBER:
+            return a.number == b.number;
+        case NodeType::VARIABLE:
+            return a.symbol == b.symbol;
+        default:
+            return true;
+    }
+}
+
+ExprNode* ExprPool::node(std::uint32_t id) const {
+    return std::launder(reinterpret_cast<ExprNode*>(chunks[id >> chunkShift][id & chunkMask].bytes));
+}
 
-ExprNodePtr autodiff::buildNumber(std::string token) {
-    return std::make_unique<ExprNode>(NodeType::NUMBER, token);
+ExprNodePtr ExprPool::intern(const ExprNode& candidate) {
+    if (2 * (static_cast<std::size_t>(count) + 1) > slots.size()) {
+        grow();
+    }
+    std::size_t mask = slots.size() - 1;
+    for (std::size_t i = candidate.hash & mask;; i = (i + 1) & mask) {
+        Slot& slot = slots[i];
+        if (slot.generation != generation) {
+            std::uint32_t id = count++;
+            if ((id >> chunkShift) == chunks.size()) {
+                chunks.emplace_back(new NodeStorage[chunkMask + 1]);
+            }
+            ExprNode* stored = new (chunks[id >> chunkShift][id & chunkMask].bytes) ExprNode(candidate);
+            stored->id = id;
+            slot = { id, generation };
+            return stored;
+        }
+        ExprNode* existing = node(slot.id);
+        if (sameShallow(*existing, candidate)) {
+            return existing;
+        }
+    }
 }
 
-ExprNodePtr autodiff::buildVariable(std::string token) {
-    return std::make_unique<ExprNode>(NodeType::VARIABLE, token);
+// The live nodes are exactly ids 0 to count-1, so they are re-inserted from
+// the chunks rather than from the old table.
+void ExprPool::grow() {
+    std::size_t capacity = std::max<std::size_t>(1024, 2 * slots.size());
+    if (capacity / 2 <= count + 1) {
+        capacity *= 2;
+    }
+    slots.assign(capacity, Slot{ 0, 0 });
+    generation = 1;
+    std::size_t mask = capacity - 1;
+    for (std::uint32_t id = 0; id < count; ++id) {
+        std::size_t i = node(id)->hash & mask;
+        while (slots[i].generation == generation) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = { id, generation };
+    }
 }
 
-ExprNodePtr autodiff::buildOperator(OperatorType opType) {
-    return std::make_unique<ExprNode>(NodeType::OPERATOR, opType);
+std::size_t ExprPool::size() const {
+    return count;
 }
 
-ExprNodePtr autodiff::buildOperator(OperatorType opType, const ExprNodePtr& arg1, const ExprNodePtr& arg2) {
-    return std::make_unique<ExprNode>(NodeType::OPERATOR, opType, cloneSubtree(arg1.get()), cloneSubtree(arg2.get()));
+void ExprPool::clear() {
+    count = 0;
+    if (++generation == 0) { // wrapped: stale stamps could look current again
+        std::fill(slots.begin(), slots.end(), Slot{ 0, 0 });
+        generation = 1;
+    }
 }
 
-ExprNodePtr autodiff::buildFunction(FunctionType funcType, const ExprNodePtr& arg) {
-    return std::make_unique<ExprNode>(NodeType::FUNCTION, funcType, cloneSubtree(arg.get()));
+void ExprPool::release() {
+    count = 0;
+    generation = 1;
+    std::vector<std::unique_ptr<NodeStorage[]>>().swap(chunks);
+    std::vector<Slot>().swap(slots);
 }
 
-ExprNodePtr autodiff::buildFunction(FunctionType funcType, const ExprNodePtr& arg1, const ExprNodePtr& arg2) {
-    return std::make_unique<ExprNode>(NodeType::FUNCTION, funcType, cloneSubtree(arg1.get()), cloneSubtree(arg2.get()));
+std::size_t ExprPool::capacityBytes() const {
+    return chunks.size() * (chunkMask + 1) * sizeof(NodeStorage) + slots.capacity() * sizeof(Slot);
 }
 
+ExprPool& ExprPool::current() {
+    static thread_local ExprPool pool;
+    return pool;
+}
 
+ExprNodePtr autodiff::buildNumber(const Number& number) {
+    return ExprPool::current().intern(ExprNode(NodeType::NUMBER, number));
+}
 
-ExprNodePtr autodiff::cloneSubtree(const ExprNode* node) {
-    if (!node) {
+ExprNodePtr autodiff::buildVariable(SymbolId symbol) {
+    return ExprPool::current().intern(ExprNode(NodeType::VARIABLE, symbol));
+}
+
+ExprNodePtr autodiff::buildOperator(OperatorType opType, ExprNodePtr arg1, ExprNodePtr arg2) {
+    return ExprPool::current().intern(ExprNode(NodeType::OPERATOR, opType, arg1, arg2));
+}
+
+ExprNodePtr autodiff::buildFunction(FunctionType funcType, ExprNodePtr arg) {
+    return ExprPool::current().intern(ExprNode(NodeType::FUNCTION, funcType, arg, nullptr));
+}
+
+ExprNodePtr autodiff::buildFunction(FunctionType funcType, ExprNodePtr arg1, ExprNodePtr arg2) {
+    return ExprPool::current().intern(ExprNode(NodeType::FUNCTION, funcType, arg1, arg2));
+}
+
+// Post-order with an explicit stack; shared subtrees are rebuilt once.
+ExprNodePtr autodiff::cloneSubtree(const ExprNode* root) {
+    if (!root) {
         return nullptr;
     }
-
-    ExprNodePtr newNode;
-    switch (node->type) {
-        case NodeType::NUMBER:
-            newNode = buildNumber(node->value);
-            break;
-        case NodeType::VARIABLE:
-            newNode = buildVariable(node->value);
-            break;
-        case NodeType::OPERATOR:
-            newNode = buildOperator(node->opType, cloneSubtree(node->left.get()), cloneSubtree(node->right.get()));
-            break;
-        case NodeType::FUNCTION: {
+    std::unordered_map<const ExprNode*, ExprNodePtr> clones;
+    auto cloneOf = [&clones](const ExprNode* node) { return node ? clones.at(node) : nullptr; };
+    std::vector<std::pair<const ExprNode*, bool>> stack; // (node, children already pushed)
+    stack.emplace_back(root, false);
+    while (!stack.empty()) {
+        auto [node, expanded] = stack.back();
+        if (clones.count(node)) {
+            stack.pop_back();
+            continue;
+        }
+        if (!expanded && (node->left || node->right)) {
+            stack.back().second = true;
             if (node->right) {
-                newNode = buildFunction(node->funcType, cloneSubtree(node->left.get()), cloneSubtree(node->right.get()));
-            } else {
-                newNode = buildFunction(node->funcType, cloneSubtree(node->left.get()));
+                stack.emplace_back(node->right, false);
             }
-            break;
+            if (node->left) {
+                stack.emplace_back(node->left, false);
+            }
+            continue;
         }
-        default:
-            return nullptr;
+        stack.pop_back();
+        ExprNodePtr clone = nullptr;
+        switch (node->type) {
+            case NodeType::NUMBER:
+                clone = buildNumber(node->number);
+                break;
+            case NodeType::VARIABLE:
+                clone = buildVariable(node->symbol);
+                break;
+            case NodeType::OPERATOR:
+                clone = buildOperator(node->opType, cloneOf(node->left), cloneOf(node->right));
+                break;
+            case NodeType::FUNCTION:
+                clone = node->right
+                    ? buildFunction(node->funcType, cloneOf(node->left), cloneOf(node->right))
+                    : buildFunction(node->funcType, cloneOf(node->left));
+                break;
+        }
+        clones.emplace(node, clone);
     }
-    return newNode;
-}
\ No newline at end of file
+    return clones.at(root);
+}
+
+std::size_t autodiff::countNodes(ExprNodePtr expr) {
+    return countNodes(std::vector<ExprNodePtr>{ expr });
+}
+
+std::size_t autodiff::countNodes(const std::vector<ExprNodePtr>& roots) {
+    std::unordered_set<ExprNodePtr> seen;
+    std::vector<ExprNodePtr> stack;
+    for (ExprNodePtr root : roots) {
+        if (root) {
+            stack.push_back(root);
+        }
+    }
+    while (!stack.empty()) {
+        ExprNodePtr node = stack.back();
+        stack.pop_back();
+        if (!seen.insert(node).second) {
+            continue;
+        }
+        if (node->left) {
+            stack.push_back(node->left);
+        }
+        if (node->right) {
+            stack.push_back(node->right);
+        }
+    }
+    return seen.size();
+}
+
+std::size_t autodiff::maxDepth(const std::vector<ExprNodePtr>& roots) {
+    std::unordered_map<ExprNodePtr, std::size_t> depths; // of finished subtrees
+    std::vector<ExprNodePtr> stack;
+    std::size_t deepest = 0;
+    for (ExprNodePtr root : roots) {
+        if (root) {
+            stack.push_back(root);
+        }
+        while (!stack.empty()) {
+            ExprNodePtr node = stack.back();
+            if (depths.count(node)) {
+                stack.pop_back();
+                continue;
+            }
+            // A node is finished once both children are; shared subtrees are walked once.
+            bool ready = true;
+            for (ExprNodePtr child : { node->left, node->right }) {
+                if (child && !depths.count(child)) {
+                    stack.push_back(child);
+                    ready = false;
+                }
+            }
+            if (!ready) {
+                continue;
+            }
+            stack.pop_back();
+            std::size_t depth = 1 + std::max(node->left ? depths[node->left] : 0, node->right ? depths[node->right] : 0);
+            depths.emplace(node, depth);
+        }
+        if (root) {
+            deepest = std::max(deepest, depths[root]);
+        }
+    }
+    return deepest;
+}
@@ -1,170 +1,184 @@
 #include <iostream>
 
 #include "expression_builder.hpp"
+#include "pipeline_stats.hpp"
 
 using namespace autodiff;
 
-ExpressionBuilder::ExpressionBuilder(const std::vector<std::string>& tokens) :tokens(tokens), cur_index(0) {}
-
-ExprNodePtr ExpressionBuilder::build() {
-    return parseExpression();
+ExpressionBuilder::ExpressionBuilder(std::vector<Token> tokens) : tokens(std::move(tokens)), cur_index(0) {
+    if (this->tokens.empty() || this->tokens.back().kind != TokenKind::END) {
+        this->tokens.push_back({ TokenKind::END, OperatorType::NONE_OP, FunctionType::NONE_FUNC, 0, std::string_view() });
+    }
 }
 
-ExprNodePtr ExpressionBuilder::parseExpression() {
-    ExprNodePtr left = parseTerm();
+ExpressionBuilder::ExpressionBuilder(Tokenizer& tokenizer) : cur_index(0), stream(&tokenizer) {}
 
-    while (isTokenAvailable()) {
-        std::string op = peekToken();
-        if (op == "+" || op == "-") {
-            std::string token = consumeToken();
-            OperatorType opType = getOperatorType(token);
-            ExprNodePtr right = parseTerm();
-            left = buildOperator(opType, std::move(left), std::move(right));
-        } else {
+// Operator-precedence parsing with an explicit stack of open operators and
+// groups, so nesting depth is bounded by memory rather than the call stack.
+ExprNodePtr ExpressionBuilder::build() {
+    StageTimer timer(Stage::PARSE);
+    cur_index = 0;
+    current = stream ? stream->next() : tokens[0];
+    frames.clear();
+    operands.clear();
+    bool expectOperand = true;
+    while (true) {
+        if (expectOperand) {
+            if (!parseOperand(expectOperand)) {
+                return nullptr;
+            }
+            continue;
+        }
+        const Token& token = peekToken();
+        if (token.kind == TokenKind::OPERATOR) {
+            reduce(getPrecedence(token.opType), token.opType == OperatorType::POW);
+            frames.push_back({ TokenKind::OPERATOR, token.opType, FunctionType::NONE_FUNC, 0, std::string_view() });
+            consumeToken();
+            expectOperand = true;
+        } else if (token.kind == TokenKind::COMMA || token.kind == TokenKind::RIGHT_PAREN) {
+            bool comma = token.kind == TokenKind::COMMA;
+            reduce(-1, false);
+            if (frames.empty()) { // nothing to close: the expression ends here
+                break;
+            }
+            if (!closeGroup(comma)) {
+                return nullptr;
+            }
+            expectOperand = comma;
+        } else { // anything else after an operand ends the expression
             break;
         }
     }
-
-    return left;
+    reduce(-1, false);
+    if (!frames.empty()) {
+        reportUnclosed(frames.back());
+        return nullptr;
+    }
+    return timer.finish(operands.back());
 }
 
-ExprNodePtr ExpressionBuilder::parseTerm() {
-    ExprNodePtr left = parseFactor();
-
-    while (isTokenAvailable()) {
-        std::string op = peekToken();
-        if (op == "*" || op == "/") {
-            std::string token = consumeToken();
-            OperatorType opType = getOperatorType(token);
-            ExprNodePtr right = parseFactor();
-            left = buildOperator(opType, std::move(left), std::move(right));
-        } else {
-            break;
+// Pushes a number or variable, or opens a parenthesis or function call.
+bool ExpressionBuilder::parseOperand(bool& expectOperand) {
+    Token token = consumeToken();
+    switch (token.kind) {
+        case TokenKind::NUMBER: {
+            Number number;
+            if (!Number::parse(token.text, number)) {
+                std::cerr << "Error: Invalid number literal " << token.text << std::endl;
+                return false;
+            }
+            operands.push_back(buildNumber(number));
+            expectOperand = false;
+            return true;
         }
+        case TokenKind::VARIABLE:
+            operands.push_back(buildVariable(token.symbol));
+            expectOperand = false;
+            return true;
+        case TokenKind::LEFT_PAREN:
+            frames.push_back({ TokenKind::LEFT_PAREN, OperatorType::NONE_OP, FunctionType::NONE_FUNC, 0, token.text });
+            return true;
+        case TokenKind::FUNCTION:
+            if (consumeToken().kind != TokenKind::LEFT_PAREN) {
+                std::cerr << "Error: Invalid function call for " << token.text << std::endl;
+                return false;
+            }
+            frames.push_back({ TokenKind::FUNCTION, OperatorType::NONE_OP, token.funcType, 0, token.text });
+            return true;
+        case TokenKind::END:
+            std::cerr << "Error: Unexpected end of tokens" << std::endl;
+            return false;
+        default:
+            std::cerr << "Error: Unexpected token: " << token.text << std::endl;
+            return false;
     }
-
-    return left;
 }
 
-ExprNodePtr ExpressionBuilder::parseFactor() {
-    ExprNodePtr left = parsePrimary();
-    if (isTokenAvailable() && peekToken() == "^") {
-        consumeToken();
-        ExprNodePtr right = parseFactor();
-        return buildOperator(OperatorType::POW, std::move(left), std::move(right));
+void ExpressionBuilder::reduce(int precedence, bool rightAssociative) {
+    while (!frames.empty() && frames.back().kind == TokenKind::OPERATOR) {
+        int top = getPrecedence(frames.back().opType);
+        if (top < precedence || (top == precedence && rightAssociative)) {
+            break;
+        }
+        ExprNodePtr right = operands.back();
+        operands.pop_back();
+        operands.back() = buildOperator(frames.back().opType, operands.back(), right);
+        frames.pop_back();
     }
-    return left;
 }
 
-
-ExprNodePtr ExpressionBuilder::parsePrimary() {
-    if (!isTokenAvailable()) {
-        std::cerr << "Error: Unexpected end of tokens in parsePrimary()" << std::endl;
-        return nullptr; 
-    }
-    std::string token = consumeToken();
-    if (getTokenType(token) == NodeType::NUMBER) {
-        return buildNumber(token);
-    } else if (getTokenType(token) == NodeType::VARIABLE) {
-        return buildVariable(token);
-    } else if (token == "(") {
-        ExprNodePtr expression = parseExpression();
-        if (isTokenAvailable() && peekToken() == ")") {
-            consumeToken(); // ')'
-            return expression;
-        } else {
-            std::cerr << "Error: Missing closing parenthesis ')'" << std::endl;
-            return nullptr;
+// Handles ',' or ')' for the innermost open group; operators inside it are
+// already reduced.
+bool ExpressionBuilder::closeGroup(bool comma) {
+    Frame& frame = frames.back();
+    if (frame.kind == TokenKind::LEFT_PAREN) {
+        if (comma) {
+            reportUnclosed(frame);
+            return false;
         }
-    } else if (getTokenType(token) == NodeType::FUNCTION) {
-        FunctionType funcType = getFunctionType(token);
-        if (isTokenAvailable() && consumeToken() == "(") {
-            if (funcType == FunctionType::LOG || funcType == FunctionType::POW_FUNC) {
-                ExprNodePtr arg1 = parseExpression();
-                if (isTokenAvailable() && consumeToken() == ",") {
-                    ExprNodePtr arg2 = parseExpression();
-                    if (isTokenAvailable() && consumeToken() == ")") {
-                        return buildFunction(funcType, std::move(arg1), std::move(arg2));
-                    }
-                }
-            } else { // ln, cos, sin, tan, exp
-                ExprNodePtr arg = parseExpression();
-                if (isTokenAvailable() && consumeToken() == ")") {
-                    return buildFunction(funcType, std::move(arg));
-                }
-            }
-        }
-        std::cerr << "Error: Invalid function call for " << token << std::endl;
-        return nullptr;
-    } else {
-        std::cerr << "Error: Unexpected token: " << token << std::endl;
-        return nullptr;
+        frames.pop_back();
+        consumeToken(); // ')'
+        return true;
     }
-}
-
-std::string ExpressionBuilder::peekToken() const {
-    if (cur_index < tokens.size()) {
-        return tokens[cur_index];
+    bool binary = frame.funcType == FunctionType::LOG || frame.funcType == FunctionType::POW_FUNC;
+    if (comma ? (!binary || frame.commas > 0) : frame.commas != (binary ? 1 : 0)) {
+        reportUnclosed(frame);
+        return false;
     }
-    return "";
+    consumeToken();
+    if (comma) {
+        ++frame.commas;
+        return true;
+    }
+    if (binary) { // log, pow
+        ExprNodePtr arg2 = operands.back();
+        operands.pop_back();
+        operands.back() = buildFunction(frame.funcType, operands.back(), arg2);
+    } else { // ln, cos, sin, tan, exp
+        operands.back() = buildFunction(frame.funcType, operands.back());
+    }
+    frames.pop_back();
+    return true;
 }
 
-std::string ExpressionBuilder::consumeToken() {
-    if (cur_index < tokens.size()) {
-        return tokens[cur_index++];
+void ExpressionBuilder::reportUnclosed(const Frame& frame) const {
+    if (frame.kind == TokenKind::FUNCTION) {
+        std::cerr << "Error: Invalid function call for " << frame.name << std::endl;
+    } else {
+        std::cerr << "Error: Missing closing parenthesis ')'" << std::endl;
     }
-    return "";
 }
 
-bool ExpressionBuilder::isTokenAvailable() const {
-    return cur_index < tokens.size();
+// Past the end both return the trailing END token.
+const Token& ExpressionBuilder::peekToken() const {
+    return current;
 }
 
-NodeType ExpressionBuilder::getTokenType(const std::string& token) const {
-    if (isDigit(token[0]) ||
-        (token[0] == '-' && token.size() > 1 && isDigit(token[1]))) {
-        return NodeType::NUMBER;
-    } else if (isOperator(token[0])) {
-        return NodeType::OPERATOR;
-    } else if (isFunction(token)) {
-        return NodeType::FUNCTION;
+Token ExpressionBuilder::consumeToken() {
+    Token token = current;
+    if (stream) {
+        current = stream->next();
+    } else if (cur_index + 1 < tokens.size()) {
+        current = tokens[++cur_index];
     }
-    return NodeType::VARIABLE;
+    return token;
 }
 
-OperatorType ExpressionBuilder::getOperatorType(const std::string& token) const {
-    switch (token[0]) {
-    case '+':
-        return OperatorType::ADD;
-    case '-':
-        return OperatorType::SUB;
-    case '*':
-        return OperatorType::MUL;
-    case '/':
-        return OperatorType::DIV;
-    case '^':
-        return OperatorType::POW;
-    default:
-        return OperatorType::NONE_OP;
-    }
+bool ExpressionBuilder::isTokenAvailable() const {
+    return peekToken().kind != TokenKind::END;
 }
 
-FunctionType ExpressionBuilder::getFunctionType(const std::string& token) const {
-    if (token == "ln") {
-        return FunctionType::LN;
-    } else if (token == "log") {
-        return FunctionType::LOG;
-    } else if (token == "cos") {
-        return FunctionType::COS;
-    } else if (token == "sin") {
-        return FunctionType::SIN;
-    } else if (token == "tan") {
-        return FunctionType::TAN;
-    } else if (token == "exp") {
-        return FunctionType::EXP;
-    } else if (token == "pow") {
-        return FunctionType::POW_FUNC;
-    } else {
-        return FunctionType::NONE_FUNC;
+int ExpressionBuilder::getPrecedence(OperatorType op) {
+    switch (op) {
+        case OperatorType::ADD:
+        case OperatorType::SUB:
+            return 1;
+        case OperatorType::MUL:
+        case OperatorType::DIV:
+            return 2;
+        case OperatorType::POW:
+            return 3;
+        default:
+            return 0;
     }
-}
\ No newline at end of file
+}
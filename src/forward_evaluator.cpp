@@ -0,0 +1,36 @@
+#include <algorithm>
+
+#include "forward_evaluator.hpp"
+
+using namespace autodiff;
+
+namespace {
+    template <size_t N>
+    std::vector<double> sweep(ExprNodePtr expr, const std::vector<SymbolId>& vars,
+                              const std::vector<double>& values) {
+        ForwardEvaluator<N> evaluator(vars);
+        std::vector<double> result(vars.size() + 1, 0.0);
+        size_t firstLane = 0;
+        do {
+            Dual<N> d = evaluator.evaluate(expr, values, firstLane);
+            result[0] = d.value;
+            for (size_t i = 0; i < N && firstLane + i < vars.size(); ++i) {
+                result[firstLane + i + 1] = d.tangent[i];
+            }
+            firstLane += N;
+        } while (firstLane < vars.size());
+        return result;
+    }
+}
+
+std::vector<double> autodiff::forwardGradient(ExprNodePtr expr, const std::vector<SymbolId>& vars,
+                                              const std::vector<double>& values) {
+    if (vars.size() <= 1) {
+        return sweep<1>(expr, vars, values);
+    } else if (vars.size() <= 2) {
+        return sweep<2>(expr, vars, values);
+    } else if (vars.size() <= 4) {
+        return sweep<4>(expr, vars, values);
+    }
+    return sweep<8>(expr, vars, values);
+}
@@ -0,0 +1,386 @@
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "graph_file.hpp"
+
+using namespace autodiff;
+
+static_assert(sizeof(GraphFileHeader) == 72, "header layout");
+static_assert(sizeof(GraphNode) == 12 && sizeof(GraphSymbol) == 8 && sizeof(GraphConstant) == 24
+              && sizeof(GraphRoot) == 8, "section layout");
+
+namespace {
+    const char magic[8] = { 'A', 'D', 'G', 'R', 'A', 'P', 'H', '\0' };
+    const std::uint32_t formatVersion = 2;
+    const std::uint32_t byteOrderMark = 0x01020304;
+
+    // One multiply and shift per 8-byte word, so checking a large file is
+    // limited by reading it. Every section is a multiple of 8 bytes long.
+    class Checksum {
+    public:
+        void update(const void* bytes, size_t length) {
+            const unsigned char* p = static_cast<const unsigned char*>(bytes);
+            for (size_t i = 0; i + 8 <= length; i += 8) {
+                std::uint64_t word;
+                std::memcpy(&word, p + i, sizeof(word));
+                h = (h ^ word) * 0x9e3779b97f4a7c15ULL;
+                h ^= h >> 29;
+            }
+        }
+        std::uint64_t value() const { return h; }
+
+    private:
+        std::uint64_t h = 0xcbf29ce484222325ULL;
+    };
+
+    // An odd node count leaves the table 4 bytes short of the next boundary;
+    // the writer fills it with one zeroed entry.
+    size_t paddedNodeBytes(std::uint64_t nodeCount) { return (nodeCount + nodeCount % 2) * sizeof(GraphNode); }
+
+    template <typename T>
+    void writeSection(std::ofstream& out, const std::vector<T>& items, Checksum& checksum) {
+        out.write(reinterpret_cast<const char*>(items.data()), items.size() * sizeof(T));
+        checksum.update(items.data(), items.size() * sizeof(T));
+    }
+
+    // Wide values are written out in the name blob, as they print.
+    GraphConstant toConstant(const Number& number, std::string& names) {
+        GraphConstant constant{ static_cast<std::uint32_t>(number.getKind()), 0, 0, 1 };
+        if (number.isWide()) {
+            constant.wide = 1;
+            constant.numerator = static_cast<std::int64_t>(names.size());
+            number.appendTo(names);
+            constant.denominator = static_cast<std::int64_t>(names.size()) - constant.numerator;
+        } else if (number.isExact()) {
+            constant.numerator = number.getNumerator();
+            constant.denominator = number.getDenominator();
+        } else {
+            double value = number.toDouble();
+            std::memcpy(&constant.numerator, &value, sizeof(value));
+        }
+        return constant;
+    }
+}
+
+bool autodiff::writeGraph(const std::string& path, ExprNodePtr value, const std::vector<SymbolId>& vars,
+                          const std::vector<ExprNodePtr>& partials) {
+    if (!value || partials.size() != vars.size()) {
+        std::cerr << "Error: writeGraph needs a value and one partial per variable" << std::endl;
+        return false;
+    }
+    std::vector<GraphNode> nodes;
+    std::vector<GraphSymbol> symbols;
+    std::vector<GraphConstant> constants;
+    std::vector<GraphRoot> roots;
+    std::string names;
+    std::unordered_map<ExprNodePtr, std::uint32_t> indices;
+    std::unordered_map<SymbolId, std::uint32_t> symbolIndices;
+
+    auto symbolIndex = [&](SymbolId symbol) {
+        auto [found, added] = symbolIndices.emplace(symbol, static_cast<std::uint32_t>(symbols.size()));
+        if (added) {
+            const std::string& name = symbolName(symbol);
+            symbols.push_back({ static_cast<std::uint32_t>(names.size()), static_cast<std::uint32_t>(name.size()) });
+            names += name;
+        }
+        return found->second;
+    };
+    auto indexOf = [&indices](ExprNodePtr node) { return node ? indices.at(node) : graphNone; };
+
+    // Post-order over all roots at once, so a subtree shared between the
+    // value and the partials, or between partials, is written once.
+    std::vector<ExprNodePtr> all = { value };
+    all.insert(all.end(), partials.begin(), partials.end());
+    std::vector<std::pair<ExprNodePtr, bool>> stack; // (node, children already pushed)
+    for (ExprNodePtr root : all) {
+        stack.emplace_back(root, false);
+        while (!stack.empty()) {
+            auto [node, expanded] = stack.back();
+            if (indices.count(node)) {
+                stack.pop_back();
+                continue;
+            }
+            if (!expanded && (node->left || node->right)) {
+                stack.back().second = true;
+                if (node->right) {
+                    stack.emplace_back(node->right, false);
+                }
+                if (node->left) {
+                    stack.emplace_back(node->left, false);
+                }
+                continue;
+            }
+            stack.pop_back();
+            if (nodes.size() >= graphNone) {
+                std::cerr << "Error: Too many nodes for a graph file" << std::endl;
+                return false;
+            }
+            GraphNode entry{ node->type, node->opType, node->funcType, 0, indexOf(node->left), indexOf(node->right) };
+            if (node->type == NodeType::VARIABLE) {
+                entry.left = symbolIndex(node->symbol);
+            } else if (node->type == NodeType::NUMBER) {
+                entry.left = static_cast<std::uint32_t>(constants.size());
+                constants.push_back(toConstant(node->number, names));
+            }
+            indices.emplace(node, static_cast<std::uint32_t>(nodes.size()));
+            nodes.push_back(entry);
+        }
+    }
+    roots.push_back({ indices.at(value), graphNone });
+    for (size_t i = 0; i < vars.size(); ++i) {
+        roots.push_back({ indices.at(partials[i]), symbolIndex(vars[i]) });
+    }
+    if (names.size() >= graphNone) {
+        std::cerr << "Error: Symbol names too long for a graph file" << std::endl;
+        return false;
+    }
+    names.resize((names.size() + 7) / 8 * 8, '\0');
+
+    GraphFileHeader header = {};
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = formatVersion;
+    header.byteOrder = byteOrderMark;
+    header.nodeCount = nodes.size();
+    if (nodes.size() % 2 != 0) {
+        nodes.push_back(GraphNode{});
+    }
+    header.symbolCount = symbols.size();
+    header.constantCount = constants.size();
+    header.rootCount = roots.size();
+    header.nameBytes = names.size();
+    header.fileSize = sizeof(header) + constants.size() * sizeof(GraphConstant) + symbols.size() * sizeof(GraphSymbol)
+        + roots.size() * sizeof(GraphRoot) + nodes.size() * sizeof(GraphNode) + names.size();
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::cerr << "Error: Cannot open " << path << " for writing" << std::endl;
+        return false;
+    }
+    Checksum checksum;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header)); // checksum filled in below
+    writeSection(out, constants, checksum);
+    writeSection(out, symbols, checksum);
+    writeSection(out, roots, checksum);
+    writeSection(out, nodes, checksum);
+    out.write(names.data(), names.size());
+    checksum.update(names.data(), names.size());
+    header.checksum = checksum.value();
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.close();
+    if (!out) {
+        std::cerr << "Error: Cannot write " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+MappedGraph::~MappedGraph() {
+    close();
+}
+
+bool MappedGraph::open(const std::string& path, bool verifyChecksum) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Error: Cannot open " << path << std::endl;
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(GraphFileHeader)) {
+        std::cerr << "Error: " << path << " is not a graph file" << std::endl;
+        ::close(fd);
+        return false;
+    }
+    size = static_cast<size_t>(info.st_size);
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping keeps the file alive
+    if (mapped == MAP_FAILED) {
+        std::cerr << "Error: Cannot map " << path << std::endl;
+        size = 0;
+        return false;
+    }
+    data = static_cast<const unsigned char*>(mapped);
+    header = reinterpret_cast<const GraphFileHeader*>(data);
+
+    const char* problem = nullptr;
+    if (std::memcmp(header->magic, magic, sizeof(magic)) != 0) {
+        problem = "is not a graph file";
+    } else if (header->byteOrder != byteOrderMark) {
+        problem = "was written with a different byte order";
+    } else if (header->version == 0 || header->version > formatVersion) { // version 1 only lacks wide constants
+        problem = "has an unsupported format version";
+    } else if (header->nodeCount >= graphNone || header->symbolCount >= graphNone
+               || header->constantCount >= graphNone || header->rootCount >= graphNone
+               || header->nameBytes >= graphNone || header->nameBytes % 8 != 0 || header->rootCount == 0
+               || header->fileSize != size
+               || size != sizeof(GraphFileHeader) + header->constantCount * sizeof(GraphConstant)
+                          + header->symbolCount * sizeof(GraphSymbol) + header->rootCount * sizeof(GraphRoot)
+                          + paddedNodeBytes(header->nodeCount) + header->nameBytes) {
+        problem = "is truncated or has inconsistent section sizes";
+    }
+    if (!problem && verifyChecksum) {
+        Checksum checksum;
+        checksum.update(data + sizeof(GraphFileHeader), size - sizeof(GraphFileHeader));
+        if (checksum.value() != header->checksum) {
+            problem = "fails its checksum";
+        }
+    }
+    if (problem) {
+        std::cerr << "Error: " << path << " " << problem << std::endl;
+        close();
+        return false;
+    }
+
+    const unsigned char* cursor = data + sizeof(GraphFileHeader);
+    constants = reinterpret_cast<const GraphConstant*>(cursor);
+    cursor += header->constantCount * sizeof(GraphConstant);
+    symbols = reinterpret_cast<const GraphSymbol*>(cursor);
+    cursor += header->symbolCount * sizeof(GraphSymbol);
+    roots = reinterpret_cast<const GraphRoot*>(cursor);
+    cursor += header->rootCount * sizeof(GraphRoot);
+    nodes = reinterpret_cast<const GraphNode*>(cursor);
+    cursor += paddedNodeBytes(header->nodeCount);
+    names = reinterpret_cast<const char*>(cursor);
+    return true;
+}
+
+void MappedGraph::close() {
+    if (data) {
+        munmap(const_cast<unsigned char*>(data), size);
+    }
+    data = nullptr;
+    size = 0;
+    header = nullptr;
+    nodes = nullptr;
+    symbols = nullptr;
+    constants = nullptr;
+    roots = nullptr;
+    names = nullptr;
+}
+
+std::string_view MappedGraph::symbol(std::uint32_t index) const {
+    return std::string_view(names + symbols[index].offset, symbols[index].length);
+}
+
+bool MappedGraph::constant(std::uint32_t index, Number& value) const {
+    const GraphConstant& constant = constants[index];
+    if (constant.wide) {
+        if (constant.kind == static_cast<std::uint32_t>(Number::Kind::REAL) || constant.numerator < 0
+            || constant.denominator <= 0
+            || static_cast<std::uint64_t>(constant.numerator + constant.denominator) > header->nameBytes) {
+            return false;
+        }
+        std::string_view text(names + constant.numerator, static_cast<size_t>(constant.denominator));
+        size_t slash = text.find('/');
+        Number numerator;
+        Number denominator(1);
+        if (!Number::parse(text.substr(0, slash), numerator) || !numerator.isInteger()
+            || (slash != std::string_view::npos
+                && (!Number::parse(text.substr(slash + 1), denominator) || !denominator.isInteger()
+                    || denominator.isZero()))) {
+            return false;
+        }
+        value = numerator / denominator;
+        return true;
+    }
+    switch (static_cast<Number::Kind>(constant.kind)) {
+        case Number::Kind::INTEGER:
+            value = Number(constant.numerator);
+            return true;
+        case Number::Kind::RATIONAL:
+            value = Number::rational(constant.numerator, constant.denominator);
+            return true;
+        case Number::Kind::REAL: {
+            double real;
+            std::memcpy(&real, &constant.numerator, sizeof(real));
+            value = Number::real(real);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Children precede their parents in the table, so a single forward pass
+// builds every node from nodes already built. Every index is checked, since
+// the checksum may have been skipped.
+std::vector<ExprNodePtr> MappedGraph::load(std::vector<SymbolId>& vars) const {
+    std::vector<ExprNodePtr> result;
+    vars.clear();
+    if (!header) {
+        return result;
+    }
+    std::vector<SymbolId> symbolIds(symbolCount());
+    for (std::uint32_t i = 0; i < symbolCount(); ++i) {
+        if (static_cast<std::uint64_t>(symbols[i].offset) + symbols[i].length > header->nameBytes) {
+            std::cerr << "Error: Graph symbol " << i << " is out of range" << std::endl;
+            return result;
+        }
+        symbolIds[i] = internSymbol(symbol(i));
+    }
+
+    std::vector<ExprNodePtr> built(nodeCount());
+    for (std::uint32_t i = 0; i < nodeCount(); ++i) {
+        const GraphNode& entry = nodes[i];
+        bool leaf = entry.type == NodeType::NUMBER || entry.type == NodeType::VARIABLE;
+        bool leftOk = leaf || entry.left == graphNone || entry.left < i;
+        bool rightOk = entry.right == graphNone || entry.right < i;
+        ExprNodePtr left = !leaf && entry.left < i ? built[entry.left] : nullptr;
+        ExprNodePtr right = entry.right < i ? built[entry.right] : nullptr;
+        ExprNodePtr node = nullptr;
+        if (leftOk && rightOk) {
+            switch (entry.type) {
+                case NodeType::NUMBER: {
+                    Number value;
+                    if (entry.left < header->constantCount && constant(entry.left, value)) {
+                        node = buildNumber(value);
+                    }
+                    break;
+                }
+                case NodeType::VARIABLE:
+                    if (entry.left < symbolCount()) {
+                        node = buildVariable(symbolIds[entry.left]);
+                    }
+                    break;
+                case NodeType::OPERATOR:
+                    if (entry.opType < OperatorType::NONE_OP && left && right) {
+                        node = buildOperator(entry.opType, left, right);
+                    }
+                    break;
+                case NodeType::FUNCTION:
+                    if (entry.funcType < FunctionType::NONE_FUNC && left) {
+                        node = right ? buildFunction(entry.funcType, left, right) : buildFunction(entry.funcType, left);
+                    }
+                    break;
+            }
+        }
+        if (!node) {
+            std::cerr << "Error: Graph node " << i << " is malformed" << std::endl;
+            return result;
+        }
+        built[i] = node;
+    }
+
+    for (size_t k = 0; k < rootCount(); ++k) {
+        const GraphRoot& entry = roots[k];
+        bool variableOk = k == 0 ? entry.variable == graphNone : entry.variable < symbolCount();
+        if (entry.node >= nodeCount() || !variableOk) {
+            std::cerr << "Error: Graph root " << k << " is malformed" << std::endl;
+            vars.clear();
+            result.clear();
+            return result;
+        }
+        result.push_back(built[entry.node]);
+        if (k > 0) {
+            vars.push_back(symbolIds[entry.variable]);
+        }
+    }
+    return result;
+}
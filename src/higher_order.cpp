@@ -0,0 +1,57 @@
+#include <algorithm>
+#include <functional>
+
+#include "higher_order.hpp"
+
+using namespace autodiff;
+
+size_t HigherOrderDifferentiator::KeyHash::operator()(const Key& key) const {
+    size_t h = std::hash<const void*>()(key.expr);
+    for (SymbolId var : key.vars) {
+        h = h * 31 + var;
+    }
+    return h;
+}
+
+ExprNodePtr HigherOrderDifferentiator::partial(ExprNodePtr expr, std::vector<SymbolId> vars) {
+    std::sort(vars.begin(), vars.end());
+    return partialSorted(expr, vars, vars.size());
+}
+
+// Partial with respect to the first `order` entries of sortedVars.
+ExprNodePtr HigherOrderDifferentiator::partialSorted(ExprNodePtr expr, const std::vector<SymbolId>& sortedVars,
+                                                     size_t order) {
+    if (order == 0) {
+        return expr;
+    }
+    Key key{ expr, std::vector<SymbolId>(sortedVars.begin(), sortedVars.begin() + order) };
+    auto found = partials.find(key);
+    if (found != partials.end()) {
+        return found->second;
+    }
+    ExprNodePtr lower = partialSorted(expr, sortedVars, order - 1);
+    ExprNodePtr result = simplifier.simplify(differentiator.differentiateCached(lower, sortedVars[order - 1]));
+    partials.emplace(std::move(key), result);
+    return result;
+}
+
+Hessian HigherOrderDifferentiator::hessian(ExprNodePtr expr, const std::vector<SymbolId>& vars) {
+    Hessian result;
+    result.entries.assign(vars.size(), std::vector<ExprNodePtr>(vars.size(), nullptr));
+    std::vector<ExprNodePtr> distinct;
+    for (size_t i = 0; i < vars.size(); ++i) {
+        for (size_t j = i; j < vars.size(); ++j) {
+            ExprNodePtr entry = partial(expr, { vars[i], vars[j] });
+            result.entries[i][j] = entry;
+            result.entries[j][i] = entry;
+            distinct.push_back(entry);
+        }
+    }
+    result.nodeCount = countNodes(distinct);
+    return result;
+}
+
+void HigherOrderDifferentiator::clearCache() {
+    differentiator.clearCache();
+    partials.clear();
+}
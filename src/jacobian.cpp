@@ -0,0 +1,89 @@
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+#include <unordered_set>
+
+#include "jacobian.hpp"
+#include "tokenizer.hpp"
+#include "expression_builder.hpp"
+
+using namespace autodiff;
+
+namespace {
+    std::string trim(const std::string& text) {
+        size_t begin = text.find_first_not_of(" \t\r");
+        if (begin == std::string::npos) {
+            return "";
+        }
+        size_t end = text.find_last_not_of(" \t\r");
+        return text.substr(begin, end - begin + 1);
+    }
+
+    bool validName(const std::string& name) {
+        if (name.empty() || !std::isalpha(static_cast<unsigned char>(name[0]))) {
+            return false;
+        }
+        return std::all_of(name.begin(), name.end(),
+                           [](char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_'; });
+    }
+}
+
+bool autodiff::readSystem(std::istream& in, ExpressionSystem& system) {
+    std::unordered_set<std::string> defined;
+    std::unordered_set<SymbolId> seen; // variables already in system.vars
+    std::string line;
+    size_t lineNumber = 0;
+    while (std::getline(in, line)) {
+        ++lineNumber;
+        if (trim(line).empty()) {
+            continue;
+        }
+        size_t equals = line.find('=');
+        std::string name = equals == std::string::npos ? "" : trim(line.substr(0, equals));
+        if (!validName(name)) {
+            std::cerr << "Error: Line " << lineNumber << ": expected name = expression" << std::endl;
+            return false;
+        }
+        if (!defined.insert(name).second) {
+            std::cerr << "Error: Line " << lineNumber << ": " << name << " is defined twice" << std::endl;
+            return false;
+        }
+        std::string expr = line.substr(equals + 1);
+        Tokenizer tokenizer(expr);
+        ExpressionBuilder builder(tokenizer);
+        ExprNodePtr output = builder.build();
+        if (!output) {
+            std::cerr << "Error: Line " << lineNumber << ": cannot parse " << name << std::endl;
+            return false;
+        }
+        system.names.push_back(name);
+        system.outputs.push_back(output);
+        for (SymbolId var : tokenizer.getVariables()) {
+            if (seen.insert(var).second) {
+                system.vars.push_back(var);
+            }
+        }
+    }
+    if (system.outputs.empty()) {
+        std::cerr << "Error: No expressions in the system" << std::endl;
+        return false;
+    }
+    sortByName(system.vars);
+    return true;
+}
+
+Jacobian JacobianBuilder::build(const std::vector<ExprNodePtr>& outputs, const std::vector<SymbolId>& vars) {
+    Jacobian result;
+    result.rows = outputs.size();
+    result.cols = vars.size();
+    result.entries.resize(result.rows * result.cols);
+    for (size_t col = 0; col < vars.size(); ++col) {
+        for (size_t row = 0; row < outputs.size(); ++row) {
+            result.entries[row * result.cols + col] = differentiator.differentiateCached(outputs[row], vars[col]);
+        }
+        differentiator.clearCache(); // no later column reads this one's derivatives
+    }
+    result.entries = simplifier.simplify(result.entries);
+    result.nodeCount = countNodes(result.entries);
+    return result;
+}
@@ -2,41 +2,607 @@
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <fstream>
+#include <thread>
+#include <memory>
 
 #include "expr_node.hpp"
 #include "tokenizer.hpp"
 #include "expression_builder.hpp"
 #include "differentiator.hpp"
+#include "reverse_differentiator.hpp"
 #include "tree_printer.hpp"
+#include "code_generator.hpp"
 #include "simplifier.hpp"
+#include "tape.hpp"
+#include "forward_evaluator.hpp"
+#include "higher_order.hpp"
+#include "canonicalizer.hpp"
+#include "stream_processor.hpp"
+#include "pipeline_stats.hpp"
+#include "graph_file.hpp"
+#include "jacobian.hpp"
+#include "sparsity.hpp"
+#include "checkpoint.hpp"
 
 using namespace autodiff;
 
-int main() {
-    std::string expr;
-    std::cout << "Enter an expression: ";
-    std::getline(std::cin, expr);
+// Parses "a=1,b=2.5" into name/value pairs.
+static bool parseBindings(const std::string& text, std::vector<std::pair<std::string, double>>& bindings) {
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find(',', start);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        std::string item = text.substr(start, end - start);
+        size_t eq = item.find('=');
+        if (eq == std::string::npos) {
+            return false;
+        }
+        try {
+            bindings.emplace_back(item.substr(0, eq), std::stod(item.substr(eq + 1)));
+        } catch (const std::exception&) {
+            return false;
+        }
+        start = end + 1;
+    }
+    return true;
+}
+
+static void printCacheStats(const DerivativeCache& cache) {
+    DerivativeCacheStats stats = cache.getStats();
+    std::cerr << "derivative cache: " << stats.hits << " hits, " << stats.misses << " misses, "
+              << stats.evictions << " evictions, " << stats.entries << " entries, " << stats.nodes << " nodes" << std::endl;
+}
+
+// Parses a byte count with an optional K, M or G suffix (powers of 1024).
+static bool parseBytes(const std::string& text, size_t& bytes) {
+    size_t end = 0;
+    try {
+        bytes = std::stoull(text, &end);
+    } catch (const std::exception&) {
+        return false;
+    }
+    std::string suffix = text.substr(end);
+    if (suffix == "K" || suffix == "k") {
+        bytes <<= 10;
+    } else if (suffix == "M" || suffix == "m") {
+        bytes <<= 20;
+    } else if (suffix == "G" || suffix == "g") {
+        bytes <<= 30;
+    } else if (!suffix.empty()) {
+        return false;
+    }
+    return true;
+}
+
+// Structural nonzeros, and their values when evaluated at a point, in COO or
+// CSR form after a few header lines naming the rows and columns.
+static void printSparse(const std::string& format, const std::vector<std::string>& rowNames,
+                        const std::vector<SymbolId>& vars, const SparsityPattern& pattern,
+                        const std::vector<std::uint32_t>& colors, const std::vector<double>& values) {
+    std::cout << "# rows:";
+    for (const std::string& name : rowNames) {
+        std::cout << " " << name;
+    }
+    std::cout << "\n# columns:";
+    for (SymbolId var : vars) {
+        std::cout << " " << symbolName(var);
+    }
+    std::cout << "\n# nonzeros: " << pattern.nonzeros() << " of " << pattern.rows * pattern.cols
+              << ", sweeps: " << colorCount(colors) << "\n";
+    if (format == "csr") {
+        printCsr(std::cout, pattern, values);
+    } else {
+        printCoo(std::cout, pattern, values);
+    }
+    std::cout << std::flush;
+}
+
+// Reads a system of named expressions and prints its Jacobian, evaluates it
+// at the bindings, or generates code for it.
+static int runSystem(const std::string& path, const std::vector<std::pair<std::string, double>>& bindings,
+                     bool evaluateAtPoint, bool shared, bool emitCode, const CodeOptions& codeOptions,
+                     const std::string& sparseFormat) {
+    std::ifstream file;
+    if (!path.empty() && path != "-") {
+        file.open(path);
+        if (!file) {
+            std::cerr << "Error: Cannot open " << path << std::endl;
+            return 1;
+        }
+    }
+    ExpressionSystem system;
+    if (!readSystem(file.is_open() ? static_cast<std::istream&>(file) : std::cin, system)) {
+        return 1;
+    }
+    Simplifier simplifier;
+    system.outputs = simplifier.simplify(system.outputs);
+    std::vector<double> inputs(system.vars.size(), 0.0);
+    for (const auto& binding : bindings) {
+        auto found = std::find(system.vars.begin(), system.vars.end(), internSymbol(binding.first));
+        if (found != system.vars.end()) {
+            inputs[found - system.vars.begin()] = binding.second;
+        }
+    }
+    if (!sparseFormat.empty()) {
+        SparsityPattern pattern = jacobianPattern(system.outputs, system.vars);
+        std::vector<std::uint32_t> colors = colorColumns(pattern);
+        std::vector<double> values;
+        if (evaluateAtPoint) {
+            values = sparseJacobian(system.outputs, system.vars, inputs, pattern, colors).values;
+        }
+        printSparse(sparseFormat, system.names, system.vars, pattern, colors, values);
+        return 0;
+    }
+    Jacobian jacobian = JacobianBuilder().build(system.outputs, system.vars);
+    const std::vector<SymbolId>& vars = system.vars;
+
+    if (evaluateAtPoint || emitCode) {
+        std::vector<ExprNodePtr> roots = system.outputs;
+        roots.insert(roots.end(), jacobian.entries.begin(), jacobian.entries.end());
+        Tape tape = TapeCompiler(vars).compile(roots);
+        if (emitCode) {
+            std::cout << CodeGenerator().generate(tape, vars, codeOptions);
+            return 0;
+        }
+        std::vector<double> values(roots.size());
+        tape.evaluate(inputs.data(), values.data());
+        for (size_t row = 0; row < jacobian.rows; ++row) {
+            std::cout << system.names[row] << ": " << values[row] << std::endl;
+        }
+        for (size_t row = 0; row < jacobian.rows; ++row) {
+            for (size_t col = 0; col < jacobian.cols; ++col) {
+                std::cout << system.names[row] << "," << symbolName(vars[col]) << ": "
+                          << values[jacobian.rows + row * jacobian.cols + col] << std::endl;
+            }
+        }
+        return 0;
+    }
+
+    TreePrinter printer;
+    if (shared) {
+        SharedPrint output = printer.printShared(jacobian.entries);
+        for (size_t i = 0; i < output.names.size(); ++i) {
+            std::cout << output.names[i] << " = " << output.definitions[i] << std::endl;
+        }
+        for (size_t i = 0; i < jacobian.entries.size(); ++i) {
+            std::cout << system.names[i / jacobian.cols] << "," << symbolName(vars[i % jacobian.cols]) << ": "
+                      << output.results[i] << std::endl;
+        }
+    } else {
+        for (size_t i = 0; i < jacobian.entries.size(); ++i) {
+            std::cout << system.names[i / jacobian.cols] << "," << symbolName(vars[i % jacobian.cols]) << ": ";
+            printer.print(jacobian.entries[i], std::cout);
+            std::cout << std::endl;
+        }
+    }
+    std::cerr << "nodes: " << jacobian.nodeCount << std::endl;
+    return 0;
+}
+
+// Prints the stage totals to stderr when main returns, whichever way it does.
+struct StatsReport {
+    PipelineStats* stats = nullptr;
+    bool json = false;
+
+    ~StatsReport() {
+        if (!stats) {
+            return;
+        }
+        setPipelineStats(nullptr);
+        if (json) {
+            stats->printJson(std::cerr);
+        } else {
+            stats->printText(std::cerr);
+        }
+    }
+};
+
+int main(int argc, char* argv[]) {
+    // --per-variable: differentiate once per variable instead of one reverse sweep
+    // --at a=1,b=2: print the value and gradient at a point instead of formulas
+    // --dual: with --at, use forward-mode dual numbers instead of symbolic derivatives
+    // --hessian: print the second partials (upper triangle) instead of the gradient,
+    //     or their values with --at
+    // --canonical: bring printed derivatives into canonical form, node counts go to stderr
+    // --cse: print subtrees repeated across the derivatives once, as t1 = ..., t2 = ...
+    // --emit-c: print C source for grad(in, out), out = value then gradient, in = sorted variables
+    // --emit-c-batch: the same plus grad_batch(in, out, n) over columns of n points
+    // --batch [file]: differentiate one expression per line of file (default stdin)
+    // --format text|tsv|json: output format for --batch
+    // --threads N: worker threads for --batch, 0 (default) for one per hardware thread
+    // --derivative-cache N: with --per-variable, reuse derivatives of small subexpressions
+    //     across variables and lines in a cache of at most N nodes; statistics go to stderr
+    // --stats [text|json]: time, node counts and depth per pipeline stage, to stderr
+    // --save file: also write the simplified value and gradient to a binary graph file
+    // --load file: take value and gradient from a graph file instead of an expression
+    // --system [file]: read "name = expression" lines (default stdin) and print their
+    //     Jacobian as name,variable: ...; works with --cse, --at and --emit-c, where the
+    //     outputs come first and the Jacobian follows row by row
+    // --sparse [coo|csr]: with --system or --hessian, print the structural nonzeros
+    //     found without differentiating, plus their values with --at, computed in one
+    //     forward sweep per color of the column (Jacobian) or star (Hessian) coloring
+    // --checkpoint bytes[K|M|G]: with --at, take the gradient by a numeric reverse sweep
+    //     over the value's tape in at most this much memory, recomputing from checkpoints;
+    //     the schedule and recompute factor go to stderr
+    bool perVariable = false;
+    bool evaluateAtPoint = false;
+    bool dual = false;
+    bool hessian = false;
+    bool canonical = false;
+    bool shared = false;
+    bool emitCode = false;
+    CodeOptions codeOptions;
+    bool batch = false;
+    std::string batchFile;
+    StreamOptions streamOptions;
+    unsigned threads = 0;
+    size_t cacheNodes = 0;
+    bool stats = false;
+    bool statsJson = false;
+    std::string savePath;
+    std::string loadPath;
+    bool system = false;
+    std::string systemFile;
+    std::string sparseFormat;
+    size_t checkpointBudget = 0;
+    std::vector<std::pair<std::string, double>> bindings;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--per-variable") {
+            perVariable = true;
+        } else if (arg == "--dual") {
+            dual = true;
+        } else if (arg == "--hessian") {
+            hessian = true;
+        } else if (arg == "--canonical") {
+            canonical = true;
+        } else if (arg == "--cse") {
+            shared = true;
+        } else if (arg == "--emit-c" || arg == "--emit-c-batch") {
+            emitCode = true;
+            codeOptions.batched = arg == "--emit-c-batch";
+        } else if (arg == "--batch") {
+            batch = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                batchFile = argv[++i];
+            }
+        } else if (arg == "--format" && i + 1 < argc) {
+            std::string format = argv[++i];
+            if (format == "text") {
+                streamOptions.format = OutputFormat::TEXT;
+            } else if (format == "tsv") {
+                streamOptions.format = OutputFormat::TSV;
+            } else if (format == "json") {
+                streamOptions.format = OutputFormat::JSON;
+            } else {
+                std::cerr << "Error: Unknown format " << format << std::endl;
+                return 1;
+            }
+        } else if (arg == "--threads" && i + 1 < argc) {
+            try {
+                threads = static_cast<unsigned>(std::stoul(argv[++i]));
+            } catch (const std::exception&) {
+                std::cerr << "Error: Invalid thread count " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--derivative-cache" && i + 1 < argc) {
+            try {
+                cacheNodes = std::stoul(argv[++i]);
+            } catch (const std::exception&) {
+                std::cerr << "Error: Invalid cache size " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--stats") {
+            stats = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                std::string format = argv[++i];
+                if (format != "text" && format != "json") {
+                    std::cerr << "Error: Unknown stats format " << format << std::endl;
+                    return 1;
+                }
+                statsJson = format == "json";
+            }
+        } else if (arg == "--save" && i + 1 < argc) {
+            savePath = argv[++i];
+        } else if (arg == "--load" && i + 1 < argc) {
+            loadPath = argv[++i];
+        } else if (arg == "--system") {
+            system = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                systemFile = argv[++i];
+            }
+        } else if (arg == "--checkpoint" && i + 1 < argc) {
+            if (!parseBytes(argv[++i], checkpointBudget) || checkpointBudget == 0) {
+                std::cerr << "Error: Invalid memory budget " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--sparse") {
+            sparseFormat = "coo";
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                sparseFormat = argv[++i];
+                if (sparseFormat != "coo" && sparseFormat != "csr") {
+                    std::cerr << "Error: Unknown sparse format " << sparseFormat << std::endl;
+                    return 1;
+                }
+            }
+        } else if (arg == "--at" && i + 1 < argc) {
+            evaluateAtPoint = true;
+            if (!parseBindings(argv[++i], bindings)) {
+                std::cerr << "Error: Invalid bindings " << argv[i] << std::endl;
+                return 1;
+            }
+        } else {
+            std::cerr << "Error: Unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    if (stats && !pipelineStatsAvailable()) {
+        std::cerr << "Error: --stats needs a build with AUTODIFF_STATS" << std::endl;
+        return 1;
+    }
+    PipelineStats pipelineStats;
+    StatsReport statsReport;
+    if (stats) {
+        setPipelineStats(&pipelineStats);
+        statsReport.stats = &pipelineStats;
+        statsReport.json = statsJson;
+    }
+
+    std::unique_ptr<DerivativeCache> cache;
+    if (cacheNodes > 0) {
+        cache.reset(new DerivativeCache(cacheNodes));
+    }
+
+    if (batch) {
+        if (evaluateAtPoint || dual || hessian || emitCode || !savePath.empty() || !loadPath.empty() || system
+            || !sparseFormat.empty() || checkpointBudget > 0) {
+            std::cerr << "Error: --at, --dual, --hessian, --emit-c, --save, --load, --system, --sparse and --checkpoint"
+                      << " are not supported with --batch" << std::endl;
+            return 1;
+        }
+        std::ios::sync_with_stdio(false);
+        streamOptions.perVariable = perVariable;
+        streamOptions.canonical = canonical;
+        streamOptions.shared = shared;
+        streamOptions.cache = cache.get();
+        std::ifstream file;
+        if (!batchFile.empty() && batchFile != "-") {
+            file.open(batchFile);
+            if (!file) {
+                std::cerr << "Error: Cannot open " << batchFile << std::endl;
+                return 1;
+            }
+        }
+        std::istream& input = file.is_open() ? static_cast<std::istream&>(file) : std::cin;
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        size_t failures = 0;
+        if (threads == 1) {
+            failures = StreamProcessor(streamOptions).run(input, std::cout);
+        } else {
+            failures = ParallelStreamProcessor(streamOptions, threads).run(input, std::cout);
+        }
+        if (cache) {
+            printCacheStats(*cache);
+        }
+        return failures == 0 ? 0 : 1;
+    }
+
+    if (system) {
+        if (hessian || dual || perVariable || canonical || !savePath.empty() || !loadPath.empty()
+            || checkpointBudget > 0) {
+            std::cerr << "Error: --system only works with --cse, --at and --emit-c" << std::endl;
+            return 1;
+        }
+        return runSystem(systemFile, bindings, evaluateAtPoint, shared, emitCode, codeOptions, sparseFormat);
+    }
+    if (!sparseFormat.empty() && (!hessian || dual || emitCode || !loadPath.empty())) {
+        std::cerr << "Error: --sparse works with --system or --hessian" << std::endl;
+        return 1;
+    }
 
-    Tokenizer tokenizer(expr);
-    std::vector<std::string> tokens = tokenizer.tokenize();
+    if (dual && (!evaluateAtPoint || hessian || emitCode)) {
+        std::cerr << "Error: --dual only works with --at when printing the gradient" << std::endl;
+        return 1;
+    }
+    if (checkpointBudget > 0 && (!evaluateAtPoint || dual || hessian || emitCode || !loadPath.empty())) {
+        std::cerr << "Error: --checkpoint only works with --at on an expression" << std::endl;
+        return 1;
+    }
+    if (!savePath.empty() && (evaluateAtPoint || hessian || emitCode)) {
+        std::cerr << "Error: --save only works when printing the gradient" << std::endl;
+        return 1;
+    }
 
-    ExpressionBuilder builder(tokens);
-    ExprNodePtr root = builder.build();
+    // A loaded file already holds the simplified value and gradient.
+    MappedGraph graph;
+    ExprNodePtr root = nullptr;
+    std::vector<SymbolId> vars;
+    std::vector<ExprNodePtr> derivatives;
+    if (!loadPath.empty()) {
+        if (!graph.open(loadPath)) {
+            return 1;
+        }
+        std::vector<ExprNodePtr> roots = graph.load(vars);
+        if (roots.empty()) {
+            return 1;
+        }
+        root = roots[0];
+        derivatives.assign(roots.begin() + 1, roots.end());
+    } else {
+        std::string expr;
+        if (!emitCode) { // keep generated source clean for redirection
+            std::cout << "Enter an expression: ";
+        }
+        std::getline(std::cin, expr);
+
+        Tokenizer tokenizer(expr);
+        if (stats) { // tokenize up front so that it is timed apart from parsing
+            root = ExpressionBuilder(tokenizer.tokenize()).build();
+        } else {
+            ExpressionBuilder builder(tokenizer);
+            root = builder.build();
+        }
+        if (!root) { // the builder has reported why
+            return 1;
+        }
+        vars = tokenizer.getVariables();
+        sortByName(vars);
+    }
 
     Simplifier simplifier;
-    root = simplifier.simplify(std::move(root));
-    Differentiator differentiator;
+    root = simplifier.simplify(root);
     TreePrinter printer;
 
-    std::vector<std::string> vars = tokenizer.getVariables();
-    std::sort(vars.begin(), vars.end());
+    std::vector<double> inputs(vars.size(), 0.0);
+    for (const auto& binding : bindings) {
+        auto found = std::find(vars.begin(), vars.end(), internSymbol(binding.first));
+        if (found != vars.end()) { // bindings for absent variables are ignored
+            inputs[found - vars.begin()] = binding.second;
+        }
+    }
+
+    if (hessian && !sparseFormat.empty()) {
+        SparsityPattern pattern = hessianPattern(root, vars);
+        std::vector<std::uint32_t> colors = starColor(pattern);
+        std::vector<double> values;
+        if (evaluateAtPoint) {
+            values = sparseHessian(root, vars, inputs, pattern, colors).values;
+        }
+        std::vector<std::string> rowNames;
+        for (SymbolId var : vars) {
+            rowNames.push_back(symbolName(var));
+        }
+        printSparse(sparseFormat, rowNames, vars, pattern, colors, values);
+        return 0;
+    }
+    if (hessian) {
+        HigherOrderDifferentiator higherOrder;
+        Hessian result = higherOrder.hessian(root, vars);
+        std::vector<ExprNodePtr> upper;
+        for (size_t i = 0; i < vars.size(); ++i) {
+            upper.insert(upper.end(), result.entries[i].begin() + i, result.entries[i].end());
+        }
+        std::vector<double> values(upper.size());
+        if (evaluateAtPoint) {
+            TapeCompiler(vars).compile(upper).evaluate(inputs.data(), values.data());
+        }
+        size_t k = 0;
+        for (size_t i = 0; i < vars.size(); ++i) {
+            for (size_t j = i; j < vars.size(); ++j, ++k) {
+                std::cout << symbolName(vars[i]) << "," << symbolName(vars[j]) << ": ";
+                if (evaluateAtPoint) {
+                    std::cout << values[k];
+                } else {
+                    printer.print(upper[k], std::cout);
+                }
+                std::cout << std::endl;
+            }
+        }
+        std::cerr << "nodes: " << result.nodeCount << std::endl;
+        return 0;
+    }
+
+    if (checkpointBudget > 0) {
+        Tape tape = TapeCompiler(vars).compile(root);
+        CheckpointedReverse reverse(tape, checkpointBudget);
+        std::vector<double> gradient(vars.size());
+        double value = 0.0;
+        if (!reverse.gradient(inputs.data(), value, gradient.data())) {
+            std::cerr << "Error: A memory budget of " << checkpointBudget << " bytes cannot hold the "
+                      << tape.numRegisters() << " registers" << std::endl;
+            return 1;
+        }
+        std::cout << "value: " << value << std::endl;
+        for (size_t i = 0; i < vars.size(); ++i) {
+            std::cout << symbolName(vars[i]) << ": " << gradient[i] << std::endl;
+        }
+        const CheckpointStats& stats = reverse.getStats();
+        std::cerr << "checkpoint: " << stats.instructions << " instructions in " << stats.chunks << " chunks of "
+                  << stats.chunkLength << ", " << stats.snapshotsUsed << " of " << stats.snapshots
+                  << " snapshots, recompute factor " << stats.recomputeFactor << ", peak " << stats.peakBytes
+                  << " bytes" << std::endl;
+        return 0;
+    }
+
+    if (dual) {
+        std::vector<double> values = forwardGradient(root, vars, inputs);
+        std::cout << "value: " << values[0] << std::endl;
+        for (size_t i = 0; i < vars.size(); ++i) {
+            std::cout << symbolName(vars[i]) << ": " << values[i + 1] << std::endl;
+        }
+        return 0;
+    }
+
+    if (loadPath.empty()) {
+        if (perVariable) {
+            Differentiator differentiator;
+            differentiator.setDerivativeCache(cache.get());
+            for (SymbolId var : vars) {
+                derivatives.push_back(differentiator.differentiate(root, var));
+            }
+            if (cache) {
+                printCacheStats(*cache);
+            }
+        } else {
+            ReverseDifferentiator reverse;
+            derivatives = reverse.gradient(root, vars);
+        }
+    }
+
+    if (evaluateAtPoint || emitCode) {
+        std::vector<ExprNodePtr> roots = { root };
+        for (ExprNodePtr diff : derivatives) {
+            roots.push_back(simplifier.simplify(diff));
+        }
+        Tape tape = TapeCompiler(vars).compile(roots);
+        if (emitCode) {
+            std::cout << CodeGenerator().generate(tape, vars, codeOptions);
+            return 0;
+        }
+        std::vector<double> values(roots.size());
+        tape.evaluate(inputs.data(), values.data());
+        std::cout << "value: " << values[0] << std::endl;
+        for (size_t i = 0; i < vars.size(); ++i) {
+            std::cout << symbolName(vars[i]) << ": " << values[i + 1] << std::endl;
+        }
+        return 0;
+    }
 
-    for (const std::string& var : vars) {
-        ExprNodePtr diff = differentiator.differentiate(root, var);
-        diff = simplifier.simplify(std::move(diff));
-        std::string derivativeExpr = printer.print(diff);
-        std::cout << var << ": " << derivativeExpr << std::endl;
+    Canonicalizer canonicalizer;
+    for (size_t i = 0; i < vars.size(); ++i) {
+        ExprNodePtr diff = simplifier.simplify(derivatives[i]);
+        if (canonical) {
+            diff = canonicalizer.canonicalize(diff);
+            const CanonicalizeStats& stats = canonicalizer.getLastStats();
+            std::cerr << symbolName(vars[i]) << ": nodes " << stats.nodesBefore << " -> " << stats.nodesAfter
+                      << " in " << stats.iterations << " iterations" << std::endl;
+        }
+        derivatives[i] = diff;
+    }
+    if (!savePath.empty() && !writeGraph(savePath, root, vars, derivatives)) {
+        return 1;
+    }
+    if (shared) {
+        SharedPrint output = printer.printShared(derivatives);
+        for (size_t i = 0; i < output.names.size(); ++i) {
+            std::cout << output.names[i] << " = " << output.definitions[i] << std::endl;
+        }
+        for (size_t i = 0; i < vars.size(); ++i) {
+            std::cout << symbolName(vars[i]) << ": " << output.results[i] << std::endl;
+        }
+        return 0;
+    }
+    for (size_t i = 0; i < vars.size(); ++i) {
+        std::cout << symbolName(vars[i]) << ": ";
+        printer.print(derivatives[i], std::cout);
+        std::cout << std::endl;
     }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,702 @@
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "number.hpp"
+
+using namespace autodiff;
+
+namespace {
+    // Exact powers beyond this many bits are left unfolded.
+    const size_t maxPowerBits = 4096;
+
+    std::int64_t gcd(std::int64_t a, std::int64_t b) {
+        // Works on magnitudes as unsigned so that INT64_MIN does not overflow.
+        std::uint64_t x = a < 0 ? 0 - static_cast<std::uint64_t>(a) : static_cast<std::uint64_t>(a);
+        std::uint64_t y = b < 0 ? 0 - static_cast<std::uint64_t>(b) : static_cast<std::uint64_t>(b);
+        while (y != 0) {
+            std::uint64_t t = x % y;
+            x = y;
+            y = t;
+        }
+        return static_cast<std::int64_t>(x);
+    }
+
+    std::uint64_t magnitude(std::int64_t value) {
+        return value < 0 ? 0 - static_cast<std::uint64_t>(value) : static_cast<std::uint64_t>(value);
+    }
+
+    // Magnitudes of wide values, in base 2^32 with the least significant
+    // digit first and no leading zero digits; zero is empty. Only what exact
+    // rational arithmetic needs, schoolbook throughout.
+    typedef std::vector<std::uint32_t> Digits;
+
+    void trim(Digits& a) {
+        while (!a.empty() && a.back() == 0) {
+            a.pop_back();
+        }
+    }
+
+    Digits digitsOf(std::uint64_t value) {
+        Digits result;
+        for (; value != 0; value >>= 32) {
+            result.push_back(static_cast<std::uint32_t>(value));
+        }
+        return result;
+    }
+
+    std::uint64_t lowWord(const Digits& a) {
+        std::uint64_t low = a.empty() ? 0 : a[0];
+        return a.size() > 1 ? low | static_cast<std::uint64_t>(a[1]) << 32 : low;
+    }
+
+    size_t bitLength(const Digits& a) {
+        return a.empty() ? 0 : 32 * (a.size() - 1) + (32 - __builtin_clz(a.back()));
+    }
+
+    bool isOneDigits(const Digits& a) {
+        return a.size() == 1 && a[0] == 1;
+    }
+
+    int compare(const Digits& a, const Digits& b) {
+        if (a.size() != b.size()) {
+            return a.size() < b.size() ? -1 : 1;
+        }
+        for (size_t i = a.size(); i-- > 0;) {
+            if (a[i] != b[i]) {
+                return a[i] < b[i] ? -1 : 1;
+            }
+        }
+        return 0;
+    }
+
+    Digits add(const Digits& a, const Digits& b) {
+        const Digits& longer = a.size() >= b.size() ? a : b;
+        const Digits& shorter = a.size() >= b.size() ? b : a;
+        Digits result(longer.size() + 1);
+        std::uint64_t carry = 0;
+        for (size_t i = 0; i < longer.size(); ++i) {
+            carry += static_cast<std::uint64_t>(longer[i]) + (i < shorter.size() ? shorter[i] : 0);
+            result[i] = static_cast<std::uint32_t>(carry);
+            carry >>= 32;
+        }
+        result.back() = static_cast<std::uint32_t>(carry);
+        trim(result);
+        return result;
+    }
+
+    // a - b for a >= b.
+    Digits subtract(const Digits& a, const Digits& b) {
+        Digits result(a.size());
+        std::uint64_t borrow = 0;
+        for (size_t i = 0; i < a.size(); ++i) {
+            std::uint64_t take = (i < b.size() ? b[i] : 0) + borrow;
+            borrow = a[i] < take;
+            result[i] = static_cast<std::uint32_t>((static_cast<std::uint64_t>(a[i]) + (borrow << 32)) - take);
+        }
+        trim(result);
+        return result;
+    }
+
+    Digits multiply(const Digits& a, const Digits& b) {
+        if (a.empty() || b.empty()) {
+            return Digits();
+        }
+        Digits result(a.size() + b.size(), 0);
+        for (size_t i = 0; i < a.size(); ++i) {
+            std::uint64_t carry = 0;
+            for (size_t j = 0; j < b.size(); ++j) {
+                carry += static_cast<std::uint64_t>(a[i]) * b[j] + result[i + j];
+                result[i + j] = static_cast<std::uint32_t>(carry);
+                carry >>= 32;
+            }
+            result[i + b.size()] = static_cast<std::uint32_t>(carry);
+        }
+        trim(result);
+        return result;
+    }
+
+    void multiplyAdd(Digits& a, std::uint32_t factor, std::uint32_t addend) {
+        std::uint64_t carry = addend;
+        for (std::uint32_t& digit : a) {
+            carry += static_cast<std::uint64_t>(digit) * factor;
+            digit = static_cast<std::uint32_t>(carry);
+            carry >>= 32;
+        }
+        if (carry != 0) {
+            a.push_back(static_cast<std::uint32_t>(carry));
+        }
+    }
+
+    // Divides a in place and returns the remainder.
+    std::uint32_t divideSmall(Digits& a, std::uint32_t divisor) {
+        std::uint64_t rest = 0;
+        for (size_t i = a.size(); i-- > 0;) {
+            std::uint64_t current = rest << 32 | a[i];
+            a[i] = static_cast<std::uint32_t>(current / divisor);
+            rest = current % divisor;
+        }
+        trim(a);
+        return static_cast<std::uint32_t>(rest);
+    }
+
+    Digits shiftLeft(const Digits& a, size_t bits) {
+        if (a.empty()) {
+            return Digits();
+        }
+        size_t words = bits / 32;
+        size_t rest = bits % 32;
+        Digits result(a.size() + words + 1, 0);
+        for (size_t i = 0; i < a.size(); ++i) {
+            std::uint64_t shifted = static_cast<std::uint64_t>(a[i]) << rest;
+            result[i + words] |= static_cast<std::uint32_t>(shifted);
+            result[i + words + 1] |= static_cast<std::uint32_t>(shifted >> 32);
+        }
+        trim(result);
+        return result;
+    }
+
+    Digits shiftRight(const Digits& a, size_t bits) {
+        size_t words = bits / 32;
+        size_t rest = bits % 32;
+        if (words >= a.size()) {
+            return Digits();
+        }
+        Digits result(a.size() - words);
+        for (size_t i = 0; i < result.size(); ++i) {
+            std::uint64_t pair = a[i + words];
+            if (i + words + 1 < a.size()) {
+                pair |= static_cast<std::uint64_t>(a[i + words + 1]) << 32;
+            }
+            result[i] = static_cast<std::uint32_t>(pair >> rest);
+        }
+        trim(result);
+        return result;
+    }
+
+    size_t trailingZeros(const Digits& a) { // a is not zero
+        size_t i = 0;
+        while (a[i] == 0) {
+            ++i;
+        }
+        return 32 * i + __builtin_ctz(a[i]);
+    }
+
+    // Binary gcd: shifts and subtractions only.
+    Digits gcd(Digits a, Digits b) {
+        if (a.empty() || b.empty()) {
+            return a.empty() ? b : a;
+        }
+        size_t shift = std::min(trailingZeros(a), trailingZeros(b));
+        a = shiftRight(a, trailingZeros(a));
+        b = shiftRight(b, trailingZeros(b));
+        while (true) { // both odd
+            int order = compare(a, b);
+            if (order == 0) {
+                break;
+            }
+            if (order < 0) {
+                a.swap(b);
+            }
+            a = subtract(a, b);
+            a = shiftRight(a, trailingZeros(a));
+        }
+        return shiftLeft(a, shift);
+    }
+
+    // a / b for b dividing a, one bit at a time.
+    Digits divideExact(const Digits& a, const Digits& b) {
+        if (b.size() == 1) {
+            Digits quotient = a;
+            divideSmall(quotient, b[0]);
+            return quotient;
+        }
+        Digits quotient(a.size(), 0);
+        Digits remainder;
+        for (size_t bit = bitLength(a); bit-- > 0;) {
+            remainder = shiftLeft(remainder, 1);
+            if (a[bit / 32] >> (bit % 32) & 1) {
+                if (remainder.empty()) {
+                    remainder.push_back(1);
+                } else {
+                    remainder[0] |= 1;
+                }
+            }
+            if (compare(remainder, b) >= 0) {
+                remainder = subtract(remainder, b);
+                quotient[bit / 32] |= std::uint32_t(1) << (bit % 32);
+            }
+        }
+        trim(quotient);
+        return quotient;
+    }
+
+    void appendDecimal(Digits a, std::string& out) {
+        std::vector<std::uint32_t> groups; // base 10^9, least significant first
+        do {
+            groups.push_back(divideSmall(a, 1000000000));
+        } while (!a.empty());
+        char buffer[16];
+        std::snprintf(buffer, sizeof(buffer), "%u", groups.back());
+        out += buffer;
+        for (size_t i = groups.size() - 1; i-- > 0;) {
+            std::snprintf(buffer, sizeof(buffer), "%09u", groups[i]);
+            out += buffer;
+        }
+    }
+
+    // n / d from the leading 64 bits of each, so that neither overflows a
+    // double on its own.
+    double quotient(const Digits& n, const Digits& d) {
+        size_t shiftN = bitLength(n) > 64 ? bitLength(n) - 64 : 0;
+        size_t shiftD = bitLength(d) > 64 ? bitLength(d) - 64 : 0;
+        double top = static_cast<double>(lowWord(shiftRight(n, shiftN)));
+        double bottom = static_cast<double>(lowWord(shiftRight(d, shiftD)));
+        return std::ldexp(top / bottom, static_cast<int>(shiftN) - static_cast<int>(shiftD));
+    }
+}
+
+namespace autodiff {
+    // An exact value whose numerator or denominator does not fit int64, in
+    // lowest terms once interned. Interned values are shared by every thread,
+    // compare by address and live as long as the process, like symbols.
+    struct WideRational {
+        bool negative = false;
+        Digits numerator;
+        Digits denominator{ 1 };
+        std::size_t hash = 0;
+        std::string text; // as printed
+    };
+}
+
+namespace {
+    const WideRational* intern(WideRational value) {
+        std::string key(1, value.negative ? '-' : '+');
+        std::uint64_t length = value.numerator.size();
+        key.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        key.append(reinterpret_cast<const char*>(value.numerator.data()), value.numerator.size() * sizeof(std::uint32_t));
+        key.append(reinterpret_cast<const char*>(value.denominator.data()),
+                   value.denominator.size() * sizeof(std::uint32_t));
+
+        static std::mutex mutex;
+        static std::unordered_map<std::string, std::unique_ptr<WideRational>> table;
+        std::lock_guard<std::mutex> lock(mutex);
+        auto [found, added] = table.try_emplace(key);
+        if (added) {
+            value.hash = std::hash<std::string>()(key);
+            if (value.negative) {
+                value.text += '-';
+            }
+            appendDecimal(value.numerator, value.text);
+            if (!isOneDigits(value.denominator)) {
+                value.text += '/';
+                appendDecimal(value.denominator, value.text);
+            }
+            found->second.reset(new WideRational(std::move(value)));
+        }
+        return found->second.get();
+    }
+
+    WideRational sum(const WideRational& a, const WideRational& b) {
+        Digits left = multiply(a.numerator, b.denominator);
+        Digits right = multiply(b.numerator, a.denominator);
+        WideRational result;
+        result.denominator = multiply(a.denominator, b.denominator);
+        if (a.negative == b.negative) {
+            result.negative = a.negative;
+            result.numerator = add(left, right);
+        } else if (compare(left, right) >= 0) {
+            result.negative = a.negative;
+            result.numerator = subtract(left, right);
+        } else {
+            result.negative = b.negative;
+            result.numerator = subtract(right, left);
+        }
+        return result;
+    }
+
+    WideRational product(const WideRational& a, const WideRational& b) {
+        WideRational result;
+        result.negative = a.negative != b.negative;
+        result.numerator = multiply(a.numerator, b.numerator);
+        result.denominator = multiply(a.denominator, b.denominator);
+        return result;
+    }
+}
+
+Number::Number() : kind(Kind::INTEGER), num(0), den(1) {}
+
+Number::Number(std::int64_t value) : kind(Kind::INTEGER), num(value), den(1) {}
+
+Number Number::rational(std::int64_t num, std::int64_t den) {
+    return normalize(num, den);
+}
+
+Number Number::real(double value) {
+    Number n;
+    n.kind = Kind::REAL;
+    n.den = 1;
+    n.realValue = value;
+    return n;
+}
+
+bool Number::parse(std::string_view token, Number& result) {
+    if (token.empty()) {
+        return false;
+    }
+    std::int64_t value;
+    auto parsed = std::from_chars(token.data(), token.data() + token.size(), value);
+    if (parsed.ec == std::errc() && parsed.ptr == token.data() + token.size()) {
+        result = Number(value);
+        return true;
+    }
+    // Integer literals out of int64 range stay exact.
+    size_t first = token[0] == '-' ? 1 : 0;
+    if (first < token.size() && std::all_of(token.begin() + first, token.end(), [](char c) {
+            return c >= '0' && c <= '9';
+        })) {
+        WideRational wide;
+        wide.negative = first == 1;
+        for (size_t i = first; i < token.size(); ++i) {
+            multiplyAdd(wide.numerator, 10, static_cast<std::uint32_t>(token[i] - '0'));
+        }
+        trim(wide.numerator);
+        result = fromWide(std::move(wide));
+        return true;
+    }
+    std::string text(token);
+    char* end = nullptr;
+    double real = std::strtod(text.c_str(), &end);
+    if (*end != '\0') {
+        return false;
+    }
+    result = Number::real(real);
+    return true;
+}
+
+Number::Kind Number::getKind() const {
+    return kind;
+}
+
+bool Number::isInteger() const {
+    return kind == Kind::INTEGER;
+}
+
+bool Number::isExact() const {
+    return kind != Kind::REAL;
+}
+
+bool Number::isWide() const {
+    return kind != Kind::REAL && den == 0;
+}
+
+bool Number::isZero() const {
+    return kind == Kind::REAL ? realValue == 0.0 : (den != 0 && num == 0);
+}
+
+bool Number::isOne() const {
+    return kind == Kind::REAL ? realValue == 1.0 : (num == 1 && den == 1);
+}
+
+bool Number::isNegative() const {
+    if (kind == Kind::REAL) {
+        return realValue < 0.0;
+    }
+    return den == 0 ? wide->negative : num < 0;
+}
+
+std::int64_t Number::getNumerator() const {
+    return num;
+}
+
+std::int64_t Number::getDenominator() const {
+    return den;
+}
+
+Number Number::numerator() const {
+    if (kind == Kind::REAL || den == 1) {
+        return *this;
+    }
+    if (den != 0) {
+        return Number(num);
+    }
+    WideRational result = *wide;
+    result.denominator = Digits{ 1 };
+    return fromWide(std::move(result));
+}
+
+Number Number::denominator() const {
+    if (kind == Kind::REAL || den != 0) {
+        return Number(kind == Kind::REAL ? 1 : den);
+    }
+    WideRational result;
+    result.numerator = wide->denominator;
+    return fromWide(std::move(result));
+}
+
+double Number::toDouble() const {
+    if (kind == Kind::REAL) {
+        return realValue;
+    }
+    if (den == 0) {
+        double magnitude = quotient(wide->numerator, wide->denominator);
+        return wide->negative ? -magnitude : magnitude;
+    }
+    return kind == Kind::INTEGER ? static_cast<double>(num) : static_cast<double>(num) / static_cast<double>(den);
+}
+
+std::string Number::toString() const {
+    std::string out;
+    appendTo(out);
+    return out;
+}
+
+void Number::appendTo(std::string& out) const {
+    if (isWide()) {
+        out += wide->text;
+        return;
+    }
+    char buffer[48];
+    char* end = buffer;
+    switch (kind) {
+        case Kind::INTEGER:
+            end = std::to_chars(buffer, buffer + sizeof(buffer), num).ptr;
+            break;
+        case Kind::RATIONAL:
+            end = std::to_chars(buffer, buffer + sizeof(buffer), num).ptr;
+            out.append(buffer, end - buffer);
+            out += '/';
+            end = std::to_chars(buffer, buffer + sizeof(buffer), den).ptr;
+            break;
+        case Kind::REAL:
+            // Shortest form that reads back to the same double.
+            std::snprintf(buffer, sizeof(buffer), "%.15g", realValue);
+            if (std::strtod(buffer, nullptr) != realValue) {
+                std::snprintf(buffer, sizeof(buffer), "%.17g", realValue);
+            }
+            end = buffer + std::strlen(buffer);
+            break;
+    }
+    out.append(buffer, end - buffer);
+}
+
+std::size_t Number::hash() const {
+    std::uint64_t h = static_cast<std::uint64_t>(kind) * 0x9e3779b97f4a7c15ULL;
+    if (kind == Kind::REAL) {
+        std::uint64_t bits;
+        std::memcpy(&bits, &realValue, sizeof(bits));
+        h ^= bits;
+    } else if (den == 0) {
+        h ^= static_cast<std::uint64_t>(wide->hash) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    } else {
+        h ^= static_cast<std::uint64_t>(num) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+        h ^= static_cast<std::uint64_t>(den) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return static_cast<std::size_t>(h);
+}
+
+bool Number::operator==(const Number& other) const {
+    if (kind != other.kind) {
+        return false;
+    }
+    if (kind == Kind::REAL) {
+        // Bitwise, so that hash-consing keeps 0.0 and -0.0 (and NaNs) apart consistently.
+        return std::memcmp(&realValue, &other.realValue, sizeof(double)) == 0;
+    }
+    if (den == 0 || other.den == 0) { // interned: equal values share one instance
+        return den == other.den && wide == other.wide;
+    }
+    return num == other.num && den == other.den;
+}
+
+bool Number::operator!=(const Number& other) const {
+    return !(*this == other);
+}
+
+Number Number::operator-() const {
+    if (kind == Kind::REAL) {
+        return real(-realValue);
+    }
+    std::int64_t negated;
+    if (den == 0 || __builtin_sub_overflow(static_cast<std::int64_t>(0), num, &negated)) {
+        WideRational result = widen(*this);
+        result.negative = !result.negative;
+        return fromWide(std::move(result));
+    }
+    return normalize(negated, den);
+}
+
+Number Number::operator+(const Number& other) const {
+    if (kind == Kind::REAL || other.kind == Kind::REAL) {
+        return real(toDouble() + other.toDouble());
+    }
+    if (den != 0 && other.den != 0) {
+        // a/b + c/d = (a*(d/g) + c*(b/g)) / (b*(d/g)) with g = gcd(b, d)
+        std::int64_t g = gcd(den, other.den);
+        std::int64_t left, right, sum, denominator;
+        if (!__builtin_mul_overflow(num, other.den / g, &left)
+            && !__builtin_mul_overflow(other.num, den / g, &right)
+            && !__builtin_add_overflow(left, right, &sum)
+            && !__builtin_mul_overflow(den, other.den / g, &denominator)) {
+            return normalize(sum, denominator);
+        }
+    }
+    return fromWide(::sum(widen(*this), widen(other)));
+}
+
+Number Number::operator-(const Number& other) const {
+    return *this + (-other);
+}
+
+Number Number::operator*(const Number& other) const {
+    if (kind == Kind::REAL || other.kind == Kind::REAL) {
+        return real(toDouble() * other.toDouble());
+    }
+    if (den != 0 && other.den != 0) {
+        // Cross-reduce first to keep the intermediate products small.
+        std::int64_t g1 = gcd(num, other.den);
+        std::int64_t g2 = gcd(other.num, den);
+        g1 = g1 == 0 ? 1 : g1;
+        g2 = g2 == 0 ? 1 : g2;
+        std::int64_t numerator, denominator;
+        if (!__builtin_mul_overflow(num / g1, other.num / g2, &numerator)
+            && !__builtin_mul_overflow(den / g2, other.den / g1, &denominator)) {
+            return normalize(numerator, denominator);
+        }
+    }
+    return fromWide(product(widen(*this), widen(other)));
+}
+
+Number Number::operator/(const Number& other) const {
+    if (other.isZero() || kind == Kind::REAL || other.kind == Kind::REAL) {
+        return real(toDouble() / other.toDouble());
+    }
+    return *this * other.reciprocal();
+}
+
+Number Number::abs() const {
+    return isNegative() ? -*this : *this;
+}
+
+Number Number::reciprocal() const {
+    if (kind == Kind::REAL || isZero()) {
+        return real(1.0 / toDouble());
+    }
+    if (den == 0) {
+        WideRational result = widen(*this);
+        result.numerator.swap(result.denominator);
+        return fromWide(std::move(result));
+    }
+    return normalize(den, num);
+}
+
+bool Number::pow(const Number& base, const Number& exponent, Number& result) {
+    if (base.kind == Kind::REAL || exponent.kind == Kind::REAL) {
+        result = real(std::pow(base.toDouble(), exponent.toDouble()));
+        return true;
+    }
+    if (!exponent.isInteger() || exponent.isWide() || (base.isZero() && exponent.isNegative())) {
+        return false;
+    }
+    std::int64_t e = exponent.num;
+    std::uint64_t remaining = magnitude(e);
+    // The result has at least (bits - 1) * |e| bits in its numerator or denominator.
+    WideRational parts = widen(base);
+    size_t bits = std::max(bitLength(parts.numerator), bitLength(parts.denominator));
+    if (bits > 1 && remaining > maxPowerBits / (bits - 1)) {
+        return false;
+    }
+    // Exponentiation by squaring.
+    Number acc(1);
+    Number square = base;
+    while (remaining > 0) {
+        if (remaining & 1) {
+            acc = acc * square;
+        }
+        remaining >>= 1;
+        if (remaining > 0) {
+            square = square * square;
+        }
+    }
+    result = e < 0 ? acc.reciprocal() : acc;
+    return true;
+}
+
+Number Number::normalize(std::int64_t num, std::int64_t den) {
+    if (den == 0) {
+        return real(static_cast<double>(num) / 0.0);
+    }
+    if (den < 0) {
+        if (num == std::numeric_limits<std::int64_t>::min() || den == std::numeric_limits<std::int64_t>::min()) {
+            WideRational result;
+            result.negative = num > 0;
+            result.numerator = digitsOf(magnitude(num));
+            result.denominator = digitsOf(magnitude(den));
+            return fromWide(std::move(result));
+        }
+        num = -num;
+        den = -den;
+    }
+    std::int64_t g = gcd(num, den);
+    if (g > 1) {
+        num /= g;
+        den /= g;
+    }
+    Number n;
+    n.num = num;
+    n.den = den;
+    n.kind = den == 1 ? Kind::INTEGER : Kind::RATIONAL;
+    return n;
+}
+
+WideRational Number::widen(const Number& number) {
+    if (number.den == 0) {
+        return *number.wide;
+    }
+    WideRational result;
+    result.negative = number.num < 0;
+    result.numerator = digitsOf(magnitude(number.num));
+    result.denominator = digitsOf(static_cast<std::uint64_t>(number.den));
+    return result;
+}
+
+Number Number::fromWide(WideRational value) {
+    if (value.denominator.empty()) {
+        double sign = value.numerator.empty() ? 0.0 : (value.negative ? -1.0 : 1.0);
+        return real(sign / 0.0);
+    }
+    if (value.numerator.empty()) {
+        return Number(0);
+    }
+    Digits g = gcd(value.numerator, value.denominator);
+    if (!isOneDigits(g)) {
+        value.numerator = divideExact(value.numerator, g);
+        value.denominator = divideExact(value.denominator, g);
+    }
+    Number n;
+    n.kind = isOneDigits(value.denominator) ? Kind::INTEGER : Kind::RATIONAL;
+    std::uint64_t top = lowWord(value.numerator);
+    bool fits = bitLength(value.numerator) <= 63
+        || (value.negative && bitLength(value.numerator) == 64 && top == std::uint64_t(1) << 63);
+    if (fits && bitLength(value.denominator) <= 63) {
+        n.num = value.negative ? static_cast<std::int64_t>(0 - top) : static_cast<std::int64_t>(top);
+        n.den = static_cast<std::int64_t>(lowWord(value.denominator));
+        return n;
+    }
+    value.hash = 0;
+    value.text.clear();
+    n.den = 0;
+    n.wide = intern(std::move(value));
+    return n;
+}
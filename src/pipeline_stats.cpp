@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <utility>
+
+#include "pipeline_stats.hpp"
+
+using namespace autodiff;
+
+#ifdef AUTODIFF_STATS
+std::atomic<PipelineStats*> autodiff::detail::activeStats{ nullptr };
+
+void StageTimer::start(Stage stage, const std::vector<ExprNodePtr>& inputs) {
+    outermost = true;
+    event.stage = stage;
+    if (!inputs.empty()) {
+        event.nodesBefore = countNodes(inputs);
+        if (stage == Stage::PRINT) {
+            event.depth = maxDepth(inputs);
+        }
+    }
+    poolBefore = ExprPool::current().size();
+    begin = std::chrono::steady_clock::now();
+}
+
+void StageTimer::stop(const std::vector<ExprNodePtr>& results, size_t length) {
+    event.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    size_t poolAfter = ExprPool::current().size();
+    event.allocations = poolAfter > poolBefore ? poolAfter - poolBefore : 0;
+    event.length = length;
+    if (!results.empty()) {
+        event.nodesAfter = countNodes(results);
+        event.depth = maxDepth(results);
+    }
+    stats->record(event);
+}
+#endif
+
+const char* autodiff::stageName(Stage stage) {
+    switch (stage) {
+        case Stage::TOKENIZE:
+            return "tokenize";
+        case Stage::PARSE:
+            return "parse";
+        case Stage::SIMPLIFY:
+            return "simplify";
+        case Stage::DIFFERENTIATE:
+            return "differentiate";
+        case Stage::CANONICALIZE:
+            return "canonicalize";
+        case Stage::PRINT:
+            return "print";
+        case Stage::COUNT:
+            break;
+    }
+    return "";
+}
+
+PipelineStats::PipelineStats(Callback callback) : callback(std::move(callback)) {}
+
+void PipelineStats::record(const StageEvent& event) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        StageTotals& total = totals[static_cast<size_t>(event.stage)];
+        ++total.calls;
+        total.seconds += event.seconds;
+        total.nodesBefore += event.nodesBefore;
+        total.nodesAfter += event.nodesAfter;
+        total.length += event.length;
+        total.allocations += event.allocations;
+        total.maxDepth = std::max(total.maxDepth, event.depth);
+    }
+    if (callback) {
+        callback(event);
+    }
+}
+
+StageTotals PipelineStats::getTotals(Stage stage) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return totals[static_cast<size_t>(stage)];
+}
+
+void PipelineStats::printText(std::ostream& out) const {
+    out << std::left << std::setw(14) << "stage" << std::right << std::setw(8) << "calls" << std::setw(12) << "ms"
+        << std::setw(12) << "nodes in" << std::setw(12) << "nodes out" << std::setw(12) << "allocated"
+        << std::setw(10) << "depth" << std::setw(12) << "tok/chars" << std::endl;
+    for (size_t i = 0; i < totals.size(); ++i) {
+        StageTotals total = getTotals(static_cast<Stage>(i));
+        if (total.calls == 0) {
+            continue;
+        }
+        out << std::left << std::setw(14) << stageName(static_cast<Stage>(i)) << std::right << std::setw(8)
+            << total.calls << std::setw(12) << std::fixed << std::setprecision(3) << total.seconds * 1e3
+            << std::defaultfloat << std::setw(12) << total.nodesBefore << std::setw(12) << total.nodesAfter
+            << std::setw(12) << total.allocations << std::setw(10) << total.maxDepth << std::setw(12)
+            << total.length << std::endl;
+    }
+}
+
+void PipelineStats::printJson(std::ostream& out) const {
+    out << "{";
+    bool first = true;
+    for (size_t i = 0; i < totals.size(); ++i) {
+        StageTotals total = getTotals(static_cast<Stage>(i));
+        if (total.calls == 0) {
+            continue;
+        }
+        out << (first ? "" : ",") << "\"" << stageName(static_cast<Stage>(i)) << "\":{\"calls\":" << total.calls
+            << ",\"seconds\":" << total.seconds << ",\"nodes_before\":" << total.nodesBefore
+            << ",\"nodes_after\":" << total.nodesAfter << ",\"allocations\":" << total.allocations
+            << ",\"max_depth\":" << total.maxDepth << ",\"length\":" << total.length << "}";
+        first = false;
+    }
+    out << "}" << std::endl;
+}
+
+void autodiff::setPipelineStats(PipelineStats* stats) {
+#ifdef AUTODIFF_STATS
+    detail::activeStats.store(stats, std::memory_order_release);
+#else
+    (void)stats;
+#endif
+}
+
+bool autodiff::pipelineStatsAvailable() {
+#ifdef AUTODIFF_STATS
+    return true;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,213 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <utility>
+
+#include "reverse_differentiator.hpp"
+#include "pipeline_stats.hpp"
+
+using namespace autodiff;
+
+std::vector<ExprNodePtr> ReverseDifferentiator::gradient(ExprNodePtr expr, const std::vector<SymbolId>& vars) {
+    resetTable(adjoints);
+    if (!expr) {
+        return std::vector<ExprNodePtr>(vars.size(), nullptr); // as differentiate does
+    }
+    std::vector<ExprNodePtr> result;
+    result.reserve(vars.size());
+    StageTimer timer(Stage::DIFFERENTIATE, expr);
+    wanted = 0;
+    for (SymbolId var : vars) {
+        wanted |= variableBit(var);
+    }
+
+    // Parents come after their children, so walking backwards visits every
+    // node only once all of its uses have contributed to its adjoint.
+    std::vector<ExprNodePtr> order = topologicalOrder(expr);
+    adjoints[expr] = buildNumber(1);
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+        auto found = adjoints.find(*it);
+        if (found != adjoints.end()) {
+            propagate(*it, found->second);
+        }
+    }
+
+    for (SymbolId var : vars) {
+        auto found = adjoints.find(buildVariable(var));
+        result.push_back(found != adjoints.end() ? found->second : buildNumber(0));
+    }
+    timer.finish(result);
+    return result;
+}
+
+std::vector<ExprNodePtr> ReverseDifferentiator::topologicalOrder(ExprNodePtr expr) const {
+    std::vector<ExprNodePtr> order;
+    std::unordered_set<ExprNodePtr> visited;
+    std::vector<std::pair<ExprNodePtr, bool>> stack; // (node, children already pushed)
+    stack.emplace_back(expr, false);
+    while (!stack.empty()) {
+        auto [node, expanded] = stack.back();
+        stack.pop_back();
+        if (expanded) {
+            order.push_back(node);
+            continue;
+        }
+        if (!visited.insert(node).second) {
+            continue;
+        }
+        stack.emplace_back(node, true);
+        // Subtrees without any wanted variable never receive an adjoint.
+        if (node->right && needed(node->right)) {
+            stack.emplace_back(node->right, false);
+        }
+        if (node->left && needed(node->left)) {
+            stack.emplace_back(node->left, false);
+        }
+    }
+    return order;
+}
+
+void ReverseDifferentiator::propagate(ExprNodePtr node, ExprNodePtr adjoint) {
+    switch (node->type) {
+        case NodeType::NUMBER:
+        case NodeType::VARIABLE:
+            return;
+        case NodeType::OPERATOR:
+            propagateOperator(node, adjoint);
+            return;
+        case NodeType::FUNCTION:
+            propagateFunction(node, adjoint);
+            return;
+        default:
+            std::cerr << "Error: Unknown NodeType in propagate" << std::endl;
+            return;
+    }
+}
+
+void ReverseDifferentiator::propagateOperator(ExprNodePtr node, ExprNodePtr adjoint) {
+    ExprNodePtr u = node->left;
+    ExprNodePtr v = node->right;
+    bool toU = needed(u); // operands constant in every wanted variable get no adjoint
+    bool toV = v && needed(v);
+    switch (node->opType) {
+        case OperatorType::ADD: // du += a, dv += a
+            if (toU) {
+                accumulate(u, adjoint);
+            }
+            if (toV) {
+                accumulate(v, adjoint);
+            }
+            return;
+        case OperatorType::SUB: // du += a, dv -= a
+            if (toU) {
+                accumulate(u, adjoint);
+            }
+            if (toV) {
+                accumulate(v, adjoint, true);
+            }
+            return;
+        case OperatorType::MUL: // du += a*v, dv += a*u
+            if (toU) {
+                accumulate(u, scale(adjoint, v));
+            }
+            if (toV) {
+                accumulate(v, scale(adjoint, u));
+            }
+            return;
+        case OperatorType::DIV: // du += a/v, dv -= a*u/v^2
+            if (toU) {
+                accumulate(u, buildOperator(OperatorType::DIV, adjoint, v));
+            }
+            if (toV) {
+                accumulate(v, scale(adjoint, buildOperator(OperatorType::DIV, u,
+                    buildOperator(OperatorType::POW, v, buildNumber(2)))), true);
+            }
+            return;
+        case OperatorType::POW: // du += a*v*u^(v-1), dv += a*ln(u)*u^v
+            if (toU) {
+                accumulate(u, scale(adjoint, buildOperator(OperatorType::MUL, v,
+                    buildOperator(OperatorType::POW, u, buildOperator(OperatorType::SUB, v, buildNumber(1))))));
+            }
+            if (toV) {
+                accumulate(v, scale(adjoint, buildOperator(OperatorType::MUL,
+                    buildFunction(FunctionType::LN, u), node)));
+            }
+            return;
+        default:
+            std::cerr << "Error: Unknown OperatorType in propagateOperator" << std::endl;
+            return;
+    }
+}
+
+void ReverseDifferentiator::propagateFunction(ExprNodePtr node, ExprNodePtr adjoint) {
+    ExprNodePtr u = node->left;
+    ExprNodePtr v = node->right;
+    bool toU = needed(u); // operands constant in every wanted variable get no adjoint
+    bool toV = v && needed(v);
+    switch (node->funcType) {
+        case FunctionType::LN: // du += a/u
+            accumulate(u, scale(adjoint, buildOperator(OperatorType::DIV, buildNumber(1), u)));
+            return;
+        case FunctionType::LOG: { // log(u, v) = ln(v)/ln(u)
+            ExprNodePtr lnU = buildFunction(FunctionType::LN, u);
+            // du -= a*ln(v)/(u*ln(u)^2), dv += a/(v*ln(u))
+            if (toU) {
+                accumulate(u, scale(adjoint, buildOperator(OperatorType::DIV, buildFunction(FunctionType::LN, v),
+                    buildOperator(OperatorType::MUL, u,
+                        buildOperator(OperatorType::POW, lnU, buildNumber(2))))), true);
+            }
+            if (toV) {
+                accumulate(v, scale(adjoint, buildOperator(OperatorType::DIV, buildNumber(1),
+                    buildOperator(OperatorType::MUL, v, lnU))));
+            }
+            return;
+        }
+        case FunctionType::COS: // du += a*(-1*sin(u))
+            accumulate(u, scale(adjoint, buildOperator(OperatorType::MUL, buildNumber(-1),
+                buildFunction(FunctionType::SIN, u))));
+            return;
+        case FunctionType::SIN: // du += a*cos(u)
+            accumulate(u, scale(adjoint, buildFunction(FunctionType::COS, u)));
+            return;
+        case FunctionType::TAN: // du += a*(1/cos(u)^2)
+            accumulate(u, scale(adjoint, buildOperator(OperatorType::DIV, buildNumber(1),
+                buildOperator(OperatorType::POW, buildFunction(FunctionType::COS, u), buildNumber(2)))));
+            return;
+        case FunctionType::EXP: // du += a*exp(u)
+            accumulate(u, scale(adjoint, node));
+            return;
+        case FunctionType::POW_FUNC: // same rule as u^v
+            if (toU) {
+                accumulate(u, scale(adjoint, buildOperator(OperatorType::MUL, v,
+                    buildOperator(OperatorType::POW, u, buildOperator(OperatorType::SUB, v, buildNumber(1))))));
+            }
+            if (toV) {
+                accumulate(v, scale(adjoint, buildOperator(OperatorType::MUL,
+                    buildFunction(FunctionType::LN, u), node)));
+            }
+            return;
+        default:
+            std::cerr << "Error: Unknown FunctionType in propagateFunction" << std::endl;
+            return;
+    }
+}
+
+void ReverseDifferentiator::accumulate(ExprNodePtr node, ExprNodePtr contribution, bool negate) {
+    auto found = adjoints.find(node);
+    if (found == adjoints.end()) {
+        adjoints.emplace(node, negate
+            ? buildOperator(OperatorType::MUL, buildNumber(-1), contribution)
+            : contribution);
+        return;
+    }
+    found->second = buildOperator(negate ? OperatorType::SUB : OperatorType::ADD, found->second, contribution);
+}
+
+ExprNodePtr ReverseDifferentiator::scale(ExprNodePtr adjoint, ExprNodePtr factor) const {
+    // The seed adjoint is 1; skipping the multiplication keeps the outputs small.
+    if (adjoint->type == NodeType::NUMBER && adjoint->number.isOne()) {
+        return factor;
+    }
+    return buildOperator(OperatorType::MUL, adjoint, factor);
+}
@@ -1,9 +1,10 @@
 #include <iostream>
-#include <cmath>
-#include <string>
+#include <utility>
+#include <vector>
 
 #include "simplifier.hpp"
 #include "expr_node.hpp"
+#include "pipeline_stats.hpp"
 
 using namespace autodiff;
 
@@ -11,135 +12,179 @@ ExprNodePtr Simplifier::simplify(ExprNodePtr node) {
     if (!node) {
         return nullptr;
     }
-    return simplifyNode(std::move(node));
+    StageTimer timer(Stage::SIMPLIFY, node);
+    resetTable(memo);
+    return timer.finish(simplifyNode(node));
+}
+
+std::vector<ExprNodePtr> Simplifier::simplify(const std::vector<ExprNodePtr>& nodes) {
+    StageTimer timer(Stage::SIMPLIFY, nodes);
+    resetTable(memo);
+    std::vector<ExprNodePtr> results;
+    results.reserve(nodes.size());
+    for (ExprNodePtr node : nodes) {
+        results.push_back(simplifyNode(node));
+    }
+    return timer.finish(results);
 }
 
 ExprNodePtr Simplifier::simplifyNode(ExprNodePtr node) {
     if (!node) {
         return nullptr;
     }
-    node->left = simplifyNode(std::move(node->left));
-    node->right = simplifyNode(std::move(node->right));
+    auto cached = memo.find(node);
+    if (cached != memo.end()) {
+        return cached->second;
+    }
+    // Explicit post-order walk: children are simplified before their parent,
+    // whatever the nesting depth.
+    std::vector<std::pair<ExprNodePtr, bool>> stack; // (node, children already pushed)
+    stack.emplace_back(node, false);
+    while (!stack.empty()) {
+        auto [top, expanded] = stack.back();
+        if (memo.count(top)) {
+            stack.pop_back();
+            continue;
+        }
+        if (expanded) {
+            stack.pop_back();
+            memo.emplace(top, simplifyUncached(top));
+            continue;
+        }
+        stack.back().second = true;
+        if (top->right) {
+            stack.emplace_back(top->right, false);
+        }
+        if (top->left) {
+            stack.emplace_back(top->left, false);
+        }
+    }
+    return memo.at(node);
+}
 
+// Children are already in memo.
+ExprNodePtr Simplifier::simplifyUncached(ExprNodePtr node) {
+    ExprNodePtr left = node->left ? memo.at(node->left) : nullptr;
+    ExprNodePtr right = node->right ? memo.at(node->right) : nullptr;
+
+    ExprNodePtr result;
     switch (node->type) {
         case NodeType::OPERATOR:
             switch (node->opType) {
                 case OperatorType::ADD:
-                    return simplifyAdd(std::move(node));
+                    result = simplifyAdd(node, left, right);
+                    break;
                 case OperatorType::SUB:
-                    return simplifySub(std::move(node));
+                    result = simplifySub(node, left, right);
+                    break;
                 case OperatorType::MUL:
-                    return simplifyMul(std::move(node));
+                    result = simplifyMul(node, left, right);
+                    break;
                 case OperatorType::DIV:
-                    return simplifyDiv(std::move(node));
+                    result = simplifyDiv(node, left, right);
+                    break;
                 case OperatorType::POW:
-                    return simplifyPow(std::move(node));
+                    result = simplifyPow(node, left, right);
+                    break;
                 default:
-                    return node;
+                    result = rebuild(node, left, right);
+                    break;
             }
             break;
         default:
-            return node;
+            result = rebuild(node, left, right);
+            break;
     }
+    return result;
 }
 
-ExprNodePtr Simplifier::simplifyAdd(ExprNodePtr node) {
-    ExprNodePtr& left = node->left;
-    ExprNodePtr& right = node->right;
+ExprNodePtr Simplifier::simplifyAdd(ExprNodePtr node, ExprNodePtr left, ExprNodePtr right) {
     if (isZero(left)) { // 0 + x = x
-        return std::move(right);
+        return right;
     }
     if (isZero(right)) { // x + 0 = x
-        return std::move(left);
+        return left;
     }
     if (left->type == NodeType::NUMBER && right->type == NodeType::NUMBER) {
-        double leftValue = std::stod(left->value);
-        double rightValue = std::stod(right->value);
-        return buildNumber(std::to_string(leftValue + rightValue));
+        return buildNumber(left->number + right->number);
     }
-    return node;
+    return rebuild(node, left, right);
 }
 
-ExprNodePtr Simplifier::simplifySub(ExprNodePtr node) {
-    ExprNodePtr& left = node->left;
-    ExprNodePtr& right = node->right;
-    if (isZero(left)) { // 0 - x = -x
-        double value = std::stod(right->value);
-        return buildNumber(std::to_string(-value));
+ExprNodePtr Simplifier::simplifySub(ExprNodePtr node, ExprNodePtr left, ExprNodePtr right) {
+    if (isZero(left) && right->type == NodeType::NUMBER) { // 0 - x = -x
+        return buildNumber(-right->number);
     }
     if (isZero(right)) { // x - 0 = x
-        return std::move(left);
+        return left;
     }
     if (left->type == NodeType::NUMBER && right->type == NodeType::NUMBER) {
-        double leftValue = std::stod(left->value);
-        double rightValue = std::stod(right->value);
-        return buildNumber(std::to_string(leftValue - rightValue));
+        return buildNumber(left->number - right->number);
     }
-    return node;
+    return rebuild(node, left, right);
 }
 
-ExprNodePtr Simplifier::simplifyMul(ExprNodePtr node) {
-    ExprNodePtr& left = node->left;
-    ExprNodePtr& right = node->right;
+ExprNodePtr Simplifier::simplifyMul(ExprNodePtr node, ExprNodePtr left, ExprNodePtr right) {
     if (isZero(left) || isZero(right)) { // 0 * x = 0 or x * 0 = 0
-        return buildNumber("0");
+        return buildNumber(0);
     }
     if (isOne(left)) { // 1 * x = x
-        return std::move(right);
+        return right;
     }
     if (isOne(right)) { // x * 1 = x
-        return std::move(left);
+        return left;
     }
     if (left->type == NodeType::NUMBER && right->type == NodeType::NUMBER) {
-        double leftValue = std::stod(left->value);
-        double rightValue = std::stod(right->value);
-        return buildNumber(std::to_string(leftValue * rightValue));
+        return buildNumber(left->number * right->number);
     }
-    return node;
+    return rebuild(node, left, right);
 }
 
-ExprNodePtr Simplifier::simplifyDiv(ExprNodePtr node) {
-    ExprNodePtr& left = node->left;
-    ExprNodePtr& right = node->right;
+ExprNodePtr Simplifier::simplifyDiv(ExprNodePtr node, ExprNodePtr left, ExprNodePtr right) {
     if (isZero(left)) { // 0 / x = 0
-        return buildNumber("0");
+        return buildNumber(0);
     }
     if (isOne(right)) { // x / 1 = x
-        return std::move(left);
+        return left;
     }
-    if (left->type == NodeType::NUMBER && right->type == NodeType::NUMBER) {
-        double leftValue = std::stod(left->value);
-        double rightValue = std::stod(right->value);
-        return buildNumber(std::to_string(leftValue / rightValue));
+    if (left->type == NodeType::NUMBER && right->type == NodeType::NUMBER && !right->number.isZero()) {
+        return buildNumber(left->number / right->number); // stays exact, e.g. 1/3
     }
-    return node;
+    return rebuild(node, left, right);
 }
 
-ExprNodePtr Simplifier::simplifyPow(ExprNodePtr node) {
-    ExprNodePtr& left = node->left;
-    ExprNodePtr& right = node->right;
+ExprNodePtr Simplifier::simplifyPow(ExprNodePtr node, ExprNodePtr left, ExprNodePtr right) {
     if (isZero(right)) { // x^0 = 1
-        return buildNumber("1");
+        return buildNumber(1);
     }
     if (isOne(right)) { // x^1 = x
-        return std::move(left);
+        return left;
     }
-    if (left->type == NodeType::NUMBER && right->type == NodeType::NUMBER) {
-        double leftValue = std::stod(left->value);
-        double rightValue = std::stod(right->value);
-        return buildNumber(std::to_string(std::pow(leftValue, rightValue)));
+    Number value;
+    if (left->type == NodeType::NUMBER && right->type == NodeType::NUMBER
+        && Number::pow(left->number, right->number, value)) { // 2^(1/2) is left symbolic
+        return buildNumber(value);
     }
-    return node;
+    return rebuild(node, left, right);
 }
 
-bool Simplifier::isNumberNode(const ExprNodePtr& expr, const std::string& value) const {
-    return expr->type == NodeType::NUMBER && expr->value == value;
+ExprNodePtr Simplifier::rebuild(ExprNodePtr node, ExprNodePtr left, ExprNodePtr right) const {
+    if (left == node->left && right == node->right) { // nothing changed below
+        return node;
+    }
+    if (node->type == NodeType::OPERATOR) {
+        return buildOperator(node->opType, left, right);
+    }
+    if (right) {
+        return buildFunction(node->funcType, left, right);
+    }
+    return buildFunction(node->funcType, left);
 }
 
-bool Simplifier::isZero(const ExprNodePtr& expr) const {
-    return isNumberNode(expr, "0");
+bool Simplifier::isZero(ExprNodePtr expr) const {
+    return expr->type == NodeType::NUMBER && expr->number.isZero();
 }
 
-bool Simplifier::isOne(const ExprNodePtr& expr) const {
-    return isNumberNode(expr, "1");
-}
\ No newline at end of file
+bool Simplifier::isOne(ExprNodePtr expr) const {
+    return expr->type == NodeType::NUMBER && expr->number.isOne();
+}
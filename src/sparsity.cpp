@@ -0,0 +1,498 @@
+#include <algorithm>
+#include <deque>
+#include <numeric>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+#include "sparsity.hpp"
+#include "forward_evaluator.hpp"
+#include "reverse_differentiator.hpp"
+#include "simplifier.hpp"
+
+using namespace autodiff;
+
+namespace {
+    const std::uint32_t unbound = static_cast<std::uint32_t>(-1);
+    const std::uint32_t uncolored = static_cast<std::uint32_t>(-1);
+
+    // The positions in vars of the variables below each node, computed once
+    // per node in a post-order walk from its children's. A node whose set is
+    // one of its children's shares it, and with up to 64 variables sets are
+    // built and shared by their bit mask.
+    class VariableSets {
+    public:
+        VariableSets(const std::vector<SymbolId>& vars) : singletons(vars.size(), 0), small(vars.size() <= 64) {
+            for (size_t i = 0; i < vars.size(); ++i) {
+                if (vars[i] >= indexOf.size()) {
+                    indexOf.resize(vars[i] + 1, unbound);
+                }
+                indexOf[vars[i]] = static_cast<std::uint32_t>(i);
+            }
+            sets.emplace_back(); // 0: no variables
+            masks.push_back(0);
+        }
+
+        // Sorted and free of duplicates; stays valid while the object lives.
+        const std::vector<std::uint32_t>& of(ExprNodePtr root) {
+            return sets[setOf(root)];
+        }
+
+    private:
+        std::vector<std::uint32_t> indexOf; // symbol id -> position in vars
+        std::vector<std::uint32_t> singletons; // position in vars -> its set, 0 until needed
+        bool small;
+        std::deque<std::vector<std::uint32_t>> sets; // deque: references survive growth
+        std::vector<VariableMask> masks;             // of each set, by position in vars, when small
+        std::unordered_map<VariableMask, std::uint32_t> byMask;
+        std::unordered_map<ExprNodePtr, std::uint32_t> known; // node -> its set
+
+        std::uint32_t setOf(ExprNodePtr root) {
+            if (!root || root->dependencies == 0) {
+                return 0;
+            }
+            auto found = known.find(root);
+            if (found != known.end()) {
+                return found->second;
+            }
+            std::vector<std::pair<ExprNodePtr, bool>> stack; // (node, children already pushed)
+            stack.emplace_back(root, false);
+            while (!stack.empty()) {
+                auto [node, expanded] = stack.back();
+                if (known.count(node)) {
+                    stack.pop_back();
+                    continue;
+                }
+                if (expanded) {
+                    stack.pop_back();
+                    known.emplace(node, unite(childSet(node->left), childSet(node->right)));
+                    continue;
+                }
+                if (node->type == NodeType::VARIABLE) {
+                    stack.pop_back();
+                    known.emplace(node, variableSet(node->symbol));
+                    continue;
+                }
+                stack.back().second = true;
+                if (node->right && node->right->dependencies) {
+                    stack.emplace_back(node->right, false);
+                }
+                if (node->left && node->left->dependencies) {
+                    stack.emplace_back(node->left, false);
+                }
+            }
+            return known.at(root);
+        }
+
+        std::uint32_t childSet(ExprNodePtr child) const {
+            return child && child->dependencies ? known.at(child) : 0;
+        }
+
+        std::uint32_t variableSet(SymbolId symbol) {
+            std::uint32_t index = symbol < indexOf.size() ? indexOf[symbol] : unbound;
+            if (index == unbound) {
+                return 0;
+            }
+            if (singletons[index] == 0) {
+                singletons[index] = add({ index }, small ? VariableMask(1) << index : 0);
+            }
+            return singletons[index];
+        }
+
+        std::uint32_t unite(std::uint32_t a, std::uint32_t b) {
+            if (a == b || b == 0) {
+                return a;
+            }
+            if (a == 0) {
+                return b;
+            }
+            if (small) {
+                VariableMask mask = masks[a] | masks[b];
+                if (mask == masks[a]) {
+                    return a;
+                }
+                if (mask == masks[b]) {
+                    return b;
+                }
+                auto found = byMask.find(mask);
+                if (found != byMask.end()) {
+                    return found->second;
+                }
+                std::vector<std::uint32_t> set;
+                for (VariableMask rest = mask; rest; rest &= rest - 1) {
+                    set.push_back(static_cast<std::uint32_t>(__builtin_ctzll(rest)));
+                }
+                return add(std::move(set), mask);
+            }
+            std::vector<std::uint32_t> set;
+            std::set_union(sets[a].begin(), sets[a].end(), sets[b].begin(), sets[b].end(), std::back_inserter(set));
+            if (set.size() == sets[a].size()) {
+                return a;
+            }
+            if (set.size() == sets[b].size()) {
+                return b;
+            }
+            return add(std::move(set), 0);
+        }
+
+        std::uint32_t add(std::vector<std::uint32_t> set, VariableMask mask) {
+            std::uint32_t id = static_cast<std::uint32_t>(sets.size());
+            sets.push_back(std::move(set));
+            masks.push_back(mask);
+            if (small) {
+                byMask.emplace(mask, id);
+            }
+            return id;
+        }
+    };
+
+    SparsityPattern fromRows(std::vector<std::vector<std::uint32_t>>& rows, size_t cols) {
+        SparsityPattern pattern;
+        pattern.rows = rows.size();
+        pattern.cols = cols;
+        pattern.rowStart.reserve(rows.size() + 1);
+        pattern.rowStart.push_back(0);
+        for (std::vector<std::uint32_t>& row : rows) {
+            std::sort(row.begin(), row.end());
+            row.erase(std::unique(row.begin(), row.end()), row.end());
+            pattern.columns.insert(pattern.columns.end(), row.begin(), row.end());
+            pattern.rowStart.push_back(pattern.columns.size());
+        }
+        return pattern;
+    }
+
+    // Every variable of a against every variable of b, in both directions.
+    // Returns the number of entries added.
+    size_t addCross(std::vector<std::vector<std::uint32_t>>& rows, const std::vector<std::uint32_t>& a,
+                    const std::vector<std::uint32_t>& b) {
+        for (std::uint32_t i : a) {
+            rows[i].insert(rows[i].end(), b.begin(), b.end());
+        }
+        for (std::uint32_t j : b) {
+            rows[j].insert(rows[j].end(), a.begin(), a.end());
+        }
+        return 2 * a.size() * b.size();
+    }
+
+    std::vector<std::uint32_t> merged(const std::vector<std::uint32_t>& a, const std::vector<std::uint32_t>& b) {
+        std::vector<std::uint32_t> result;
+        std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(result));
+        return result;
+    }
+
+    bool isConstant(ExprNodePtr node, int value) {
+        return node->type == NodeType::NUMBER && node->number == Number(value);
+    }
+
+    // Vertices by decreasing degree; ties keep their index order.
+    std::vector<std::uint32_t> largestFirst(const std::vector<size_t>& degree) {
+        std::vector<std::uint32_t> order(degree.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(),
+                         [&degree](std::uint32_t a, std::uint32_t b) { return degree[a] > degree[b]; });
+        return order;
+    }
+
+    std::uint32_t firstFree(const std::vector<std::uint32_t>& forbidden, std::uint32_t vertex) {
+        std::uint32_t color = 0;
+        while (color < forbidden.size() && forbidden[color] == vertex) {
+            ++color;
+        }
+        return color;
+    }
+
+    // Seeds every variable in the lane of its color and sweeps roots forward,
+    // N colors per pass. compressed[r * numColors + c] receives the sum of
+    // the partials of roots[r] over the variables colored c.
+    template <size_t N>
+    void sweepColors(const std::vector<ExprNodePtr>& roots, const std::vector<SymbolId>& vars,
+                     const std::vector<double>& values, const std::vector<std::uint32_t>& colors, size_t numColors,
+                     std::vector<double>& compressed) {
+        ForwardEvaluator<N> evaluator(vars);
+        compressed.assign(roots.size() * numColors, 0.0);
+        std::vector<size_t> lanes(vars.size());
+        for (size_t first = 0; first < numColors; first += N) {
+            for (size_t i = 0; i < vars.size(); ++i) {
+                lanes[i] = colors[i] >= first && colors[i] < first + N ? colors[i] - first : N;
+            }
+            std::vector<Dual<N>> results = evaluator.evaluate(roots, values, lanes);
+            for (size_t r = 0; r < roots.size(); ++r) {
+                for (size_t lane = 0; lane < N && first + lane < numColors; ++lane) {
+                    compressed[r * numColors + first + lane] = results[r].tangent[lane];
+                }
+            }
+        }
+    }
+
+    void sweepColors(const std::vector<ExprNodePtr>& roots, const std::vector<SymbolId>& vars,
+                     const std::vector<double>& values, const std::vector<std::uint32_t>& colors,
+                     std::vector<double>& compressed) {
+        size_t numColors = colorCount(colors);
+        if (numColors <= 1) {
+            sweepColors<1>(roots, vars, values, colors, numColors, compressed);
+        } else if (numColors <= 2) {
+            sweepColors<2>(roots, vars, values, colors, numColors, compressed);
+        } else if (numColors <= 4) {
+            sweepColors<4>(roots, vars, values, colors, numColors, compressed);
+        } else {
+            sweepColors<8>(roots, vars, values, colors, numColors, compressed);
+        }
+    }
+}
+
+SparsityPattern autodiff::jacobianPattern(const std::vector<ExprNodePtr>& outputs, const std::vector<SymbolId>& vars) {
+    VariableSets sets(vars);
+    std::vector<std::vector<std::uint32_t>> rows;
+    rows.reserve(outputs.size());
+    for (ExprNodePtr output : outputs) {
+        rows.push_back(sets.of(output));
+    }
+    return fromRows(rows, vars.size());
+}
+
+SparsityPattern autodiff::hessianPattern(ExprNodePtr expr, const std::vector<SymbolId>& vars) {
+    VariableSets sets(vars);
+    auto variablesOf = [&sets](ExprNodePtr node) -> const std::vector<std::uint32_t>& { return sets.of(node); };
+
+    // Second derivatives only arise where a node is nonlinear in its
+    // arguments; sums pass them on unchanged, so the pattern is the union of
+    // what every node of the graph contributes locally.
+    std::vector<std::vector<std::uint32_t>> rows(vars.size());
+    size_t entries = 0; // in rows, duplicates included
+    size_t kept = 0;    // after the last deduplication
+    std::vector<ExprNodePtr> stack = { expr };
+    std::unordered_set<ExprNodePtr> visited;
+    while (!stack.empty()) {
+        ExprNodePtr node = stack.back();
+        stack.pop_back();
+        if (!node || node->dependencies == 0 || !visited.insert(node).second) {
+            continue;
+        }
+        if (node->type == NodeType::VARIABLE || node->type == NodeType::NUMBER) {
+            continue;
+        }
+        stack.push_back(node->left);
+        stack.push_back(node->right);
+
+        ExprNodePtr left = node->left;
+        ExprNodePtr right = node->right;
+        if (node->type == NodeType::OPERATOR) {
+            switch (node->opType) {
+                case OperatorType::ADD:
+                case OperatorType::SUB:
+                    break;
+                case OperatorType::MUL:
+                    if (left->dependencies && right->dependencies) {
+                        entries += addCross(rows, variablesOf(left), variablesOf(right));
+                    }
+                    break;
+                case OperatorType::DIV:
+                    if (right->dependencies) {
+                        entries += addCross(rows, variablesOf(left), variablesOf(right));
+                        entries += addCross(rows, variablesOf(right), variablesOf(right));
+                    }
+                    break;
+                case OperatorType::POW:
+                    if (right->dependencies) {
+                        std::vector<std::uint32_t> all = merged(variablesOf(left), variablesOf(right));
+                        entries += addCross(rows, all, all);
+                    } else if (!isConstant(right, 0) && !isConstant(right, 1)) {
+                        entries += addCross(rows, variablesOf(left), variablesOf(left));
+                    }
+                    break;
+                default:
+                    break;
+            }
+        } else if (right && right->dependencies) { // log(b, u) and pow(u, v) with a varying second argument
+            std::vector<std::uint32_t> all = merged(variablesOf(left), variablesOf(right));
+            entries += addCross(rows, all, all);
+        } else if (node->funcType != FunctionType::POW_FUNC || (!isConstant(right, 0) && !isConstant(right, 1))) {
+            entries += addCross(rows, variablesOf(left), variablesOf(left));
+        }
+
+        // A block that many nodes contribute would otherwise be stored once per node.
+        if (entries > 2 * kept + (1 << 20)) {
+            kept = 0;
+            for (auto& row : rows) {
+                std::sort(row.begin(), row.end());
+                row.erase(std::unique(row.begin(), row.end()), row.end());
+                kept += row.size();
+            }
+            entries = kept;
+        }
+    }
+    return fromRows(rows, vars.size());
+}
+
+std::vector<std::uint32_t> autodiff::colorColumns(const SparsityPattern& jacobian) {
+    // Rows of each column, and the cost of its neighbourhood as the degree.
+    std::vector<std::vector<std::uint32_t>> rowsOf(jacobian.cols);
+    std::vector<size_t> degree(jacobian.cols, 0);
+    for (size_t r = 0; r < jacobian.rows; ++r) {
+        size_t length = jacobian.rowStart[r + 1] - jacobian.rowStart[r];
+        for (size_t k = jacobian.rowStart[r]; k < jacobian.rowStart[r + 1]; ++k) {
+            rowsOf[jacobian.columns[k]].push_back(static_cast<std::uint32_t>(r));
+            degree[jacobian.columns[k]] += length - 1;
+        }
+    }
+
+    std::vector<std::uint32_t> colors(jacobian.cols, uncolored);
+    std::vector<std::uint32_t> forbidden; // forbidden[c] == j while coloring column j
+    for (std::uint32_t j : largestFirst(degree)) {
+        for (std::uint32_t r : rowsOf[j]) {
+            for (size_t k = jacobian.rowStart[r]; k < jacobian.rowStart[r + 1]; ++k) {
+                std::uint32_t other = colors[jacobian.columns[k]];
+                if (other != uncolored) {
+                    if (other >= forbidden.size()) {
+                        forbidden.resize(other + 1, uncolored);
+                    }
+                    forbidden[other] = j;
+                }
+            }
+        }
+        colors[j] = firstFree(forbidden, j);
+    }
+    return colors;
+}
+
+std::vector<std::uint32_t> autodiff::starColor(const SparsityPattern& hessian) {
+    size_t n = hessian.rows;
+    auto begin = [&hessian](std::uint32_t v) { return hessian.columns.begin() + hessian.rowStart[v]; };
+    auto end = [&hessian](std::uint32_t v) { return hessian.columns.begin() + hessian.rowStart[v + 1]; };
+    std::vector<size_t> degree(n);
+    for (size_t v = 0; v < n; ++v) {
+        degree[v] = hessian.rowStart[v + 1] - hessian.rowStart[v];
+    }
+
+    // Gebremedhin, Manne and Pothen's greedy star coloring: besides the
+    // neighbours' colors, v may not take the color of a vertex x two steps
+    // away through w when w is still uncolored, or when x already has a
+    // neighbour of w's color other than w, since either would leave a
+    // two-colored path on four vertices. Counting every vertex's colored
+    // neighbours by color answers the latter without scanning x's row.
+    std::vector<std::uint32_t> colors(n, uncolored);
+    std::unordered_map<std::uint64_t, std::uint32_t> neighboursOfColor; // (vertex << 32 | color) -> count
+    auto colored = [&neighboursOfColor](std::uint32_t x, std::uint32_t color) -> std::uint32_t {
+        auto found = neighboursOfColor.find(static_cast<std::uint64_t>(x) << 32 | color);
+        return found != neighboursOfColor.end() ? found->second : 0;
+    };
+    std::vector<std::uint32_t> forbidden;
+    auto forbid = [&forbidden](std::uint32_t color, std::uint32_t v) {
+        if (color >= forbidden.size()) {
+            forbidden.resize(color + 1, uncolored);
+        }
+        forbidden[color] = v;
+    };
+    for (std::uint32_t v : largestFirst(degree)) {
+        for (auto w = begin(v); w != end(v); ++w) {
+            if (*w != v && colors[*w] != uncolored) {
+                forbid(colors[*w], v);
+            }
+        }
+        for (auto w = begin(v); w != end(v); ++w) {
+            if (*w == v) {
+                continue;
+            }
+            for (auto x = begin(*w); x != end(*w); ++x) {
+                if (*x == v || *x == *w || colors[*x] == uncolored) {
+                    continue;
+                }
+                if (colors[*w] == uncolored || colored(*x, colors[*w]) > 1) { // w counts itself once
+                    forbid(colors[*x], v);
+                }
+            }
+        }
+        colors[v] = firstFree(forbidden, v);
+        for (auto w = begin(v); w != end(v); ++w) {
+            if (*w != v) {
+                ++neighboursOfColor[static_cast<std::uint64_t>(*w) << 32 | colors[v]];
+            }
+        }
+    }
+    return colors;
+}
+
+size_t autodiff::colorCount(const std::vector<std::uint32_t>& colors) {
+    std::uint32_t highest = 0;
+    for (std::uint32_t color : colors) {
+        highest = std::max(highest, color + 1);
+    }
+    return highest;
+}
+
+SparseMatrix autodiff::sparseJacobian(const std::vector<ExprNodePtr>& outputs, const std::vector<SymbolId>& vars,
+                                      const std::vector<double>& values, const SparsityPattern& pattern,
+                                      const std::vector<std::uint32_t>& colors) {
+    std::vector<double> compressed;
+    sweepColors(outputs, vars, values, colors, compressed);
+    size_t numColors = colorCount(colors);
+    SparseMatrix result{ pattern, std::vector<double>(pattern.nonzeros()) };
+    for (size_t r = 0; r < pattern.rows; ++r) {
+        for (size_t k = pattern.rowStart[r]; k < pattern.rowStart[r + 1]; ++k) {
+            result.values[k] = compressed[r * numColors + colors[pattern.columns[k]]];
+        }
+    }
+    return result;
+}
+
+SparseMatrix autodiff::sparseHessian(ExprNodePtr expr, const std::vector<SymbolId>& vars,
+                                     const std::vector<double>& values, const SparsityPattern& pattern,
+                                     const std::vector<std::uint32_t>& colors) {
+    std::vector<ExprNodePtr> gradient = Simplifier().simplify(ReverseDifferentiator().gradient(expr, vars));
+    std::vector<double> compressed; // row i, color c: the Hessian-vector product of color c at i
+    sweepColors(gradient, vars, values, colors, compressed);
+    size_t numColors = colorCount(colors);
+
+    // An entry (i, j) is alone in row i among the neighbours of color
+    // colors[j], or else j's row is where it stands alone in colors[i].
+    SparseMatrix result{ pattern, std::vector<double>(pattern.nonzeros()) };
+    std::vector<std::uint32_t> tally(numColors, 0);
+    for (size_t i = 0; i < pattern.rows; ++i) {
+        for (size_t k = pattern.rowStart[i]; k < pattern.rowStart[i + 1]; ++k) {
+            ++tally[colors[pattern.columns[k]]];
+        }
+        for (size_t k = pattern.rowStart[i]; k < pattern.rowStart[i + 1]; ++k) {
+            std::uint32_t j = pattern.columns[k];
+            if (tally[colors[j]] == 1) {
+                result.values[k] = compressed[i * numColors + colors[j]];
+            } else {
+                result.values[k] = compressed[j * numColors + colors[i]];
+            }
+        }
+        for (size_t k = pattern.rowStart[i]; k < pattern.rowStart[i + 1]; ++k) {
+            tally[colors[pattern.columns[k]]] = 0;
+        }
+    }
+    return result;
+}
+
+void autodiff::printCoo(std::ostream& out, const SparsityPattern& pattern, const std::vector<double>& values) {
+    for (size_t r = 0; r < pattern.rows; ++r) {
+        for (size_t k = pattern.rowStart[r]; k < pattern.rowStart[r + 1]; ++k) {
+            out << r << " " << pattern.columns[k];
+            if (!values.empty()) {
+                out << " " << values[k];
+            }
+            out << "\n";
+        }
+    }
+}
+
+void autodiff::printCsr(std::ostream& out, const SparsityPattern& pattern, const std::vector<double>& values) {
+    out << "row_start:";
+    for (size_t start : pattern.rowStart) {
+        out << " " << start;
+    }
+    out << "\ncolumns:";
+    for (std::uint32_t column : pattern.columns) {
+        out << " " << column;
+    }
+    out << "\n";
+    if (!values.empty()) {
+        out << "values:";
+        for (double value : values) {
+            out << " " << value;
+        }
+        out << "\n";
+    }
+}
@@ -0,0 +1,291 @@
+#include <cstdio>
+
+#include "stream_processor.hpp"
+
+using namespace autodiff;
+
+namespace {
+    const size_t flushThreshold = 1 << 16;
+    const size_t chunkLines = 64; // lines per parallel task
+    const size_t splitNodes = 2000; // expressions this large get one task per variable
+
+    void appendLineNumber(size_t lineNumber, std::string& out) {
+        char digits[24];
+        int length = std::snprintf(digits, sizeof(digits), "%zu", lineNumber);
+        out.append(digits, length);
+    }
+
+    // Drops a trailing '\r' so CRLF input reads like LF input.
+    bool readLine(std::istream& in, std::string& line) {
+        if (!std::getline(in, line)) {
+            return false;
+        }
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        return true;
+    }
+
+    bool isBlank(const std::string& line) {
+        return line.find_first_not_of(" \t") == std::string::npos;
+    }
+}
+
+StreamProcessor::StreamProcessor(const StreamOptions& options, ThreadPool* pool)
+    : options(options), pool(pool), tokenizer(std::string_view()), builder(tokenizer) {}
+
+StreamProcessor::Scratch& StreamProcessor::threadScratch() {
+    static thread_local Scratch scratch;
+    return scratch;
+}
+
+bool StreamProcessor::process(std::string_view expr, size_t lineNumber, std::string& out) {
+    // Nothing from the previous line is referenced any more.
+    ExprPool::current().clear();
+
+    tokenizer.reset(expr);
+    ExprNodePtr root = builder.build();
+    if (!root) {
+        appendError(expr, lineNumber, out);
+        return false;
+    }
+    Scratch& scratch = threadScratch();
+    root = scratch.simplifier.simplify(root);
+
+    std::vector<SymbolId> vars = tokenizer.getVariables();
+    sortByName(vars);
+    if (!options.perVariable) {
+        derivatives = scratch.reverse.gradient(root, vars);
+    }
+    // Derivatives are printed straight into out, in order, unless they have
+    // to be finished first: by other workers, or all together for the bindings.
+    bool split = pool && !options.shared && vars.size() > 1 && countNodes(root) >= splitNodes;
+    texts.resize(vars.size());
+    if (split) {
+        // Other workers only read root and derivatives, which stay in this
+        // thread's pool, and intern whatever they build into their own.
+        TaskGroup group;
+        for (size_t i = 0; i < vars.size(); ++i) {
+            pool->submit(group, [this, root, &vars, i] {
+                texts[i].clear();
+                threadScratch().printer.print(derive(root, vars[i], i), texts[i]);
+            });
+        }
+        pool->wait(group);
+    } else if (options.shared) {
+        finished.resize(vars.size());
+        for (size_t i = 0; i < vars.size(); ++i) {
+            finished[i] = derive(root, vars[i], i);
+        }
+        bindings = scratch.printer.printShared(finished);
+        texts.swap(bindings.results);
+    }
+
+    if (options.format == OutputFormat::JSON) {
+        out += "{\"line\":";
+        appendLineNumber(lineNumber, out);
+        out += ",\"expression\":";
+        appendJsonString(expr, out);
+        if (options.shared) {
+            out += ",\"bindings\":{";
+            for (size_t i = 0; i < bindings.names.size(); ++i) {
+                if (i > 0) {
+                    out += ',';
+                }
+                appendJsonString(bindings.names[i], out);
+                out += ':';
+                appendJsonString(bindings.definitions[i], out);
+            }
+            out += '}';
+        }
+        out += ",\"derivatives\":{";
+    } else {
+        for (size_t i = 0; i < bindings.names.size(); ++i) {
+            if (options.format == OutputFormat::TSV) {
+                appendLineNumber(lineNumber, out);
+                out += '\t';
+                out += bindings.names[i];
+                out += '\t';
+            } else {
+                out += bindings.names[i];
+                out += " = ";
+            }
+            out += bindings.definitions[i];
+            out += '\n';
+        }
+    }
+    for (size_t i = 0; i < vars.size(); ++i) {
+        const std::string& name = symbolName(vars[i]);
+        switch (options.format) {
+            case OutputFormat::TEXT:
+                out += name;
+                out += ": ";
+                break;
+            case OutputFormat::TSV:
+                appendLineNumber(lineNumber, out);
+                out += '\t';
+                out += name;
+                out += '\t';
+                break;
+            case OutputFormat::JSON:
+                if (i > 0) {
+                    out += ',';
+                }
+                appendJsonString(name, out);
+                out += ":\""; // printed expressions have nothing to escape
+                break;
+        }
+        if (split || options.shared) {
+            out += texts[i];
+        } else {
+            scratch.printer.print(derive(root, vars[i], i), out);
+        }
+        out += options.format == OutputFormat::JSON ? '"' : '\n';
+    }
+    if (options.format == OutputFormat::JSON) {
+        out += "}}\n";
+    } else if (options.format == OutputFormat::TEXT) {
+        out += '\n';
+    }
+    return true;
+}
+
+// The final form of one derivative; may run on any thread.
+ExprNodePtr StreamProcessor::derive(ExprNodePtr root, SymbolId var, size_t index) {
+    Scratch& scratch = threadScratch();
+    scratch.differentiator.setDerivativeCache(options.cache);
+    ExprNodePtr diff = options.perVariable ? scratch.differentiator.differentiate(root, var) : derivatives[index];
+    diff = scratch.simplifier.simplify(diff);
+    if (options.canonical) {
+        diff = scratch.canonicalizer.canonicalize(diff);
+    }
+    return diff;
+}
+
+// The parser has already explained the problem on stderr.
+void StreamProcessor::appendError(std::string_view expr, size_t lineNumber, std::string& out) const {
+    switch (options.format) {
+        case OutputFormat::TEXT:
+            break;
+        case OutputFormat::TSV:
+            appendLineNumber(lineNumber, out);
+            out += "\t\terror\n";
+            break;
+        case OutputFormat::JSON:
+            out += "{\"line\":";
+            appendLineNumber(lineNumber, out);
+            out += ",\"expression\":";
+            appendJsonString(expr, out);
+            out += ",\"error\":\"parse error\"}\n";
+            break;
+    }
+}
+
+size_t StreamProcessor::run(std::istream& in, std::ostream& out) {
+    std::string line;
+    std::string buffer;
+    buffer.reserve(flushThreshold * 2);
+    size_t lineNumber = 0;
+    size_t failures = 0;
+    while (readLine(in, line)) {
+        ++lineNumber;
+        if (isBlank(line)) {
+            continue;
+        }
+        if (!process(line, lineNumber, buffer)) {
+            ++failures;
+        }
+        if (buffer.size() >= flushThreshold) {
+            out.write(buffer.data(), buffer.size());
+            buffer.clear();
+        }
+    }
+    out.write(buffer.data(), buffer.size());
+    out.flush();
+    return failures;
+}
+
+ParallelStreamProcessor::ParallelStreamProcessor(const StreamOptions& options, size_t numThreads)
+    : pool(numThreads) {
+    for (size_t i = 0; i < pool.size(); ++i) {
+        processors.emplace_back(new StreamProcessor(options, &pool));
+    }
+}
+
+// Chunks go round a ring: the reader refills the oldest slot once its output
+// has been written, so at most ring.size() chunks are held in memory.
+size_t ParallelStreamProcessor::run(std::istream& in, std::ostream& out) {
+    std::vector<std::unique_ptr<Chunk>> ring;
+    for (size_t i = 0; i < 4 * pool.size(); ++i) {
+        ring.emplace_back(new Chunk());
+    }
+    size_t submitted = 0;
+    size_t written = 0;
+    size_t lineNumber = 0;
+    size_t failures = 0;
+    auto writeOldest = [&]() {
+        Chunk& chunk = *ring[written % ring.size()];
+        pool.wait(chunk.done);
+        out.write(chunk.output.data(), chunk.output.size());
+        failures += chunk.failures;
+        ++written;
+    };
+
+    bool more = true;
+    while (more) {
+        if (submitted - written == ring.size()) {
+            writeOldest();
+        }
+        Chunk& chunk = *ring[submitted % ring.size()];
+        chunk.lines.resize(chunkLines);
+        size_t count = 0;
+        while (count < chunkLines && readLine(in, chunk.lines[count])) {
+            ++count;
+        }
+        more = count == chunkLines;
+        if (count == 0) {
+            break;
+        }
+        chunk.lines.resize(count);
+        chunk.firstLine = lineNumber + 1;
+        lineNumber += count;
+        chunk.output.clear();
+        chunk.failures = 0;
+        pool.submit(chunk.done, [this, &chunk] {
+            StreamProcessor& processor = *processors[pool.currentWorker()];
+            for (size_t i = 0; i < chunk.lines.size(); ++i) {
+                if (!isBlank(chunk.lines[i]) && !processor.process(chunk.lines[i], chunk.firstLine + i, chunk.output)) {
+                    ++chunk.failures;
+                }
+            }
+        });
+        ++submitted;
+    }
+    while (written < submitted) {
+        writeOldest();
+    }
+    out.flush();
+    return failures;
+}
+
+void autodiff::appendJsonString(std::string_view text, std::string& out) {
+    out += '"';
+    for (char c : text) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned char>(c));
+                    out += escaped;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    out += '"';
+}
@@ -0,0 +1,76 @@
+#include <algorithm>
+#include <iostream>
+#include <cstdlib>
+
+#include "symbol_table.hpp"
+
+using namespace autodiff;
+
+namespace {
+    // FNV-1a, the same function ExprNode uses for its payload.
+    std::size_t hashName(std::string_view s) {
+        std::uint64_t h = 1469598103934665603ULL;
+        for (char c : s) {
+            h ^= static_cast<unsigned char>(c);
+            h *= 1099511628211ULL;
+        }
+        return static_cast<std::size_t>(h);
+    }
+}
+
+SymbolId SymbolTable::intern(std::string_view name) {
+    std::string key(name); // names are short, so this normally stays in the small-string buffer
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = ids.find(key);
+    if (found != ids.end()) {
+        return found->second;
+    }
+    SymbolId id = count.load(std::memory_order_relaxed);
+    std::size_t chunk = id >> chunkBits;
+    if (chunk >= maxChunks) {
+        std::cerr << "Error: Too many symbols in SymbolTable" << std::endl;
+        std::abort();
+    }
+    if (!chunks[chunk]) {
+        chunks[chunk].reset(new Symbol[chunkSize]);
+    }
+    chunks[chunk][id & (chunkSize - 1)] = { key, hashName(key) };
+    ids.emplace(std::move(key), id);
+    count.store(id + 1, std::memory_order_release);
+    return id;
+}
+
+const std::string& SymbolTable::getName(SymbolId id) const {
+    return at(id).name;
+}
+
+std::size_t SymbolTable::getHash(SymbolId id) const {
+    return at(id).hash;
+}
+
+std::size_t SymbolTable::size() const {
+    return count.load(std::memory_order_acquire);
+}
+
+const SymbolTable::Symbol& SymbolTable::at(SymbolId id) const {
+    return chunks[id >> chunkBits][id & (chunkSize - 1)];
+}
+
+SymbolTable& SymbolTable::global() {
+    static SymbolTable table;
+    return table;
+}
+
+SymbolId autodiff::internSymbol(std::string_view name) {
+    return SymbolTable::global().intern(name);
+}
+
+const std::string& autodiff::symbolName(SymbolId id) {
+    return SymbolTable::global().getName(id);
+}
+
+void autodiff::sortByName(std::vector<SymbolId>& ids) {
+    std::sort(ids.begin(), ids.end(), [](SymbolId a, SymbolId b) {
+        return symbolName(a) < symbolName(b);
+    });
+}
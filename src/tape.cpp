@@ -0,0 +1,212 @@
+#include <iostream>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+#include "tape.hpp"
+
+using namespace autodiff;
+
+void Tape::evaluate(const double* inputs, double* results) {
+    run(inputs);
+    for (size_t k = 0; k < outputs.size(); ++k) {
+        results[k] = registers[outputs[k]];
+    }
+}
+
+double Tape::evaluate(const double* inputs) {
+    run(inputs);
+    return outputs.empty() ? std::numeric_limits<double>::quiet_NaN() : registers[outputs[0]];
+}
+
+void Tape::run(const double* inputs) {
+    double* r = registers.data();
+    std::memcpy(r, inputs, inputCount * sizeof(double));
+    for (const Instruction& ins : instructions) {
+        switch (ins.op) {
+            case OpCode::ADD: r[ins.dst] = r[ins.a] + r[ins.b]; break;
+            case OpCode::SUB: r[ins.dst] = r[ins.a] - r[ins.b]; break;
+            case OpCode::MUL: r[ins.dst] = r[ins.a] * r[ins.b]; break;
+            case OpCode::DIV: r[ins.dst] = r[ins.a] / r[ins.b]; break;
+            case OpCode::POW: r[ins.dst] = std::pow(r[ins.a], r[ins.b]); break;
+            case OpCode::LN: r[ins.dst] = std::log(r[ins.a]); break;
+            case OpCode::LOG: r[ins.dst] = std::log(r[ins.b]) / std::log(r[ins.a]); break;
+            case OpCode::COS: r[ins.dst] = std::cos(r[ins.a]); break;
+            case OpCode::SIN: r[ins.dst] = std::sin(r[ins.a]); break;
+            case OpCode::TAN: r[ins.dst] = std::tan(r[ins.a]); break;
+            case OpCode::EXP: r[ins.dst] = std::exp(r[ins.a]); break;
+        }
+    }
+}
+
+size_t Tape::numInputs() const {
+    return inputCount;
+}
+
+size_t Tape::numOutputs() const {
+    return outputs.size();
+}
+
+size_t Tape::numRegisters() const {
+    return registers.size();
+}
+
+const std::vector<Instruction>& Tape::getInstructions() const {
+    return instructions;
+}
+
+const std::vector<std::uint32_t>& Tape::getOutputs() const {
+    return outputs;
+}
+
+const std::vector<double>& Tape::getRegisters() const {
+    return registers;
+}
+
+TapeCompiler::TapeCompiler(const std::vector<SymbolId>& vars) : vars(vars) {}
+
+Tape TapeCompiler::compile(ExprNodePtr root) {
+    return compile(std::vector<ExprNodePtr>{ root });
+}
+
+Tape TapeCompiler::compile(const std::vector<ExprNodePtr>& roots) {
+    Tape tape;
+    tape.inputCount = vars.size();
+    tape.registers.assign(vars.size(), 0.0);
+
+    const std::uint32_t unbound = std::numeric_limits<std::uint32_t>::max();
+    std::vector<std::uint32_t> varIndex; // symbol id -> input register
+    for (size_t i = 0; i < vars.size(); ++i) {
+        if (vars[i] >= varIndex.size()) {
+            varIndex.resize(vars[i] + 1, unbound);
+        }
+        varIndex[vars[i]] = static_cast<std::uint32_t>(i);
+    }
+
+    std::vector<ExprNodePtr> order = topologicalOrder(roots);
+    std::unordered_map<ExprNodePtr, std::uint32_t> regOf;
+    auto addConstant = [&tape](double value) {
+        tape.registers.push_back(value);
+        return static_cast<std::uint32_t>(tape.registers.size() - 1);
+    };
+
+    // First pass: leaves. Constants sit right after the inputs and are never overwritten.
+    std::unordered_map<ExprNodePtr, int> pendingUses;
+    for (ExprNodePtr node : order) {
+        if (node->type == NodeType::NUMBER) {
+            regOf[node] = addConstant(node->number.toDouble());
+        } else if (node->type == NodeType::VARIABLE) {
+            std::uint32_t index = node->symbol < varIndex.size() ? varIndex[node->symbol] : unbound;
+            if (index != unbound) {
+                regOf[node] = index;
+            } else {
+                std::cerr << "Error: Unbound variable " << symbolName(node->symbol) << " in TapeCompiler" << std::endl;
+                regOf[node] = addConstant(std::numeric_limits<double>::quiet_NaN());
+            }
+        } else {
+            ++pendingUses[node->left];
+            if (node->right) {
+                ++pendingUses[node->right];
+            }
+        }
+    }
+    std::uint32_t firstTemporary = static_cast<std::uint32_t>(tape.registers.size());
+    std::unordered_set<ExprNodePtr> pinned;
+    for (ExprNodePtr root : roots) {
+        pinned.insert(root);
+    }
+
+    // Second pass: one instruction per interior node. A temporary returns to
+    // the free list after its last use unless it holds an output.
+    std::vector<std::uint32_t> freeList;
+    auto release = [&](ExprNodePtr operand) {
+        std::uint32_t reg = regOf[operand];
+        if (--pendingUses[operand] == 0 && reg >= firstTemporary && !pinned.count(operand)) {
+            freeList.push_back(reg);
+        }
+    };
+    for (ExprNodePtr node : order) {
+        if (node->type == NodeType::NUMBER || node->type == NodeType::VARIABLE) {
+            continue;
+        }
+        Instruction ins;
+        ins.op = getOpCode(node);
+        ins.a = regOf[node->left];
+        ins.b = node->right ? regOf[node->right] : ins.a;
+        // Operands are read before dst is written, so dst may reuse one of them.
+        release(node->left);
+        if (node->right) {
+            release(node->right);
+        }
+        if (!freeList.empty()) {
+            ins.dst = freeList.back();
+            freeList.pop_back();
+        } else {
+            tape.registers.push_back(0.0);
+            ins.dst = static_cast<std::uint32_t>(tape.registers.size() - 1);
+        }
+        regOf[node] = ins.dst;
+        tape.instructions.push_back(ins);
+    }
+
+    for (ExprNodePtr root : roots) {
+        tape.outputs.push_back(root ? regOf[root] : addConstant(std::numeric_limits<double>::quiet_NaN()));
+    }
+    return tape;
+}
+
+std::vector<ExprNodePtr> TapeCompiler::topologicalOrder(const std::vector<ExprNodePtr>& roots) const {
+    std::vector<ExprNodePtr> order;
+    std::unordered_set<ExprNodePtr> visited;
+    std::vector<std::pair<ExprNodePtr, bool>> stack; // (node, children already pushed)
+    for (auto it = roots.rbegin(); it != roots.rend(); ++it) {
+        if (*it) {
+            stack.emplace_back(*it, false);
+        }
+    }
+    while (!stack.empty()) {
+        auto [node, expanded] = stack.back();
+        stack.pop_back();
+        if (expanded) {
+            order.push_back(node);
+            continue;
+        }
+        if (!visited.insert(node).second) {
+            continue;
+        }
+        stack.emplace_back(node, true);
+        if (node->right) {
+            stack.emplace_back(node->right, false);
+        }
+        if (node->left) {
+            stack.emplace_back(node->left, false);
+        }
+    }
+    return order;
+}
+
+OpCode TapeCompiler::getOpCode(ExprNodePtr node) const {
+    if (node->type == NodeType::OPERATOR) {
+        switch (node->opType) {
+            case OperatorType::ADD: return OpCode::ADD;
+            case OperatorType::SUB: return OpCode::SUB;
+            case OperatorType::MUL: return OpCode::MUL;
+            case OperatorType::DIV: return OpCode::DIV;
+            default: return OpCode::POW;
+        }
+    }
+    switch (node->funcType) {
+        case FunctionType::LN: return OpCode::LN;
+        case FunctionType::LOG: return OpCode::LOG;
+        case FunctionType::COS: return OpCode::COS;
+        case FunctionType::SIN: return OpCode::SIN;
+        case FunctionType::TAN: return OpCode::TAN;
+        case FunctionType::EXP: return OpCode::EXP;
+        default: return OpCode::POW; // POW_FUNC
+    }
+}
@@ -0,0 +1,155 @@
+#include <algorithm>
+
+#include "thread_pool.hpp"
+
+using namespace autodiff;
+
+namespace {
+    // Which pool, if any, the calling thread works for.
+    struct WorkerIdentity {
+        const ThreadPool* pool = nullptr;
+        size_t index = 0;
+    };
+    thread_local WorkerIdentity identity;
+}
+
+bool TaskGroup::done() const {
+    return pending.load(std::memory_order_acquire) == 0;
+}
+
+ThreadPool::ThreadPool(size_t numThreads) {
+    if (numThreads == 0) {
+        numThreads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < numThreads; ++i) {
+        workers.emplace_back(new Worker());
+    }
+    for (size_t i = 0; i < numThreads; ++i) {
+        threads.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+size_t ThreadPool::size() const {
+    return workers.size();
+}
+
+size_t ThreadPool::currentWorker() const {
+    return identity.pool == this ? identity.index : size();
+}
+
+void ThreadPool::submit(TaskGroup& group, std::function<void()> task) {
+    group.pending.fetch_add(1, std::memory_order_relaxed);
+    size_t index = currentWorker();
+    if (index == size()) {
+        // Kept off the workers' deques, where it could bury the tasks a waiting
+        // worker is allowed to run.
+        std::lock_guard<std::mutex> lock(injectionMutex);
+        injection.push_back({ &group, std::move(task) });
+    } else {
+        std::lock_guard<std::mutex> lock(workers[index]->mutex);
+        workers[index]->tasks.push_back({ &group, std::move(task) });
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        queued.fetch_add(1, std::memory_order_release);
+    }
+    wake.notify_one();
+}
+
+void ThreadPool::wait(TaskGroup& group) {
+    size_t index = currentWorker();
+    if (index == size()) {
+        std::unique_lock<std::mutex> lock(group.mutex);
+        group.finished.wait(lock, [&group] { return group.done(); });
+        return;
+    }
+    while (!group.done()) {
+        Task task;
+        if (popOwn(index, &group, task) || steal(index, &group, task)) {
+            execute(task);
+        } else {
+            std::this_thread::yield(); // the rest is running elsewhere
+        }
+    }
+    // The last task signals under the group's mutex; let it leave before the
+    // caller is free to destroy the group.
+    std::lock_guard<std::mutex> lock(group.mutex);
+}
+
+// Newest first, and only tasks of group unless it is null.
+bool ThreadPool::popOwn(size_t index, TaskGroup* group, Task& task) {
+    Worker& worker = *workers[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.tasks.empty() || (group && worker.tasks.back().group != group)) {
+        return false;
+    }
+    task = std::move(worker.tasks.back());
+    worker.tasks.pop_back();
+    queued.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool ThreadPool::popInjected(Task& task) {
+    std::lock_guard<std::mutex> lock(injectionMutex);
+    if (injection.empty()) {
+        return false;
+    }
+    task = std::move(injection.front());
+    injection.pop_front();
+    queued.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+// Oldest first: those tend to be the largest pieces of work.
+bool ThreadPool::steal(size_t thief, TaskGroup* group, Task& task) {
+    for (size_t offset = 1; offset < workers.size(); ++offset) {
+        Worker& victim = *workers[(thief + offset) % workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        auto found = std::find_if(victim.tasks.begin(), victim.tasks.end(),
+                                  [group](const Task& candidate) { return !group || candidate.group == group; });
+        if (found != victim.tasks.end()) {
+            task = std::move(*found);
+            victim.tasks.erase(found);
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::execute(Task& task) {
+    task.run();
+    TaskGroup& group = *task.group;
+    std::lock_guard<std::mutex> lock(group.mutex);
+    if (group.pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        group.finished.notify_all();
+    }
+}
+
+void ThreadPool::workerLoop(size_t index) {
+    identity.pool = this;
+    identity.index = index;
+    while (true) {
+        Task task;
+        if (popOwn(index, nullptr, task) || popInjected(task) || steal(index, nullptr, task)) {
+            execute(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this] { return stopping || queued.load(std::memory_order_acquire) > 0; });
+        if (stopping && queued.load(std::memory_order_acquire) == 0) {
+            return;
+        }
+    }
+}
@@ -1,71 +1,133 @@
-#include <algorithm>
 #include <iostream>
 #include <string>
+#include <unordered_set>
 
 #include "tokenizer.hpp"
+#include "pipeline_stats.hpp"
 
 using namespace autodiff;
 
-Tokenizer::Tokenizer(const std::string& expr) : expr(expr), cur_pos(0) {}
+Tokenizer::Tokenizer(std::string_view expr) : expr(expr), cur_pos(0), previous(TokenKind::END) {}
 
-std::vector<std::string> Tokenizer::tokenize() {
+void Tokenizer::reset(std::string_view expr) {
+    this->expr = expr;
     cur_pos = 0;
-    std::vector<std::string> tokens;
-    while (cur_pos < expr.size()) {
-        char c = expr[cur_pos];
-        if ((c == '-') && (cur_pos == 0 || expr[cur_pos - 1] == '(')) {
-            tokens.push_back("-" + getNumber());
-        }
-        else if (isDigit(c)) {
-            tokens.push_back(getNumber());
-        } else if (isLetter(c)) {
-            tokens.push_back(getLetters());
-        } else if (isOperator(c)) {
-            tokens.push_back(getOperator());
-        } else {
-            ++cur_pos;
-        }
-    }
+    previous = TokenKind::END;
+}
+
+std::vector<Token> Tokenizer::tokenize() {
+    StageTimer timer(Stage::TOKENIZE);
+    cur_pos = 0;
+    previous = TokenKind::END;
+    std::vector<Token> tokens;
+    tokens.reserve(expr.size() / 3 + 1); // about one token per three characters in practice
+    do {
+        tokens.push_back(next());
+    } while (tokens.back().kind != TokenKind::END);
+    timer.finishLength(tokens.size());
     return tokens;
 }
 
-std::vector<std::string> Tokenizer::getVariables() {
+std::vector<SymbolId> Tokenizer::getVariables() {
     cur_pos = 0;
-    std::vector<std::string> vars;
+    previous = TokenKind::END;
+    std::vector<SymbolId> vars;
+    std::unordered_set<SymbolId> seen;
+    Token token;
+    do {
+        token = next();
+        if (token.kind == TokenKind::VARIABLE && seen.insert(token.symbol).second) {
+            vars.push_back(token.symbol);
+        }
+    } while (token.kind != TokenKind::END);
+    return vars;
+}
+
+// A '-' directly after '(' or at the start reads as a negative literal.
+Token Tokenizer::next() {
+    Token token{ TokenKind::END, OperatorType::NONE_OP, FunctionType::NONE_FUNC, 0, std::string_view() };
     while (cur_pos < expr.size()) {
         char c = expr[cur_pos];
-        if (isLetter(c)) {
-            std::string var = getLetters();
-            if (!isFunction(var) && std::find(vars.begin(), vars.end(), var) == vars.end()) {
-                vars.push_back(var);
+        size_t start = cur_pos;
+        if (c == '-' && (previous == TokenKind::END || previous == TokenKind::LEFT_PAREN)
+            && cur_pos + 1 < expr.size() && isDigit(expr[cur_pos + 1])) {
+            ++cur_pos;
+            getNumber();
+            token.kind = TokenKind::NUMBER;
+            token.text = expr.substr(start, cur_pos - start);
+            break;
+        } else if (isDigit(c)) {
+            token.kind = TokenKind::NUMBER;
+            token.text = getNumber();
+            break;
+        } else if (isLetter(c)) {
+            token.text = getLetters();
+            token.funcType = getFunctionType(token.text);
+            if (token.funcType != FunctionType::NONE_FUNC) {
+                token.kind = TokenKind::FUNCTION;
+            } else {
+                token.kind = TokenKind::VARIABLE;
+                token.symbol = intern(token.text);
+            }
+            break;
+        } else if (isOperator(c)) {
+            token.text = expr.substr(cur_pos++, 1);
+            switch (c) {
+                case '(':
+                    token.kind = TokenKind::LEFT_PAREN;
+                    break;
+                case ')':
+                    token.kind = TokenKind::RIGHT_PAREN;
+                    break;
+                case ',':
+                    token.kind = TokenKind::COMMA;
+                    break;
+                default:
+                    token.kind = TokenKind::OPERATOR;
+                    token.opType = c == '+' ? OperatorType::ADD
+                        : c == '-' ? OperatorType::SUB
+                        : c == '*' ? OperatorType::MUL
+                        : c == '/' ? OperatorType::DIV
+                        : OperatorType::POW;
+                    break;
             }
+            break;
         } else {
             ++cur_pos;
         }
     }
-    return vars;
+    previous = token.kind;
+    return token;
 }
 
-std::string Tokenizer::getNumber() {
-    std::string number;
-    while (cur_pos < expr.size() && isDigit(expr[cur_pos])) {
-        number += expr[cur_pos++];
+// Repeated names resolve through a local table keyed by views into expr,
+// without touching the shared symbol table again.
+SymbolId Tokenizer::intern(std::string_view name) {
+    auto found = symbols.find(name);
+    if (found != symbols.end()) {
+        return found->second;
     }
-    return number;
+    SymbolId id = internSymbol(name);
+    // Key on the table's copy of the name, which never moves, so the cache
+    // stays valid when reset() moves on to another expression.
+    symbols.emplace(symbolName(id), id);
+    return id;
 }
 
-std::string Tokenizer::getLetters() {
-    std::string var;
-    while (cur_pos < expr.size() && isLetter(expr[cur_pos])) {
-        var += expr[cur_pos++];
+std::string_view Tokenizer::getNumber() {
+    size_t start = cur_pos;
+    while (cur_pos < expr.size() && isDigit(expr[cur_pos])) {
+        ++cur_pos;
     }
-    return var;
+    return expr.substr(start, cur_pos - start);
 }
 
-std::string Tokenizer::getOperator() {
-    std::string op;
-    op += expr[cur_pos++];
-    return op;
+std::string_view Tokenizer::getLetters() {
+    size_t start = cur_pos;
+    while (cur_pos < expr.size() && isLetter(expr[cur_pos])) {
+        ++cur_pos;
+    }
+    return expr.substr(start, cur_pos - start);
 }
 
 bool autodiff::isDigit(char c) {
@@ -81,7 +143,28 @@ bool autodiff::isOperator(char c) {
         || c == '^' || c == '(' || c == ')' || c == ',';
 }
 
-bool autodiff::isFunction(const std::string& s) {
-    return s == "sin" || s == "cos" || s == "tan" || s == "exp"
-        || s == "log" || s == "ln" || s == "pow";
-}
\ No newline at end of file
+bool autodiff::isFunction(std::string_view s) {
+    return getFunctionType(s) != FunctionType::NONE_FUNC;
+}
+
+FunctionType autodiff::getFunctionType(std::string_view s) {
+    if (s.size() < 2 || s.size() > 3) { // every name below is 2 or 3 letters
+        return FunctionType::NONE_FUNC;
+    }
+    if (s == "ln") {
+        return FunctionType::LN;
+    } else if (s == "log") {
+        return FunctionType::LOG;
+    } else if (s == "cos") {
+        return FunctionType::COS;
+    } else if (s == "sin") {
+        return FunctionType::SIN;
+    } else if (s == "tan") {
+        return FunctionType::TAN;
+    } else if (s == "exp") {
+        return FunctionType::EXP;
+    } else if (s == "pow") {
+        return FunctionType::POW_FUNC;
+    }
+    return FunctionType::NONE_FUNC;
+}
@@ -1,64 +1,193 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <unordered_map>
 
 #include "tree_printer.hpp"
 #include "expr_node.hpp"
+#include "pipeline_stats.hpp"
 
 using namespace autodiff;
 
-std::string TreePrinter::print(const ExprNodePtr& node) const {
-    return printNode(node);
+namespace {
+    const size_t blockSize = 1 << 16;
 }
 
-std::string TreePrinter::printNode(const ExprNodePtr& node) const {
-    if (!node) {
-        return "";
+std::string TreePrinter::print(ExprNodePtr node) {
+    StageTimer timer(Stage::PRINT, node);
+    std::string out;
+    append(node, nullptr, out);
+    timer.finishLength(out.size());
+    return out;
+}
+
+void TreePrinter::print(ExprNodePtr node, std::string& out) {
+    StageTimer timer(Stage::PRINT, node);
+    size_t start = out.size();
+    append(node, nullptr, out);
+    timer.finishLength(out.size() - start);
+}
+
+void TreePrinter::print(ExprNodePtr node, std::ostream& out) {
+    StageTimer timer(Stage::PRINT, node);
+    block.clear();
+    flushed = 0;
+    append(node, nullptr, block, &out);
+    out.write(block.data(), block.size());
+    timer.finishLength(flushed + block.size());
+}
+
+// A subtree is a candidate when it is reached from more than one place: two
+// parents, a parent using it twice, or several roots. Edges are counted once
+// per distinct parent, so the inside of a repeated subtree only counts once.
+SharedPrint TreePrinter::printShared(const std::vector<ExprNodePtr>& roots) {
+    StageTimer timer(Stage::PRINT, roots);
+    std::unordered_map<ExprNodePtr, size_t> uses;
+    std::vector<ExprNodePtr> order; // children before parents
+    std::vector<std::pair<ExprNodePtr, bool>> pending; // (node, children already pushed)
+    for (ExprNodePtr root : roots) {
+        if (root) { // a root that failed to build prints as empty
+            pending.emplace_back(root, false);
+        }
     }
-    switch (node->type) {
-        case NodeType::NUMBER:
-        case NodeType::VARIABLE:
-            return node->value;
-        case NodeType::OPERATOR:
-            return printOperator(node);
-        case NodeType::FUNCTION:
-            return printFunction(node);
+    while (!pending.empty()) {
+        auto [node, expanded] = pending.back();
+        if (expanded) {
+            pending.pop_back();
+            order.push_back(node);
+            continue;
+        }
+        if (uses[node]++ > 0) {
+            pending.pop_back();
+            continue;
+        }
+        pending.back().second = true;
+        if (node->right) {
+            pending.emplace_back(node->right, false);
+        }
+        if (node->left) {
+            pending.emplace_back(node->left, false);
+        }
     }
-    return "";
+
+    SharedPrint result;
+    Names names;
+    for (ExprNodePtr node : order) {
+        bool leaf = node->type == NodeType::NUMBER || node->type == NodeType::VARIABLE;
+        if (leaf || uses[node] < 2) {
+            continue;
+        }
+        std::string definition;
+        append(node, &names, definition);
+        std::string name = "t" + std::to_string(result.names.size() + 1);
+        // Worth it only if writing the text once, plus "name = " and the name
+        // at every use, is shorter than writing the text at every use.
+        if (uses[node] * definition.size() <= definition.size() + name.size() + 4 + uses[node] * name.size()) {
+            continue;
+        }
+        names.emplace(node, name);
+        result.names.push_back(std::move(name));
+        result.definitions.push_back(std::move(definition));
+    }
+    for (ExprNodePtr root : roots) {
+        auto bound = names.find(root);
+        result.results.push_back(bound != names.end() ? bound->second : std::string());
+        if (root && bound == names.end()) {
+            append(root, &names, result.results.back());
+        }
+    }
+    size_t length = 0;
+    for (size_t i = 0; i < result.names.size(); ++i) {
+        length += result.names[i].size() + result.definitions[i].size();
+    }
+    for (const std::string& text : result.results) {
+        length += text.size();
+    }
+    timer.finishLength(length);
+    return result;
 }
 
-std::string TreePrinter::printOperator(const ExprNodePtr& node) const {
-    std::string leftStr = printNode(node->left);
-    std::string rightStr = printNode(node->right);
-    std::string opStr = getOperatorString(node->opType);
+// Walks the tree with an explicit stack of pending items, so output is
+// appended left to right in linear time and nesting depth does not touch
+// the call stack. Left operands are printed at once, so only what follows
+// them goes on the stack.
+void TreePrinter::append(ExprNodePtr node, const Names* names, std::string& out, std::ostream* sink) {
+    stack.clear();
+    stack.push_back({ node, 0 });
+    while (!stack.empty()) {
+        Item item = stack.back();
+        stack.pop_back();
+        if (!item.node) {
+            out += item.text;
+            continue;
+        }
+        ExprNodePtr current = item.node;
+        while (current) {
+            if (sink && out.size() >= blockSize) {
+                sink->write(out.data(), out.size());
+                flushed += out.size();
+                out.clear();
+            }
+            if (names && current != node) {
+                auto bound = names->find(current);
+                if (bound != names->end()) {
+                    out += bound->second;
+                    break;
+                }
+            }
+            switch (current->type) {
+                case NodeType::NUMBER:
+                    current->number.appendTo(out);
+                    current = nullptr;
+                    break;
+                case NodeType::VARIABLE:
+                    out += symbolName(current->symbol);
+                    current = nullptr;
+                    break;
+                case NodeType::OPERATOR:
+                    current = openOperator(current, names, out);
+                    break;
+                case NodeType::FUNCTION:
+                    current = openFunction(current, out);
+                    break;
+            }
+        }
+    }
+}
 
-    bool leftParen = needParentheses(node, node->left, false);
-    bool rightParen = needParentheses(node, node->right, true);
+// Pushes everything after the left operand, in reverse, and returns the left
+// operand. A bound operand prints as a name and never needs parentheses.
+ExprNodePtr TreePrinter::openOperator(ExprNodePtr node, const Names* names, std::string& out) {
+    bool leftParen = needParentheses(node, node->left, false) && !(names && names->count(node->left));
+    bool rightParen = needParentheses(node, node->right, true) && !(names && names->count(node->right));
 
-    if (leftParen) {
-        leftStr = "(" + leftStr + ")";
+    if (rightParen) {
+        stack.push_back({ nullptr, ')' });
     }
+    stack.push_back({ node->right, 0 });
     if (rightParen) {
-        rightStr = "(" + rightStr + ")";
+        stack.push_back({ nullptr, '(' });
     }
-
-    return leftStr + opStr + rightStr;
+    stack.push_back({ nullptr, getOperatorSymbol(node->opType) });
+    if (leftParen) {
+        stack.push_back({ nullptr, ')' });
+        out += '(';
+    }
+    return node->left;
 }
 
-std::string TreePrinter::printFunction(const ExprNodePtr& node) const {
-    std::string funcStr = getFunctionString(node->funcType);
-    FunctionType funcType = node->funcType;
-    if (funcType == FunctionType::LOG || funcType == FunctionType::POW_FUNC) {
-        std::string leftStr = printNode(node->left);
-        std::string rightStr = printNode(node->right);
-        return funcStr + "(" + leftStr + "," + rightStr + ")";
-    } else {
-        std::string argStr = printNode(node->left);
-        return funcStr + "(" + argStr + ")";
+ExprNodePtr TreePrinter::openFunction(ExprNodePtr node, std::string& out) {
+    out += getFunctionString(node->funcType);
+    out += '(';
+    stack.push_back({ nullptr, ')' });
+    if (node->funcType == FunctionType::LOG || node->funcType == FunctionType::POW_FUNC) {
+        stack.push_back({ node->right, 0 });
+        stack.push_back({ nullptr, ',' });
     }
+    return node->left;
 }
 
-int TreePrinter::getPrecedence(const ExprNodePtr& node) const {
+int TreePrinter::getPrecedence(ExprNodePtr node) const {
     if (node->type == NodeType::OPERATOR) {
         switch (node->opType) {
             case OperatorType::ADD:
@@ -71,16 +200,35 @@ int TreePrinter::getPrecedence(const ExprNodePtr& node) const {
                 return 3;
         }
     }
+    if (node->type == NodeType::NUMBER && node->number.getKind() == Number::Kind::RATIONAL) {
+        return 2; // printed as num/den
+    }
     return 0;
 }
 
-bool TreePrinter::needParentheses(const ExprNodePtr& parent, const ExprNodePtr& child, bool isRight) const {
+bool TreePrinter::needParentheses(ExprNodePtr parent, ExprNodePtr child, bool isRight) const {
     if (!child) {
         return false;
     }
-    if (parent->type == NodeType::OPERATOR && child->type == NodeType::OPERATOR) {
+    if (parent->type != NodeType::OPERATOR) {
+        return false;
+    }
+    if (child->type == NodeType::NUMBER && child->number.isNegative()
+        && (isRight || parent->opType == OperatorType::POW)) { // x-(-1), (-2)^x
+        return true;
+    }
+    if (isRight && child->type == NodeType::OPERATOR) { // x-(-1*y): the leftmost operand prints first
+        ExprNodePtr first = child->left;
+        while (first && first->type == NodeType::OPERATOR) {
+            first = first->left;
+        }
+        if (first && first->type == NodeType::NUMBER && first->number.isNegative()) {
+            return true;
+        }
+    }
+    int childPrec = getPrecedence(child);
+    if (childPrec > 0) {
         int parentPrec = getPrecedence(parent);
-        int childPrec = getPrecedence(child);
         if (parentPrec == childPrec) {
             if (isRight) {
                 return true;
@@ -92,23 +240,23 @@ bool TreePrinter::needParentheses(const ExprNodePtr& parent, const ExprNodePtr&
     return false;
 }
 
-std::string TreePrinter::getOperatorString(OperatorType op) const {
+char TreePrinter::getOperatorSymbol(OperatorType op) const {
     switch (op) {
         case OperatorType::ADD:
-            return "+";
+            return '+';
         case OperatorType::SUB:
-            return "-";
+            return '-';
         case OperatorType::MUL:
-            return "*";
+            return '*';
         case OperatorType::DIV:
-            return "/";
+            return '/';
         case OperatorType::POW:
-            return "^";
+            return '^';
     }
-    return "";
+    return '?';
 }
 
-std::string TreePrinter::getFunctionString(FunctionType func) const {
+const char* TreePrinter::getFunctionString(FunctionType func) const {
     switch (func) {
         case FunctionType::SIN:
             return "sin";